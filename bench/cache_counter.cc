@@ -0,0 +1,132 @@
+
+#include "cache_counter.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#endif
+
+namespace chipemu
+{
+namespace bench
+{
+
+#ifdef __linux__
+
+namespace
+{
+
+/* user space only, kernel.perf_event_paranoid = 2 still allows that */
+int
+open_counter(uint32_t type, uint64_t config)
+{
+    perf_event_attr attributes;
+
+    std::memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    attributes.type = type;
+    attributes.config = config;
+    attributes.disabled = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+
+    return int(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+}
+
+unsigned long long
+read_counter(int fd)
+{
+    uint64_t value = 0;
+
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &value, sizeof(value)) != ssize_t(sizeof(value))) {
+        return 0;
+    }
+    return value;
+}
+
+}
+
+cache_counter::cache_counter():
+    l1d_fd(open_counter(PERF_TYPE_HW_CACHE,
+                        PERF_COUNT_HW_CACHE_L1D
+                        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))),
+    llc_fd(open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES))
+{
+    if (l1d_fd < 0 or llc_fd < 0) {
+        if (l1d_fd >= 0) close(l1d_fd);
+        if (llc_fd >= 0) close(llc_fd);
+        l1d_fd = llc_fd = -1;
+    }
+}
+
+cache_counter::~cache_counter()
+{
+    if (available()) {
+        close(l1d_fd);
+        close(llc_fd);
+    }
+}
+
+bool
+cache_counter::available() const
+{
+    return l1d_fd >= 0;
+}
+
+void
+cache_counter::start()
+{
+    if (available()) {
+        ioctl(l1d_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(llc_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(l1d_fd, PERF_EVENT_IOC_ENABLE, 0);
+        ioctl(llc_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+cache_counter::misses
+cache_counter::stop()
+{
+    if (not available()) {
+        return {0, 0};
+    }
+    return {read_counter(l1d_fd), read_counter(llc_fd)};
+}
+
+#else
+
+cache_counter::cache_counter():
+    l1d_fd(-1),
+    llc_fd(-1)
+{}
+
+cache_counter::~cache_counter()
+{}
+
+bool
+cache_counter::available() const
+{
+    return false;
+}
+
+void
+cache_counter::start()
+{}
+
+cache_counter::misses
+cache_counter::stop()
+{
+    return {0, 0};
+}
+
+#endif
+
+}
+}
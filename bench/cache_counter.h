@@ -0,0 +1,50 @@
+
+#ifndef CHIPEMU_BENCH_CACHE_COUNTER_H
+#define CHIPEMU_BENCH_CACHE_COUNTER_H
+
+namespace chipemu
+{
+namespace bench
+{
+
+/* Counts the cache misses of the calling thread, using the hardware
+ * performance counters via perf_event_open on Linux.
+ *
+ * The counters are not available on other systems, in virtual machines
+ * without a virtual PMU, or when kernel.perf_event_paranoid forbids it,
+ * in which case available() returns false, and every count is zero.
+ */
+class cache_counter
+{
+    int l1d_fd;
+    int llc_fd;
+
+public:
+
+    struct misses
+    {
+        /* L1 data cache read misses */
+        unsigned long long l1d;
+
+        /* last level cache misses */
+        unsigned long long llc;
+    };
+
+    cache_counter();
+    ~cache_counter();
+
+    cache_counter(const cache_counter&) = delete;
+    cache_counter& operator=(const cache_counter&) = delete;
+
+    bool available() const;
+
+    void start();
+
+    /* the misses counted since start */
+    misses stop();
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,369 @@
+
+/* Microbenchmarks of the nmos engine
+ *
+ * Every kernel is run in batches of growing size, until a batch takes at
+ * least the minimum time ( -t ), and the rate is computed from the last
+ * batch. The kernels are run on the 6502 - with the nodes in the original
+ * order, renumbered ( 6502-rcm ), see MOS6500::renumber_netlist, and
+ * specialized for the pins tied to a constant level ( 6502-spec ), see
+ * MOS6500::pin_constant - and on generated netlists of different sizes,
+ * see synthetic.h
+ *
+ * The cache misses per operation are reported as well, where the
+ * hardware counters are available, see cache_counter.h
+ */
+
+#include "cache_counter.h"
+#include "mos65xx.h"
+#include "synthetic.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using chipemu::MOS6502;
+using chipemu::bench::cache_counter;
+using chipemu::bench::synthetic_chip;
+using chipemu::bench::synthetic_netlist;
+
+namespace
+{
+
+const char *program_name;
+double minimum_time = 0.5;
+bool json_output = false;
+unsigned thread_count = 1;
+unsigned region_count = 0;
+std::string filter;
+
+/* the results of reads are accumulated here, so they are not optimized away */
+volatile unsigned sink;
+
+struct result
+{
+    std::string target;
+    std::string kernel;
+    const char *unit;
+    unsigned node_count;
+    unsigned transistor_count;
+    unsigned long long operations;
+    unsigned long long evaluated_nodes;
+    double seconds;
+    cache_counter::misses misses;
+};
+
+std::vector<result> results;
+std::unique_ptr<cache_counter> counter;
+
+void
+measure(const chipemu::chip& chip,
+        const std::string& target,
+        const std::string& kernel,
+        const char *unit,
+        std::function<void(unsigned long long)> run)
+{
+    if (not filter.empty()
+            and (target + "/" + kernel).find(filter) == std::string::npos)
+    {
+        return;
+    }
+
+    typedef std::chrono::steady_clock clock;
+    unsigned long long batch = 1;
+
+    while (true) {
+        unsigned long long evaluated = chip.evaluated_node_count();
+
+        counter->start();
+
+        clock::time_point start = clock::now();
+
+        run(batch);
+
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        cache_counter::misses misses = counter->stop();
+
+        if (elapsed.count() >= minimum_time or batch >= (1ull << 40)) {
+            results.push_back({target, kernel, unit,
+                               chip.node_count(), chip.transistor_count(),
+                               batch,
+                               chip.evaluated_node_count() - evaluated,
+                               elapsed.count(),
+                               misses});
+            if (not json_output) {
+                const result& r = results.back();
+
+                printf("%-14s %-18s %14.1f %-17s %14.1f nodes/s",
+                       r.target.c_str(), r.kernel.c_str(),
+                       r.operations / r.seconds, r.unit,
+                       r.evaluated_nodes / r.seconds);
+                if (counter->available()) {
+                    printf(" %10.1f L1d-misses/op %8.1f LLC-misses/op",
+                           double(r.misses.l1d) / r.operations,
+                           double(r.misses.llc) / r.operations);
+                }
+                printf("\n");
+                fflush(stdout);
+            }
+            return;
+        }
+        batch *= 2;
+    }
+}
+
+class nop_bus : public chipemu::bus_handler
+{
+public:
+    virtual unsigned char read(unsigned) final
+    {
+        return 0xea;
+    }
+
+    virtual void write(unsigned, unsigned char) final
+    {
+    }
+};
+
+/* The specialized chip has RDY, SO, IRQ, and NMI tied to the levels
+ * written below, see MOS6500::pin_constant
+ */
+void
+bench_6502(const std::string& target, bool specialized)
+{
+    std::unique_ptr<MOS6502> CPU(specialized
+        ? MOS6502::create_specialized({{MOS6502::RDY, true},
+                                       {MOS6502::SO, false},
+                                       {MOS6502::IRQ, true},
+                                       {MOS6502::NMI, true}}, {})
+        : MOS6502::create());
+    nop_bus bus;
+    bool clock = true;
+
+    CPU->pin_write(MOS6502::RES, false);
+    CPU->pin_write(MOS6502::CLK0IN, true);
+    CPU->pin_write(MOS6502::RDY, true);
+    CPU->pin_write(MOS6502::SO, false);
+    CPU->pin_write(MOS6502::IRQ, true);
+    CPU->pin_write(MOS6502::NMI, true);
+    CPU->stabilize_network();
+    CPU->run_cycles(8, bus);
+    CPU->pin_write(MOS6502::RES, true);
+    CPU->run_cycles(8, bus);
+
+    /* NOPs from here on, the data bus is left as it is */
+    CPU->write_data_bus(0xea);
+    CPU->recalc();
+
+    measure(*CPU, target, "stabilize_network", "networks/s",
+        [&](unsigned long long count) {
+            while (count-- > 0) {
+                CPU->stabilize_network();
+            }
+        });
+    measure(*CPU, target, "half_cycle", "half-cycles/s",
+        [&](unsigned long long count) {
+            while (count-- > 0) {
+                clock = not clock;
+                CPU->pin_write(MOS6502::CLK0IN, clock);
+                CPU->recalc();
+            }
+        });
+    measure(*CPU, target, "read_nodes", "reads/s",
+        [&](unsigned long long count) {
+            unsigned value = 0;
+
+            while (count-- > 0) {
+                value += CPU->read_address_bus();
+            }
+            sink = value;
+        });
+    measure(*CPU, target, "write_nodes", "writes/s",
+        [&](unsigned long long count) {
+            while (count-- > 0) {
+                CPU->write_data_bus((unsigned char)count);
+            }
+        });
+    CPU->write_data_bus(0xea);
+    CPU->recalc();
+    measure(*CPU, target, "registers", "reads/s",
+        [&](unsigned long long count) {
+            unsigned value = 0;
+
+            while (count-- > 0) {
+                value += CPU->registers().PC;
+            }
+            sink = value;
+        });
+}
+
+void
+bench_synthetic(const synthetic_netlist& source)
+{
+    std::unique_ptr<synthetic_chip> chip;
+
+    if (region_count > 0) {
+        chip = synthetic_chip::create_partitioned(source, region_count);
+    }
+    else {
+        chip = synthetic_chip::create(source);
+        chip->set_thread_count(thread_count);
+    }
+
+    measure(*chip, source.name, "stabilize_network", "networks/s",
+        [&](unsigned long long count) {
+            while (count-- > 0) {
+                chip->stabilize_network();
+            }
+        });
+    measure(*chip, source.name, "half_cycle", "half-cycles/s",
+        [&](unsigned long long count) {
+            while (count-- > 0) {
+                chip->half_cycle();
+            }
+        });
+    measure(*chip, source.name, "read_nodes", "reads/s",
+        [&](unsigned long long count) {
+            unsigned value = 0;
+
+            while (count-- > 0) {
+                value += chip->read_outputs();
+            }
+            sink = value;
+        });
+}
+
+void
+print_json()
+{
+    printf("{\n  \"minimum_time\": %g,\n  \"threads\": %u,\n"
+           "  \"regions\": %u,\n"
+           "  \"benchmarks\": [", minimum_time, thread_count, region_count);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const result& r = results[i];
+
+        printf("%s\n    {\"target\": \"%s\", \"kernel\": \"%s\", "
+               "\"node_count\": %u, \"transistor_count\": %u, "
+               "\"operations\": %llu, \"seconds\": %.6f, "
+               "\"operations_per_second\": %.1f, \"unit\": \"%s\", "
+               "\"nodes_evaluated\": %llu, "
+               "\"nodes_evaluated_per_second\": %.1f",
+               (i == 0) ? "" : ",",
+               r.target.c_str(), r.kernel.c_str(),
+               r.node_count, r.transistor_count,
+               r.operations, r.seconds,
+               r.operations / r.seconds, r.unit,
+               r.evaluated_nodes,
+               r.evaluated_nodes / r.seconds);
+        if (counter->available()) {
+            printf(", \"l1d_misses\": %llu, \"llc_misses\": %llu}",
+                   r.misses.l1d, r.misses.llc);
+        }
+        else {
+            printf(", \"l1d_misses\": null, \"llc_misses\": null}");
+        }
+    }
+    printf("\n  ]\n}\n");
+}
+
+void
+usage_exit(int exit_code)
+{
+    FILE *output = ((exit_code == EXIT_SUCCESS) ? stdout : stderr);
+
+    fprintf(output, "Microbenchmarks of the chipemu nmos engine\n"
+     "Usage:\n"
+     "%s [-h] [-j] [-t seconds] [-p threads] [-k regions] [-f filter]\n"
+     "  -h\n"
+     "  --help          print this text, and exit\n"
+     "  -j\n"
+     "  --json          print the results as JSON\n"
+     "  -t seconds\n"
+     "  --time seconds  minimum time to run each benchmark, default 0.5\n"
+     "  -p threads\n"
+     "  --threads count number of threads used by recalc on the generated\n"
+     "                  netlists, default 1\n"
+     "  -k regions\n"
+     "  --regions count partition the generated netlists into regions,\n"
+     "                  simulated on a thread each, see\n"
+     "                  nmos_chip::load_partitioned\n"
+     "  -f text\n"
+     "  --filter text   only run benchmarks with `text` in their name,\n"
+     "                  e.g. 6502/half_cycle, or bus/\n",
+     program_name ? program_name : "./chipemu_bench");
+    exit(exit_code);
+}
+
+void
+process_arguments(char **arg)
+{
+    if (*arg == nullptr) return;
+    program_name = *arg++;
+    while (*arg != nullptr) {
+        std::string argument(*arg++);
+
+        if (argument == "-h" or argument == "--help") {
+            usage_exit(EXIT_SUCCESS);
+        }
+        else if (argument == "-j" or argument == "--json") {
+            json_output = true;
+        }
+        else if (argument == "-t" or argument == "--time") {
+            if (*arg == nullptr) usage_exit(2);
+            minimum_time = atof(*arg++);
+            if (not (minimum_time > 0)) usage_exit(2);
+        }
+        else if (argument == "-p" or argument == "--threads") {
+            if (*arg == nullptr) usage_exit(2);
+            thread_count = unsigned(atoi(*arg++));
+            if (thread_count == 0) usage_exit(2);
+        }
+        else if (argument == "-k" or argument == "--regions") {
+            if (*arg == nullptr) usage_exit(2);
+            region_count = unsigned(atoi(*arg++));
+            if (region_count == 0) usage_exit(2);
+        }
+        else if (argument == "-f" or argument == "--filter") {
+            if (*arg == nullptr) usage_exit(2);
+            filter = *arg++;
+        }
+        else {
+            usage_exit(2);
+        }
+    }
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    process_arguments(argv);
+
+    counter.reset(new cache_counter);
+    if (not counter->available() and not json_output) {
+        printf("cache miss counters are not available\n");
+    }
+
+    bench_6502("6502", false);
+    bench_6502("6502-spec", true);
+    MOS6502::renumber_netlist(true);
+    bench_6502("6502-rcm", false);
+    MOS6502::renumber_netlist(false);
+    for (unsigned length : {1000u, 10000u, 100000u}) {
+        bench_synthetic(chipemu::bench::inverter_chain(length));
+    }
+    for (unsigned length : {1000u, 10000u, 100000u}) {
+        bench_synthetic(chipemu::bench::inverter_ring(length));
+    }
+    for (unsigned width : {16u, 256u, 4096u}) {
+        bench_synthetic(chipemu::bench::pass_transistor_bus(width));
+    }
+
+    if (json_output) {
+        print_json();
+    }
+}
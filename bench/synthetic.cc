@@ -0,0 +1,327 @@
+
+#include "synthetic.h"
+
+#include "nmos_partitioned.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace chipemu
+{
+namespace bench
+{
+
+using implementation::basic_chip_description;
+using implementation::basic_nmos;
+using implementation::basic_partitioned_nmos;
+using implementation::basic_transdef;
+
+namespace
+{
+
+/* node ids 1 and 2 are reserved for power, and ground */
+uint32_t
+add_node(synthetic_netlist& result, bool pullup)
+{
+    if (result.pullups.empty()) {
+        result.pullups.assign(3, false);
+    }
+    result.pullups.push_back(pullup);
+    return uint32_t(result.pullups.size() - 1);
+}
+
+void
+add_transistor(synthetic_netlist& result,
+               uint32_t gate, uint32_t c1, uint32_t c2)
+{
+    result.transistors.push_back(gate);
+    result.transistors.push_back(c1);
+    result.transistors.push_back(c2);
+}
+
+void
+add_outputs(synthetic_netlist& result, const std::vector<uint32_t>& nodes)
+{
+    const size_t count = std::min<size_t>(nodes.size(), 32);
+
+    for (size_t i = 0; i < count; ++i) {
+        result.outputs.push_back(nodes[i * nodes.size() / count]);
+    }
+}
+
+template<typename id_type>
+struct synthetic_description
+{
+    std::vector<basic_transdef<id_type>> transistors;
+    std::unique_ptr<bool[]> pullups;
+    basic_chip_description<id_type> description;
+
+    static std::vector<basic_transdef<id_type>>
+    convert_transistors(const synthetic_netlist& source)
+    {
+        std::vector<basic_transdef<id_type>> result;
+        const uint32_t *t = source.transistors.data();
+
+        result.reserve(source.transistor_count());
+        for (unsigned i = 0; i < source.transistor_count(); ++i, t += 3) {
+            result.emplace_back(id_type(t[0]), id_type(t[1]), id_type(t[2]));
+        }
+        return result;
+    }
+
+    static std::unique_ptr<bool[]>
+    convert_pullups(const synthetic_netlist& source)
+    {
+        std::unique_ptr<bool[]> result(new bool[source.node_count()]);
+
+        for (unsigned i = 0; i < source.node_count(); ++i) {
+            result[i] = source.pullups[i + 1];
+        }
+        return result;
+    }
+
+    explicit synthetic_description(const synthetic_netlist& source):
+        transistors(convert_transistors(source)),
+        pullups(convert_pullups(source)),
+        description{source.node_count(),
+                    pullups.get(),
+                    unsigned(transistors.size()),
+                    transistors.data(),
+                    id_type(synthetic_netlist::power),
+                    id_type(synthetic_netlist::ground)}
+    {}
+};
+
+template<typename id_type>
+class implementation_synthetic : private synthetic_description<id_type>,
+                                 public basic_nmos<id_type>,
+                                 public synthetic_chip
+{
+    typedef synthetic_description<id_type> described;
+    typedef basic_nmos<id_type> engine;
+
+    std::string chip_name;
+    std::vector<id_type> inputs;
+    std::vector<id_type> outputs;
+    size_t next_input;
+
+public:
+
+    explicit implementation_synthetic(const synthetic_netlist& source):
+        described(source),
+        engine(described::description),
+        chip_name(source.name),
+        inputs(source.inputs.begin(), source.inputs.end()),
+        outputs(source.outputs.begin(), source.outputs.end()),
+        next_input(0)
+    {
+        engine::stabilize_network();
+    }
+
+    virtual const char *name() const noexcept final
+    {
+        return chip_name.c_str();
+    }
+
+    virtual void half_cycle() noexcept final
+    {
+        const id_type input = inputs[next_input];
+
+        engine::set_node(input, not engine::get_node(input));
+        engine::recalc();
+        next_input = (next_input + 1) % inputs.size();
+    }
+
+    virtual unsigned read_outputs() const noexcept final
+    {
+        return engine::read_nodes(outputs.data(), unsigned(outputs.size()));
+    }
+
+    virtual void set_thread_count(unsigned count) final
+    {
+        engine::set_thread_count(count);
+    }
+
+    virtual ~implementation_synthetic() {}
+};
+
+template<typename id_type>
+class partitioned_synthetic : private synthetic_description<id_type>,
+                              public basic_partitioned_nmos<id_type>,
+                              public synthetic_chip
+{
+    typedef synthetic_description<id_type> described;
+    typedef basic_partitioned_nmos<id_type> engine;
+
+    std::string chip_name;
+    std::vector<id_type> inputs;
+    std::vector<id_type> outputs;
+    size_t next_input;
+
+public:
+
+    partitioned_synthetic(const synthetic_netlist& source,
+                          unsigned region_count):
+        described(source),
+        engine(described::description, region_count),
+        chip_name(source.name),
+        inputs(source.inputs.begin(), source.inputs.end()),
+        outputs(source.outputs.begin(), source.outputs.end()),
+        next_input(0)
+    {
+        engine::stabilize_network();
+    }
+
+    virtual const char *name() const noexcept final
+    {
+        return chip_name.c_str();
+    }
+
+    virtual void half_cycle() noexcept final
+    {
+        const id_type input = inputs[next_input];
+
+        engine::set_node(input, not engine::get_node(input));
+        engine::recalc();
+        next_input = (next_input + 1) % inputs.size();
+    }
+
+    virtual unsigned read_outputs() const noexcept final
+    {
+        unsigned value = 0;
+
+        for (id_type id : outputs) {
+            value = (value << 1) + (engine::get_node(id) ? 1 : 0);
+        }
+        return value;
+    }
+
+    virtual void set_thread_count(unsigned) final
+    {
+        throw std::logic_error("partitioned chip");
+    }
+
+    virtual ~partitioned_synthetic() {}
+};
+
+}
+
+synthetic_netlist
+inverter_chain(unsigned length)
+{
+    synthetic_netlist result;
+    std::vector<uint32_t> chain;
+    uint32_t previous = add_node(result, false);
+
+    result.name = "chain/" + std::to_string(length);
+    result.inputs.push_back(previous);
+    for (unsigned i = 0; i < length; ++i) {
+        uint32_t node = add_node(result, true);
+
+        add_transistor(result, previous, node, synthetic_netlist::ground);
+        chain.push_back(node);
+        previous = node;
+    }
+    add_outputs(result, chain);
+    return result;
+}
+
+synthetic_netlist
+inverter_ring(unsigned length)
+{
+    synthetic_netlist result;
+    std::vector<uint32_t> ring;
+    const uint32_t set = add_node(result, false);
+    const uint32_t clear = add_node(result, false);
+
+    length = std::max(2u, length + (length & 1));
+    result.name = "ring/" + std::to_string(length);
+    for (unsigned i = 0; i < length; ++i) {
+        ring.push_back(add_node(result, true));
+    }
+    for (unsigned i = 0; i < length; ++i) {
+        add_transistor(result, ring[i], ring[(i + 1) % length],
+                       synthetic_netlist::ground);
+    }
+    add_transistor(result, set, ring[0], synthetic_netlist::ground);
+    add_transistor(result, clear, ring[1], synthetic_netlist::ground);
+
+    /* set, release, clear, release */
+    result.inputs = {set, set, clear, clear};
+    add_outputs(result, ring);
+    return result;
+}
+
+synthetic_netlist
+pass_transistor_bus(unsigned width)
+{
+    synthetic_netlist result;
+    std::vector<uint32_t> bus;
+    std::vector<uint32_t> outputs;
+    const uint32_t enable = add_node(result, true);
+    const uint32_t data = add_node(result, false);
+
+    width = std::max(1u, width);
+    result.name = "bus/" + std::to_string(width);
+    for (unsigned i = 0; i < width; ++i) {
+        bus.push_back(add_node(result, i == 0));
+        outputs.push_back(add_node(result, true));
+    }
+    add_transistor(result, data, bus[0], synthetic_netlist::ground);
+    for (unsigned i = 0; i < width; ++i) {
+        if (i + 1 < width) {
+            add_transistor(result, enable, bus[i], bus[i + 1]);
+        }
+        add_transistor(result, bus[i], outputs[i], synthetic_netlist::ground);
+    }
+    result.inputs.push_back(data);
+    add_outputs(result, outputs);
+    return result;
+}
+
+std::unique_ptr<synthetic_chip>
+synthetic_chip::create(const synthetic_netlist& source)
+{
+    const unsigned compact_limit = std::numeric_limits<uint16_t>::max();
+
+    if (source.node_count() < compact_limit
+            and source.transistor_count() <= compact_limit)
+    {
+        try {
+            return std::unique_ptr<synthetic_chip>(
+                new implementation_synthetic<uint16_t>(source));
+        }
+        catch (const std::out_of_range&) {
+            /* the packed netlist does not fit the compact layout */
+        }
+    }
+    return std::unique_ptr<synthetic_chip>(
+        new implementation_synthetic<uint32_t>(source));
+}
+
+std::unique_ptr<synthetic_chip>
+synthetic_chip::create_partitioned(const synthetic_netlist& source,
+                                   unsigned region_count)
+{
+    const unsigned compact_limit = std::numeric_limits<uint16_t>::max();
+
+    if (source.node_count() < compact_limit
+            and source.transistor_count() <= compact_limit)
+    {
+        try {
+            return std::unique_ptr<synthetic_chip>(
+                new partitioned_synthetic<uint16_t>(source, region_count));
+        }
+        catch (const std::out_of_range&) {
+            /* the packed netlist does not fit the compact layout */
+        }
+    }
+    return std::unique_ptr<synthetic_chip>(
+        new partitioned_synthetic<uint32_t>(source, region_count));
+}
+
+synthetic_chip::~synthetic_chip() {}
+
+}
+}
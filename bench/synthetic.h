@@ -0,0 +1,101 @@
+
+#ifndef CHIPEMU_BENCH_SYNTHETIC_H
+#define CHIPEMU_BENCH_SYNTHETIC_H
+
+#include "nmos.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace chipemu
+{
+namespace bench
+{
+
+/* A generated netlist, used for measuring how the nmos engine scales
+ * with the size of a network, and with the size of groups.
+ *
+ * Node 1 is power, node 2 is ground. The network is driven by toggling
+ * the nodes listed in inputs, one after the other, each toggle followed
+ * by a recalc() - that is one half-cycle of the synthetic chip.
+ */
+struct synthetic_netlist
+{
+    std::string name;
+
+    /* gate, c1, c2 of each transistor */
+    std::vector<uint32_t> transistors;
+
+    /* indexed by node id */
+    std::vector<bool> pullups;
+
+    std::vector<uint32_t> inputs;
+
+    /* nodes to read with read_nodes, at most 32 */
+    std::vector<uint32_t> outputs;
+
+    static constexpr uint32_t power = 1;
+    static constexpr uint32_t ground = 2;
+
+    unsigned node_count() const
+    {
+        return unsigned(pullups.size()) - 1;
+    }
+
+    unsigned transistor_count() const
+    {
+        return unsigned(transistors.size() / 3);
+    }
+};
+
+/* length inverters in series, every node switches on each half-cycle,
+ * one at a time, the groups are of a single node
+ */
+synthetic_netlist inverter_chain(unsigned length);
+
+/* length inverters in a loop ( length is rounded up to an even number ),
+ * forming a latch, with one input pulling down the first node, and
+ * another one pulling down the second node - changing the state of
+ * the latch flips every node in the ring
+ */
+synthetic_netlist inverter_ring(unsigned length);
+
+/* width nodes connected in series by pass transistors, all gated by the
+ * same enable input, driven at one end by a data input - every
+ * half-cycle re-evaluates a group of width nodes, each of which drives
+ * an inverter
+ */
+synthetic_netlist pass_transistor_bus(unsigned width);
+
+/* The nmos engine instantiated with a synthetic_netlist,
+ * the compact layout is used, when the netlist fits into it.
+ */
+class synthetic_chip : public virtual chip
+{
+public:
+
+    static std::unique_ptr<synthetic_chip> create(const synthetic_netlist&);
+
+    /* simulated by basic_partitioned_nmos, set_thread_count throws
+     * std::logic_error
+     */
+    static std::unique_ptr<synthetic_chip>
+    create_partitioned(const synthetic_netlist&, unsigned region_count);
+
+    /* toggles the next input, and calls recalc() */
+    virtual void half_cycle() noexcept = 0;
+
+    /* the outputs, read with one read_nodes call */
+    virtual unsigned read_outputs() const noexcept = 0;
+
+    virtual void set_thread_count(unsigned) = 0;
+
+    virtual ~synthetic_chip();
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,331 @@
+
+/* End-to-end benchmarks, running the testbench machines
+ *
+ * Each workload is a file of input, fed to a machine as if it was typed
+ * in, see the write, and fetch hooks of the kernel in commodore.cc.
+ * A machine runs until the whole input is consumed, and BASIC asks for
+ * more. The output is not printed, only
+ * a checksum of it is kept.
+ *
+ * The results can be saved as a baseline, and compared to a baseline
+ * later. The number of emulated cycles, and the checksum of the output
+ * are expected to match exactly, any difference in those means the
+ * machine behaves differently. The speed is expected to be within
+ * a tolerance of the baseline - which is only meaningful on the same
+ * computer the baseline was saved on.
+ */
+
+#include "machine.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef CHIPEMU_WORKLOAD_DIR
+#define CHIPEMU_WORKLOAD_DIR "bench/workloads"
+#endif
+
+namespace
+{
+
+/* The corpus, each one read from corpus_dir/<name>.bas
+ *  boot     - no input, just reaching the READY prompt
+ *  loops    - FOR loops, integer arithmetic
+ *  strings  - string concatenation, and string functions
+ *  float    - floating point arithmetic, and math functions
+ *
+ * The tiny kernel used by the testbench does not implement STOP, thus
+ * a program started with RUN stops with BREAK, the corpus consists of
+ * statements executed in direct mode.
+ */
+const char *const workloads[] = {"boot", "loops", "strings", "float"};
+
+const char *program_name;
+std::string corpus_dir = CHIPEMU_WORKLOAD_DIR;
+std::string baseline_path;
+std::string save_path;
+std::string filter;
+double tolerance = 20;
+bool json_output = false;
+
+struct result
+{
+    std::string machine;
+    std::string workload;
+    unsigned long long cycles;
+    uint32_t output_checksum;
+    double seconds;
+
+    double MHz() const
+    {
+        return cycles / seconds / 1e6;
+    }
+};
+
+typedef std::pair<std::string, std::string> result_key;
+
+/* FNV-1a */
+uint32_t
+checksum(FILE *file)
+{
+    uint32_t hash = 2166136261u;
+    int c;
+
+    rewind(file);
+    while ((c = fgetc(file)) != EOF) {
+        hash = (hash ^ uint32_t(c)) * 16777619u;
+    }
+    return hash;
+}
+
+result
+run_workload(const char *machine_name, const char *workload)
+{
+    typedef std::chrono::steady_clock clock;
+
+    std::string path = corpus_dir + "/" + workload + ".bas";
+    std::unique_ptr<FILE, int (*)(FILE*)> input(fopen(path.c_str(), "r"),
+                                                fclose);
+    std::unique_ptr<FILE, int (*)(FILE*)> output(tmpfile(), fclose);
+
+    if (not input) {
+        throw std::runtime_error("unable to open " + path);
+    }
+    if (not output) {
+        throw std::runtime_error("unable to create temporary file");
+    }
+
+    std::unique_ptr<testbench::machine>
+        machine(testbench::machine::create(machine_name));
+    clock::time_point start = clock::now();
+    testbench::run_result run = machine->run(input.get(), output.get());
+    std::chrono::duration<double> elapsed = clock::now() - start;
+
+    return {machine_name, workload, run.cycle_count,
+            checksum(output.get()), elapsed.count()};
+}
+
+std::map<result_key, result>
+load_baseline(const std::string& path)
+{
+    std::map<result_key, result> baseline;
+    std::unique_ptr<FILE, int (*)(FILE*)> file(fopen(path.c_str(), "r"),
+                                               fclose);
+    char line[256];
+
+    if (not file) return baseline;
+    while (fgets(line, sizeof(line), file.get()) != nullptr) {
+        char machine[64];
+        char workload[64];
+        unsigned long long cycles;
+        unsigned output_checksum;
+        double MHz;
+
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%63s %63s %llu %x %lf",
+                   machine, workload, &cycles, &output_checksum, &MHz) != 5
+                or not (MHz > 0))
+        {
+            throw std::runtime_error("invalid baseline in " + path);
+        }
+        baseline[result_key(machine, workload)] =
+            {machine, workload, cycles, output_checksum, cycles / MHz / 1e6};
+    }
+    return baseline;
+}
+
+void
+save_baseline(const std::string& path, const std::vector<result>& results)
+{
+    std::unique_ptr<FILE, int (*)(FILE*)> file(fopen(path.c_str(), "w"),
+                                               fclose);
+
+    if (not file) {
+        throw std::runtime_error("unable to write " + path);
+    }
+    fputs("# machine workload cycles output_checksum MHz\n", file.get());
+    for (const result& r : results) {
+        fprintf(file.get(), "%s %s %llu %08x %.6f\n",
+                r.machine.c_str(), r.workload.c_str(),
+                r.cycles, unsigned(r.output_checksum), r.MHz());
+    }
+}
+
+/* Returns a description of the regression, or an empty string */
+std::string
+compare(const result& r, const std::map<result_key, result>& baseline)
+{
+    auto entry = baseline.find(result_key(r.machine, r.workload));
+
+    if (entry == baseline.end()) {
+        return "";
+    }
+
+    const result& base = entry->second;
+
+    if (r.cycles != base.cycles) {
+        return "cycle count changed, was " + std::to_string(base.cycles);
+    }
+    if (r.output_checksum != base.output_checksum) {
+        return "output changed";
+    }
+    if (r.MHz() < base.MHz() * (1 - tolerance / 100)) {
+        char text[64];
+
+        snprintf(text, sizeof(text), "slower, was %.6f MHz", base.MHz());
+        return text;
+    }
+    return "";
+}
+
+void
+print_json(const std::vector<result>& results,
+           const std::vector<std::string>& regressions)
+{
+    printf("{\n  \"workloads\": [");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const result& r = results[i];
+
+        printf("%s\n    {\"machine\": \"%s\", \"workload\": \"%s\", "
+               "\"cycles\": %llu, \"seconds\": %.6f, \"MHz\": %.6f, "
+               "\"output_checksum\": \"%08x\", \"regression\": \"%s\"}",
+               (i == 0) ? "" : ",",
+               r.machine.c_str(), r.workload.c_str(),
+               r.cycles, r.seconds, r.MHz(),
+               unsigned(r.output_checksum), regressions[i].c_str());
+    }
+    printf("\n  ]\n}\n");
+}
+
+void
+usage_exit(int exit_code)
+{
+    FILE *output = ((exit_code == EXIT_SUCCESS) ? stdout : stderr);
+
+    fprintf(output, "End-to-end benchmarks, running BASIC on the testbench "
+     "machines\n"
+     "Usage:\n"
+     "%s [-h] [-j] [-d dir] [-b path] [-s path] [-r percent] [-f text]\n"
+     "  -h\n"
+     "  --help            print this text, and exit\n"
+     "  -j\n"
+     "  --json            print the results as JSON\n"
+     "  -d dir\n"
+     "  --corpus dir      read the workloads from `dir`, default:\n"
+     "                    " CHIPEMU_WORKLOAD_DIR "\n"
+     "  -b path\n"
+     "  --baseline path   compare the results to the baseline at `path`,\n"
+     "                    default: <corpus dir>/baseline.txt if it exists\n"
+     "  -s path\n"
+     "  --save path       save the results as a baseline to `path`\n"
+     "  -r percent\n"
+     "  --tolerance percent\n"
+     "                    report a regression if a workload is slower than\n"
+     "                    the baseline by this much, default: 20\n"
+     "  -f text\n"
+     "  --filter text     only run workloads with `text` in their name,\n"
+     "                    e.g. Commodore64/boot, or /float\n"
+     "Exits with status 1 if any workload regressed.\n",
+     program_name ? program_name : "./chipemu_workloads");
+    exit(exit_code);
+}
+
+void
+process_arguments(char **arg)
+{
+    if (*arg == nullptr) return;
+    program_name = *arg++;
+    while (*arg != nullptr) {
+        std::string argument(*arg++);
+
+        if (argument == "-h" or argument == "--help") {
+            usage_exit(EXIT_SUCCESS);
+        }
+        else if (argument == "-j" or argument == "--json") {
+            json_output = true;
+            continue;
+        }
+        if (*arg == nullptr) usage_exit(2);
+        if (argument == "-d" or argument == "--corpus") {
+            corpus_dir = *arg++;
+        }
+        else if (argument == "-b" or argument == "--baseline") {
+            baseline_path = *arg++;
+        }
+        else if (argument == "-s" or argument == "--save") {
+            save_path = *arg++;
+        }
+        else if (argument == "-r" or argument == "--tolerance") {
+            tolerance = atof(*arg++);
+        }
+        else if (argument == "-f" or argument == "--filter") {
+            filter = *arg++;
+        }
+        else {
+            usage_exit(2);
+        }
+    }
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    process_arguments(argv);
+    if (baseline_path.empty()) {
+        baseline_path = corpus_dir + "/baseline.txt";
+    }
+
+    std::vector<result> results;
+    std::vector<std::string> regressions;
+    bool regressed = false;
+
+    try {
+        const std::map<result_key, result> baseline =
+            load_baseline(baseline_path);
+
+        if (not json_output) {
+            printf("%-16s %-10s %10s %10s %10s\n",
+                   "machine", "workload", "cycles", "seconds", "MHz");
+        }
+        for (const char *machine : testbench::machine::available) {
+            for (const char *workload : workloads) {
+                std::string name = std::string(machine) + "/" + workload;
+
+                if (name.find(filter) == std::string::npos) continue;
+
+                results.push_back(run_workload(machine, workload));
+                regressions.push_back(compare(results.back(), baseline));
+                regressed = regressed or not regressions.back().empty();
+                if (not json_output) {
+                    const result& r = results.back();
+
+                    printf("%-16s %-10s %10llu %10.3f %10.6f %s\n",
+                           machine, workload,
+                           r.cycles, r.seconds, r.MHz(),
+                           regressions.back().c_str());
+                    fflush(stdout);
+                }
+            }
+        }
+        if (not save_path.empty()) {
+            save_baseline(save_path, results);
+        }
+    }
+    catch (const std::exception& exception) {
+        fprintf(stderr, "Error: %s\n", exception.what());
+        return 2;
+    }
+    if (json_output) {
+        print_json(results, regressions);
+    }
+    return regressed ? 1 : 0;
+}
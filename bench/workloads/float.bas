@@ -0,0 +1 @@
+X=1.5:FOR I=1 TO 2:X=X*1.1+SQR(I):NEXT:PRINT X;SIN(X)
@@ -0,0 +1 @@
+FOR I=1 TO 10:S=S+I:NEXT:PRINT S
@@ -0,0 +1 @@
+A$="CHIP":FOR I=1 TO 3:A$=A$+CHR$(48+I):NEXT:PRINT A$;LEN(A$);MID$(A$,2,3)
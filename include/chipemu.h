@@ -2,11 +2,58 @@
 #ifndef CHIPEMU_H
 #define CHIPEMU_H
 
+#include <vector>
+
 namespace chipemu
 {
 
 extern unsigned lib_version_number;
 
+/* Counters of the work done by recalc(), see chip::stats
+ *
+ * Nodes are only counted when the library is built with
+ * CHIPEMU_ENABLE_STATS, otherwise enabled is false, and every
+ * counter stays zero.
+ */
+struct chip_stats
+{
+    static constexpr unsigned group_size_buckets = 16;
+
+    bool enabled;
+
+    /* nodes taken from the queue of changed nodes */
+    unsigned long long nodes_popped;
+
+    /* popped nodes which were already evaluated, as a member of
+     * the group of another node
+     */
+    unsigned long long nodes_settled;
+
+    unsigned long long groups;
+
+    /* group_sizes[N] is the number of groups of 2^N .. 2^(N+1)-1 nodes,
+     * the last one also counts all larger groups
+     */
+    unsigned long long group_sizes[group_size_buckets];
+
+    unsigned long long transistors_toggled;
+
+    /* nodes queued after a node changed, in node id order */
+    unsigned long long ordered_changes;
+
+    /* nodes toggling more than once during one recalc() call, each toggle
+     * after the first one counted - transient values, which had to be
+     * evaluated again
+     */
+    unsigned long long glitches;
+
+    /* the largest number of nodes in the queue of changed nodes,
+     * and in a group
+     */
+    unsigned long long changed_queue_high_water;
+    unsigned long long group_high_water;
+};
+
 class chip
 {
 public:
@@ -17,6 +64,23 @@ public:
     virtual void stabilize_network() noexcept = 0;
     virtual void recalc() noexcept = 0;
 
+    /* The number of nodes recalc() evaluated since the chip was created,
+     * counting each node once for every group it was evaluated in.
+     */
+    virtual unsigned long long evaluated_node_count() const noexcept = 0;
+
+    virtual chip_stats stats() const noexcept = 0;
+    virtual void reset_stats() noexcept = 0;
+
+    /* The dynamic state of the chip, in one contiguous blob, which can be
+     * restored into any chip of the same type, e.g. to fork many chips
+     * from a single, already initialized one.
+     * restore throws std::invalid_argument if the blob does not
+     * fit the chip.
+     */
+    virtual std::vector<unsigned char> snapshot() const = 0;
+    virtual void restore(const std::vector<unsigned char>&) = 0;
+
     virtual ~chip();
 
 };
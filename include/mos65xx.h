@@ -7,6 +7,29 @@
 namespace chipemu
 {
 
+/* The memory, and peripherals attached to the address, and data bus
+ * of a 6500 family CPU, see MOS6500::run_cycles
+ *
+ * read is called in cycles where the CPU reads the data bus, the value
+ * returned is put on the data bus. In cycles, where the CPU fetches an
+ * opcode ( SYNC is high ), fetch is called instead of read.
+ * write is called in cycles where the CPU writes the data bus.
+ */
+class bus_handler
+{
+public:
+
+    virtual unsigned char read(unsigned address) = 0;
+    virtual void write(unsigned address, unsigned char value) = 0;
+
+    virtual unsigned char fetch(unsigned address)
+    {
+        return read(address);
+    }
+
+    virtual ~bus_handler();
+};
+
 class MOS6500 : public virtual chip
 {
 public:
@@ -32,6 +55,164 @@ public:
 
     virtual unsigned char IR() const noexcept = 0;
 
+    /* The registers, the buses, and the control lines, all read at once.
+     * The values are the same as returned by the separate accessors.
+     */
+    struct register_file
+    {
+        unsigned char A;
+        unsigned char X;
+        unsigned char Y;
+        unsigned char P;
+        unsigned char S;
+        unsigned char PCH;
+        unsigned char PCL;
+        unsigned PC;
+        unsigned char IR;
+        unsigned address_bus;
+        unsigned char data_bus;
+        bool RW;
+        bool SYNC;
+        bool RDY;
+        bool IRQ;
+        bool NMI;
+        bool RES;
+    };
+
+    virtual register_file registers() const noexcept = 0;
+
+    /* A new chip of the same type, with the same state */
+    virtual MOS6500 *clone() const = 0;
+
+    /* Runs the specified number of clock cycles, driving CLK0IN low, then
+     * high. After each cycle the address bus is handed to the bus_handler,
+     * and in read cycles the data bus is set to the value it returns - that
+     * value is seen by the CPU in the next recalc.
+     */
+    virtual void run_cycles(unsigned long long count, bus_handler&) = 0;
+
+    /* The netlist shared by all 65xx chips can be saved to a file, and
+     * loaded from it later - mapped into memory where possible - instead
+     * of building it again in each process.
+     * load_netlist returns false, if the file can not be used, in which case
+     * the netlist is going to be built as usual.
+     * save_netlist throws std::runtime_error on failure.
+     */
+    static bool load_netlist(const char *path);
+    static void save_netlist(const char *path);
+
+    /* Builds the netlist shared by the 65xx chips created afterwards
+     * again, with the nodes renumbered, so that nodes connected via a
+     * transistor are stored close to each other - or in the original
+     * order, if renumber is false. A saved netlist keeps its order.
+     * The node ids used by the interface of the chips, and the results
+     * of the simulation are the same either way. The generated
+     * evaluation code ( CHIPEMU_COMPILED_NETLIST ) is only used with
+     * the original order.
+     */
+    static void renumber_netlist(bool renumber);
+
+    /* The state of the CPU at an instruction boundary
+     *
+     * The 6502 completes an instruction while it already fetches the
+     * opcode of the next one ( SYNC high ), some registers are only written
+     * during the cycle following that fetch. Thus the state is taken in
+     * one of the two cycles after the last cycle of an instruction:
+     *
+     *   PC       - the address of the opcode of the next instruction
+     *   opcode   - the opcode fetched from there
+     *   cycle    - the number of the cycles of the next instruction already
+     *              run: 1 - only the opcode fetch, or 2 - the opcode fetch,
+     *              and the cycle reading the byte after the opcode, which
+     *              is operand then
+     *   A, X, Y, S, P - the registers as they were after the previous
+     *              instruction, bits 4, and 5 of P are ignored
+     */
+    struct instruction_state
+    {
+        unsigned char A;
+        unsigned char X;
+        unsigned char Y;
+        unsigned char S;
+        unsigned char P;
+        unsigned PC;
+        unsigned char opcode;
+        unsigned char operand;
+        unsigned cycle;
+    };
+
+    /* Runs cycles until the state at an instruction boundary is known -
+     * until the cycle after an opcode fetch, not counting interrupt
+     * sequences - and returns it, with cycle = 2. The number of cycles run
+     * is added to cycles, std::runtime_error is thrown if no instruction
+     * is started in 256 cycles.
+     * Afterwards the chip is left in the middle of an instruction, until
+     * load_instruction_state is called.
+     */
+    virtual instruction_state
+    save_instruction_state(bus_handler&, unsigned long long& cycles) = 0;
+
+    /* Puts the chip into the specified state, by feeding it a short
+     * sequence of instructions loading the registers, and jumping to PC,
+     * without using any bus_handler. Afterwards run_cycles continues with
+     * the cycle following the ones in state.cycle.
+     */
+    virtual void load_instruction_state(const instruction_state&) = 0;
+
+    /* Runs whole instructions at the instruction level, starting with the
+     * one in state, until at least count cycles are run, or the next opcode
+     * is not a documented one - state is updated, with cycle = 1 - and
+     * returns the number of cycles run. The cycles are counted exactly, but
+     * only the reads, and writes the instructions are meant to do are
+     * passed to the bus_handler, without the dummy reads, and the extra
+     * write of the read-modify-write instructions. The lines IRQ, NMI, RDY,
+     * and RES are assumed to be inactive.
+     */
+    static unsigned long long
+    run_instructions(instruction_state&,
+                     unsigned long long count,
+                     bus_handler&,
+                     unsigned address_bus_width = 16);
+
+    /* Runs at least count cycles, most of them at the instruction level:
+     * save_instruction_state, run_instructions, then
+     * load_instruction_state. If IRQ, NMI, RDY, or RES is active, the
+     * cycles are just run via run_cycles. Returns the number of cycles run.
+     * With validate set, the same instructions are run on a clone of the
+     * chip as well, and std::runtime_error is thrown if its bus accesses -
+     * apart from the dummy ones - the state it ends up in, or the state
+     * loaded into the chip differs from the result of run_instructions.
+     * The bus_handler is not used by the clone, it reads the values the
+     * instruction level run read.
+     */
+    virtual unsigned long long fast_forward(unsigned long long count,
+                                            bus_handler&,
+                                            bool validate) = 0;
+
+    /* A pin tied to a fixed level
+     *
+     * The create_specialized functions of the chips below return a chip
+     * built for a specific use: the pins listed in constants are tied to
+     * the specified level, and of the pins not read by the other accessors
+     * - the buses, RW, SYNC, RDY, IRQ, NMI, and RES - only the ones listed
+     * in observed_pins are read. The constants are written when the chip is
+     * created, pin_write ignores those pins later, and pin_read returns
+     * false for the pins not read.
+     * The transistors which can never be switched on, and the logic none of
+     * the pins read, or the registers depend on, are left out of the netlist
+     * of such a chip - otherwise it works exactly like a chip returned by
+     * create(), with the constants written right after creating it. The
+     * generated evaluation code ( CHIPEMU_COMPILED_NETLIST ) is not used.
+     * Throws std::invalid_argument if a pin is not a signal pin of the chip,
+     * or if a constant is specified for a pin of the data bus, for CLK0IN,
+     * or more than once for the same pin.
+     */
+    struct pin_constant
+    {
+        unsigned pin;
+        bool value;
+    };
+
     virtual ~MOS6500();
 };
 
@@ -40,6 +221,10 @@ class MOS6502 : public virtual MOS6500
 public:
 
     static MOS6502 *create();
+    static MOS6502 *create_specialized(
+                        const std::vector<pin_constant>& constants,
+                        const std::vector<unsigned>& observed_pins);
+    virtual MOS6502 *clone() const = 0;
 
     enum pin
     {
@@ -69,11 +254,43 @@ public:
 
 };
 
+/* 64 independent MOS6502 instances, simulated in lockstep
+ *
+ * Every instance ( lane ) has its own pins, and its own state, but
+ * one recalc() call advances all of them. Pins are numbered
+ * the same way as in the MOS6502 class.
+ */
+class MOS6502_lanes : public virtual chip
+{
+public:
+
+    static MOS6502_lanes *create();
+
+    virtual unsigned lane_count() const noexcept = 0;
+    virtual unsigned pin_count() const noexcept = 0;
+
+    virtual void pin_write(unsigned lane, unsigned pin, bool) noexcept = 0;
+    virtual void pin_write_all(unsigned pin, bool) noexcept = 0;
+    virtual bool pin_read(unsigned lane, unsigned pin) const noexcept = 0;
+
+    virtual unsigned read_address_bus(unsigned lane) const noexcept = 0;
+
+    virtual unsigned char read_data_bus(unsigned lane) const noexcept = 0;
+    virtual void write_data_bus(unsigned lane, unsigned char) noexcept = 0;
+
+    virtual ~MOS6502_lanes();
+
+};
+
 class MOS6503 : public virtual MOS6500
 {
 public:
 
     static MOS6503 *create();
+    static MOS6503 *create_specialized(
+                        const std::vector<pin_constant>& constants,
+                        const std::vector<unsigned>& observed_pins);
+    virtual MOS6503 *clone() const = 0;
 
     enum pin
     {
@@ -102,6 +319,10 @@ class MOS6504 : public virtual MOS6500
 public:
 
     static MOS6504 *create();
+    static MOS6504 *create_specialized(
+                        const std::vector<pin_constant>& constants,
+                        const std::vector<unsigned>& observed_pins);
+    virtual MOS6504 *clone() const = 0;
 
     enum pin
     {
@@ -130,6 +351,10 @@ class MOS6505 : public virtual MOS6500
 public:
 
     static MOS6505 *create();
+    static MOS6505 *create_specialized(
+                        const std::vector<pin_constant>& constants,
+                        const std::vector<unsigned>& observed_pins);
+    virtual MOS6505 *clone() const = 0;
 
     enum pin
     {
@@ -158,6 +383,7 @@ class MOS6510 : public virtual MOS6500
 public:
 
     static MOS6510 *create();
+    virtual MOS6510 *clone() const = 0;
 
     enum pin
     {
@@ -192,6 +418,7 @@ class MOS6510_1 : public virtual MOS6500
 public:
 
     static MOS6510_1 *create();
+    virtual MOS6510_1 *clone() const = 0;
 
     enum pin
     {
@@ -226,6 +453,7 @@ class MOS6510_2 : public virtual MOS6500
 public:
 
     static MOS6510_2 *create();
+    virtual MOS6510_2 *clone() const = 0;
 
     enum pin
     {
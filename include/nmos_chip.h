@@ -0,0 +1,100 @@
+
+#ifndef CHIPEMU_NMOS_CHIP_H
+#define CHIPEMU_NMOS_CHIP_H
+
+#include "chipemu.h"
+
+#include <vector>
+
+namespace chipemu
+{
+
+/* The regions of a chip partitioned for simulation on multiple cores,
+ * see nmos_chip::load_partitioned
+ *
+ * Nodes connected through the legs of transistors are never split between
+ * regions, thus regions only interact via the gates of transistors.
+ * The weight of a region is the number of its nodes, and transistors.
+ */
+struct partition_report
+{
+    struct region
+    {
+        unsigned node_count;
+        unsigned transistor_count;
+
+        /* nodes gating a transistor in another region */
+        unsigned boundary_node_count;
+    };
+
+    std::vector<region> regions;
+
+    /* the number of groups of nodes connected through transistor legs,
+     * these are distributed among the regions
+     */
+    unsigned component_count;
+
+    /* the number of transistors gated by a node of another region */
+    unsigned cut_size;
+
+    /* the weight of the heaviest region divided by the average weight */
+    double balance;
+};
+
+/* A chip built at runtime from netlist files in the layout of
+ * the visual6502 project: transdefs.js, segdefs.js and nodenames.js
+ *
+ * The nodes are identified by the id in those files plus one, e.g.
+ * the pins of such a chip can be looked up by their name with node_id.
+ */
+class nmos_chip : public virtual chip
+{
+public:
+
+    /* throws std::runtime_error if a file can not be read, or parsed */
+    static nmos_chip *load(const char *name,
+                           const char *transdefs_path,
+                           const char *segdefs_path,
+                           const char *nodenames_path);
+
+    /* The same as load, but the netlist is partitioned into region_count
+     * regions at most, each simulated on its own thread. The regions
+     * exchange the changes of boundary nodes in rounds, until none of them
+     * has anything left to do, thus the order nodes are evaluated in differs
+     * from the one used by a chip loaded with load, but it does not depend
+     * on the scheduling of the threads. A recalc the regions fail to settle
+     * that way is done again, by a single thread.
+     * The state of the chip after a recalc can thus differ from the state
+     * of a chip loaded with load, wherever the nodes of a group race each
+     * other - e.g. a chip can come out of reset a cycle later.
+     */
+    static nmos_chip *load_partitioned(const char *name,
+                                       const char *transdefs_path,
+                                       const char *segdefs_path,
+                                       const char *nodenames_path,
+                                       unsigned region_count);
+
+    virtual partition_report partitions() const = 0;
+
+    /* returns zero for unknown names */
+    virtual unsigned node_id(const char *node_name) const noexcept = 0;
+
+    virtual bool get_node(unsigned id) const noexcept = 0;
+    virtual void set_node(unsigned id, bool) noexcept = 0;
+
+    /* Use more than one thread in recalc, for large netlists.
+     * The results are identical to the ones computed with a single thread.
+     * Throws std::system_error if the threads can not be started, and
+     * std::logic_error on a partitioned chip, which always uses
+     * one thread per region.
+     */
+    virtual unsigned thread_count() const noexcept = 0;
+    virtual void set_thread_count(unsigned) = 0;
+
+    virtual ~nmos_chip();
+
+};
+
+}
+
+#endif
@@ -0,0 +1,106 @@
+
+#ifndef CHIPEMU_BIT_VECTOR_H
+#define CHIPEMU_BIT_VECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace chipemu
+{
+namespace implementation
+{
+
+/* A packed vector of bits, used for the state of the transistors.
+ * Unlike std::vector<bool>, the words holding the bits are accessible,
+ * thus they can be saved in a snapshot, or accessed atomically.
+ */
+class bit_vector
+{
+    std::vector<uint64_t> words;
+    size_t bit_count;
+
+public:
+
+    bit_vector():
+        bit_count(0)
+    {}
+
+    static size_t word_index(size_t index)
+    {
+        return index / 64;
+    }
+
+    static uint64_t bit_mask(size_t index)
+    {
+        return uint64_t(1) << (index % 64);
+    }
+
+    static size_t word_count(size_t bit_count)
+    {
+        return (bit_count + 63) / 64;
+    }
+
+    /* The bits added are all zero */
+    void resize(size_t count)
+    {
+        words.resize(word_count(count), 0);
+        bit_count = count;
+    }
+
+    size_t size() const
+    {
+        return bit_count;
+    }
+
+    bool operator[](size_t index) const
+    {
+        return (words[word_index(index)] & bit_mask(index)) != 0;
+    }
+
+    void flip(size_t index)
+    {
+        words[word_index(index)] ^= bit_mask(index);
+    }
+
+    void set(size_t index, bool value)
+    {
+        if (value) {
+            words[word_index(index)] |= bit_mask(index);
+        }
+        else {
+            words[word_index(index)] &= ~bit_mask(index);
+        }
+    }
+
+    /* the word containing the bit at index */
+    uint64_t& word(size_t index)
+    {
+        return words[word_index(index)];
+    }
+
+    const uint64_t& word(size_t index) const
+    {
+        return words[word_index(index)];
+    }
+
+    uint64_t *data()
+    {
+        return words.data();
+    }
+
+    const uint64_t *data() const
+    {
+        return words.data();
+    }
+
+    size_t word_count() const
+    {
+        return words.size();
+    }
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,560 @@
+
+#include "mos6500_core.h"
+
+namespace chipemu
+{
+namespace implementation
+{
+
+namespace
+{
+
+enum flags : uint8_t
+{
+    flag_C = 0x01,
+    flag_Z = 0x02,
+    flag_I = 0x04,
+    flag_D = 0x08,
+    flag_B = 0x10,
+    flag_U = 0x20,
+    flag_V = 0x40,
+    flag_N = 0x80
+};
+
+enum addressing_mode
+{
+    immediate,
+    zero_page,
+    zero_page_x,
+    zero_page_y,
+    absolute,
+    absolute_x,
+    absolute_y,
+    indirect_x,
+    indirect_y
+};
+
+/* The addressing modes of the instructions with the lowest two bits of
+ * the opcode being 01, and 00 or 10, indexed by bits 2 - 4
+ */
+constexpr addressing_mode group_1_modes[8] =
+    {indirect_x, zero_page, immediate, absolute,
+     indirect_y, zero_page_x, absolute_y, absolute_x};
+
+constexpr addressing_mode group_0_2_modes[8] =
+    {immediate, zero_page, immediate, absolute,
+     immediate, zero_page_x, immediate, absolute_x};
+
+bool
+crosses_page(uint16_t a, uint16_t b)
+{
+    return (a & 0xff00) != (b & 0xff00);
+}
+
+}
+
+const uint8_t mos6500_core::cycle_counts[256] = {
+    7, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 0, 4, 6, 0,
+    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+    6, 6, 0, 0, 3, 3, 5, 0, 4, 2, 2, 0, 4, 4, 6, 0,
+    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+    6, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 3, 4, 6, 0,
+    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+    6, 6, 0, 0, 0, 3, 5, 0, 4, 2, 2, 0, 5, 4, 6, 0,
+    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+    0, 6, 0, 0, 3, 3, 3, 0, 2, 0, 2, 0, 4, 4, 4, 0,
+    2, 6, 0, 0, 4, 4, 4, 0, 2, 5, 2, 0, 0, 5, 0, 0,
+    2, 6, 2, 0, 3, 3, 3, 0, 2, 2, 2, 0, 4, 4, 4, 0,
+    2, 5, 0, 0, 4, 4, 4, 0, 2, 4, 2, 0, 4, 4, 4, 0,
+    2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0,
+    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+    2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0,
+    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0
+};
+
+mos6500_core::mos6500_core(const MOS6500::instruction_state& state,
+                           bus_handler& bus_handler,
+                           unsigned address_bus_width):
+    bus(bus_handler),
+    address_mask((1u << address_bus_width) - 1),
+    A(state.A),
+    X(state.X),
+    Y(state.Y),
+    S(state.S),
+    P(uint8_t(state.P | flag_B | flag_U)),
+    PC(uint16_t(state.PC + 1)),
+    opcode(state.opcode),
+    has_operand(state.cycle >= 2),
+    operand(state.operand),
+    cycles_done(state.cycle)
+{
+}
+
+void
+mos6500_core::save(MOS6500::instruction_state& state) const
+{
+    state.A = A;
+    state.X = X;
+    state.Y = Y;
+    state.S = S;
+    state.P = P;
+    state.PC = uint16_t(PC - 1);
+    state.opcode = opcode;
+    state.operand = operand;
+    state.cycle = cycles_done;
+}
+
+inline uint8_t
+mos6500_core::read(uint16_t address)
+{
+    return bus.read(address & address_mask);
+}
+
+inline void
+mos6500_core::write(uint16_t address, uint8_t value)
+{
+    bus.write(address & address_mask, value);
+}
+
+/* The next byte of the instruction, which might have been read already */
+inline uint8_t
+mos6500_core::next_byte()
+{
+    if (has_operand) {
+        has_operand = false;
+        ++PC;
+        return operand;
+    }
+    return read(PC++);
+}
+
+inline uint16_t
+mos6500_core::next_word()
+{
+    const uint8_t low = next_byte();
+
+    return uint16_t(low | (next_byte() << 8));
+}
+
+inline void
+mos6500_core::push(uint8_t value)
+{
+    write(uint16_t(0x100 | S), value);
+    --S;
+}
+
+inline uint8_t
+mos6500_core::pull()
+{
+    ++S;
+    return read(uint16_t(0x100 | S));
+}
+
+inline bool
+mos6500_core::flag(uint8_t mask) const
+{
+    return (P & mask) != 0;
+}
+
+inline void
+mos6500_core::set_flag(uint8_t mask, bool value)
+{
+    if (value) {
+        P |= mask;
+    }
+    else {
+        P &= uint8_t(~mask);
+    }
+}
+
+inline void
+mos6500_core::set_NZ(uint8_t value)
+{
+    set_flag(flag_Z, value == 0);
+    set_flag(flag_N, (value & 0x80) != 0);
+}
+
+/* In decimal mode, the flags are set the way the NMOS 6502 sets them,
+ * N, and V from the intermediate result, Z from the binary sum.
+ */
+void
+mos6500_core::ADC(uint8_t value)
+{
+    const unsigned carry = flag(flag_C) ? 1 : 0;
+
+    if (not flag(flag_D)) {
+        const unsigned sum = A + value + carry;
+
+        set_flag(flag_C, sum > 0xff);
+        set_flag(flag_V, (~(A ^ value) & (A ^ sum) & 0x80) != 0);
+        A = uint8_t(sum);
+        set_NZ(A);
+        return;
+    }
+
+    unsigned low = (A & 0x0f) + (value & 0x0f) + carry;
+
+    if (low > 9) {
+        low += 6;
+    }
+
+    unsigned high = (A >> 4) + (value >> 4) + (low > 0x0f ? 1 : 0);
+
+    P &= uint8_t(~(flag_N | flag_V | flag_Z | flag_C));
+    if (uint8_t(A + value + carry) == 0) {
+        P |= flag_Z;
+    }
+    else if (high & 8) {
+        P |= flag_N;
+    }
+    if (~(A ^ value) & (A ^ (high << 4)) & 0x80) {
+        P |= flag_V;
+    }
+    if (high > 9) {
+        high += 6;
+    }
+    if (high > 0x0f) {
+        P |= flag_C;
+    }
+    A = uint8_t((high << 4) | (low & 0x0f));
+}
+
+/* The flags are set the same way in decimal, and binary mode */
+void
+mos6500_core::SBC(uint8_t value)
+{
+    const unsigned borrow = flag(flag_C) ? 0 : 1;
+    const unsigned difference = unsigned(A) - value - borrow;
+
+    set_flag(flag_C, difference < 0x100);
+    set_flag(flag_V, ((A ^ value) & (A ^ difference) & 0x80) != 0);
+    set_NZ(uint8_t(difference));
+    if (not flag(flag_D)) {
+        A = uint8_t(difference);
+        return;
+    }
+
+    int low = (A & 0x0f) - (value & 0x0f) - int(borrow);
+    int high = (A >> 4) - (value >> 4);
+
+    if (low < 0) {
+        low -= 6;
+        --high;
+    }
+    if (high < 0) {
+        high -= 6;
+    }
+    A = uint8_t((high << 4) | (low & 0x0f));
+}
+
+void
+mos6500_core::compare(uint8_t reg, uint8_t value)
+{
+    set_flag(flag_C, reg >= value);
+    set_NZ(uint8_t(reg - value));
+}
+
+uint8_t
+mos6500_core::ASL(uint8_t value)
+{
+    set_flag(flag_C, (value & 0x80) != 0);
+    value = uint8_t(value << 1);
+    set_NZ(value);
+    return value;
+}
+
+uint8_t
+mos6500_core::LSR(uint8_t value)
+{
+    set_flag(flag_C, (value & 1) != 0);
+    value = uint8_t(value >> 1);
+    set_NZ(value);
+    return value;
+}
+
+uint8_t
+mos6500_core::ROL(uint8_t value)
+{
+    const uint8_t carry = flag(flag_C) ? 1 : 0;
+
+    set_flag(flag_C, (value & 0x80) != 0);
+    value = uint8_t((value << 1) | carry);
+    set_NZ(value);
+    return value;
+}
+
+uint8_t
+mos6500_core::ROR(uint8_t value)
+{
+    const uint8_t carry = flag(flag_C) ? 0x80 : 0;
+
+    set_flag(flag_C, (value & 1) != 0);
+    value = uint8_t((value >> 1) | carry);
+    set_NZ(value);
+    return value;
+}
+
+/* The effective address, an extra cycle is added to cycles, if the
+ * indexing crosses a page, and cycles is not nullptr - only the
+ * instructions reading memory take that extra cycle.
+ */
+uint16_t
+mos6500_core::address(unsigned mode, unsigned *cycles)
+{
+    uint16_t base;
+    uint16_t result;
+
+    switch (mode) {
+        case zero_page:
+            return next_byte();
+        case zero_page_x:
+            return uint8_t(next_byte() + X);
+        case zero_page_y:
+            return uint8_t(next_byte() + Y);
+        case absolute:
+            return next_word();
+        case absolute_x:
+            base = next_word();
+            result = uint16_t(base + X);
+            break;
+        case absolute_y:
+            base = next_word();
+            result = uint16_t(base + Y);
+            break;
+        case indirect_x: {
+            const uint8_t pointer = uint8_t(next_byte() + X);
+
+            return uint16_t(read(pointer)
+                            | (read(uint8_t(pointer + 1)) << 8));
+        }
+        case indirect_y: {
+            const uint8_t pointer = next_byte();
+
+            base = uint16_t(read(pointer) | (read(uint8_t(pointer + 1)) << 8));
+            result = uint16_t(base + Y);
+            break;
+        }
+        default:
+            return 0;
+    }
+    if (cycles != nullptr and crosses_page(base, result)) {
+        ++*cycles;
+    }
+    return result;
+}
+
+unsigned
+mos6500_core::branch(bool condition)
+{
+    const int8_t offset = int8_t(next_byte());
+
+    if (not condition) {
+        return 2;
+    }
+
+    const uint16_t target = uint16_t(PC + offset);
+    const unsigned cycles = crosses_page(PC, target) ? 4 : 3;
+
+    PC = target;
+    return cycles;
+}
+
+/* Executes the instruction of opcode, returns the number of its cycles */
+unsigned
+mos6500_core::execute()
+{
+    unsigned cycles = cycle_counts[opcode];
+    uint16_t target;
+    uint8_t value;
+
+    switch (opcode) {
+        case 0x00: /* BRK */
+            next_byte();
+            push(uint8_t(PC >> 8));
+            push(uint8_t(PC));
+            push(uint8_t(P | flag_B | flag_U));
+            P |= flag_I;
+            PC = uint16_t(read(0xfffe) | (read(0xffff) << 8));
+            return cycles;
+        case 0x20: /* JSR */
+            value = next_byte();
+            push(uint8_t(PC >> 8));
+            push(uint8_t(PC));
+            PC = uint16_t(value | (next_byte() << 8));
+            return cycles;
+        case 0x40: /* RTI */
+            P = uint8_t(pull() | flag_B | flag_U);
+            value = pull();
+            PC = uint16_t(value | (pull() << 8));
+            return cycles;
+        case 0x60: /* RTS */
+            value = pull();
+            PC = uint16_t((value | (pull() << 8)) + 1);
+            return cycles;
+        case 0x4c: /* JMP abs */
+            PC = next_word();
+            return cycles;
+        case 0x6c: /* JMP (abs), the pointer never crosses a page */
+            target = next_word();
+            value = read(target);
+            PC = uint16_t(value
+                          | (read(uint16_t((target & 0xff00)
+                                           | uint8_t(target + 1))) << 8));
+            return cycles;
+        case 0x08: push(uint8_t(P | flag_B | flag_U)); return cycles;
+        case 0x28: P = uint8_t(pull() | flag_B | flag_U); return cycles;
+        case 0x48: push(A); return cycles;
+        case 0x68: A = pull(); set_NZ(A); return cycles;
+        case 0x18: set_flag(flag_C, false); return cycles;
+        case 0x38: set_flag(flag_C, true); return cycles;
+        case 0x58: set_flag(flag_I, false); return cycles;
+        case 0x78: set_flag(flag_I, true); return cycles;
+        case 0xb8: set_flag(flag_V, false); return cycles;
+        case 0xd8: set_flag(flag_D, false); return cycles;
+        case 0xf8: set_flag(flag_D, true); return cycles;
+        case 0x88: --Y; set_NZ(Y); return cycles;
+        case 0xc8: ++Y; set_NZ(Y); return cycles;
+        case 0xca: --X; set_NZ(X); return cycles;
+        case 0xe8: ++X; set_NZ(X); return cycles;
+        case 0x8a: A = X; set_NZ(A); return cycles;
+        case 0x98: A = Y; set_NZ(A); return cycles;
+        case 0xa8: Y = A; set_NZ(Y); return cycles;
+        case 0xaa: X = A; set_NZ(X); return cycles;
+        case 0xba: X = S; set_NZ(X); return cycles;
+        case 0x9a: S = X; return cycles;
+        case 0xea: return cycles;
+        case 0x0a: A = ASL(A); return cycles;
+        case 0x2a: A = ROL(A); return cycles;
+        case 0x4a: A = LSR(A); return cycles;
+        case 0x6a: A = ROR(A); return cycles;
+        case 0x10: return branch(not flag(flag_N));
+        case 0x30: return branch(flag(flag_N));
+        case 0x50: return branch(not flag(flag_V));
+        case 0x70: return branch(flag(flag_V));
+        case 0x90: return branch(not flag(flag_C));
+        case 0xb0: return branch(flag(flag_C));
+        case 0xd0: return branch(not flag(flag_Z));
+        case 0xf0: return branch(flag(flag_Z));
+        default:
+            break;
+    }
+
+    /* the rest are decoded by the fields of the opcode: aaabbbcc */
+    const unsigned operation = opcode >> 5;
+    const unsigned mode_index = (opcode >> 2) & 7;
+
+    if ((opcode & 3) == 1) {
+        const addressing_mode mode = group_1_modes[mode_index];
+
+        if (operation == 4) { /* STA */
+            write(address(mode, nullptr), A);
+            return cycles;
+        }
+        value = (mode == immediate) ? next_byte()
+                                    : read(address(mode, &cycles));
+        switch (operation) {
+            case 0: A |= value; set_NZ(A); break;
+            case 1: A &= value; set_NZ(A); break;
+            case 2: A ^= value; set_NZ(A); break;
+            case 3: ADC(value); break;
+            case 5: A = value; set_NZ(A); break;
+            case 6: compare(A, value); break;
+            case 7: SBC(value); break;
+        }
+        return cycles;
+    }
+
+    addressing_mode mode = group_0_2_modes[mode_index];
+
+    if ((opcode & 3) == 2 and (operation == 4 or operation == 5)) {
+        /* STX, and LDX are indexed by Y */
+        if (mode == zero_page_x) mode = zero_page_y;
+        if (mode == absolute_x) mode = absolute_y;
+    }
+
+    if ((opcode & 3) == 2) {
+        switch (operation) {
+            case 4: /* STX */
+                write(address(mode, nullptr), X);
+                return cycles;
+            case 5: /* LDX */
+                X = (mode == immediate) ? next_byte()
+                                        : read(address(mode, &cycles));
+                set_NZ(X);
+                return cycles;
+        }
+
+        /* read-modify-write */
+        target = address(mode, nullptr);
+        value = read(target);
+        switch (operation) {
+            case 0: value = ASL(value); break;
+            case 1: value = ROL(value); break;
+            case 2: value = LSR(value); break;
+            case 3: value = ROR(value); break;
+            case 6: --value; set_NZ(value); break;
+            case 7: ++value; set_NZ(value); break;
+        }
+        write(target, value);
+        return cycles;
+    }
+
+    switch (operation) {
+        case 1: /* BIT */
+            value = read(address(mode, nullptr));
+            set_flag(flag_Z, (A & value) == 0);
+            set_flag(flag_N, (value & 0x80) != 0);
+            set_flag(flag_V, (value & 0x40) != 0);
+            break;
+        case 4: /* STY */
+            write(address(mode, nullptr), Y);
+            break;
+        case 5: /* LDY */
+            Y = (mode == immediate) ? next_byte()
+                                    : read(address(mode, &cycles));
+            set_NZ(Y);
+            break;
+        case 6: /* CPY */
+            compare(Y, (mode == immediate) ? next_byte()
+                                           : read(address(mode, nullptr)));
+            break;
+        case 7: /* CPX */
+            compare(X, (mode == immediate) ? next_byte()
+                                           : read(address(mode, nullptr)));
+            break;
+    }
+    return cycles;
+}
+
+unsigned long long
+mos6500_core::run(unsigned long long count)
+{
+    unsigned long long cycles = 0;
+
+    while (cycles < count and cycle_counts[opcode] != 0) {
+        cycles += execute() - cycles_done;
+        has_operand = false;
+        opcode = bus.fetch(PC & address_mask);
+        ++PC;
+        cycles_done = 1;
+        ++cycles;
+    }
+    return cycles;
+}
+
+}
+
+unsigned long long
+MOS6500::run_instructions(instruction_state& state,
+                          unsigned long long count,
+                          bus_handler& bus,
+                          unsigned address_bus_width)
+{
+    implementation::mos6500_core core(state, bus, address_bus_width);
+    const unsigned long long cycles = core.run(count);
+
+    core.save(state);
+    return cycles;
+}
+
+}
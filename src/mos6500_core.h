@@ -0,0 +1,84 @@
+
+#ifndef CHIPEMU_MOS6500_CORE_H
+#define CHIPEMU_MOS6500_CORE_H
+
+#include "mos65xx.h"
+
+#include <cstdint>
+
+namespace chipemu
+{
+namespace implementation
+{
+
+/* An instruction level emulation of the NMOS 6500 family, covering the
+ * documented instructions, with the same cycle counts, and the same
+ * decimal mode behaviour as the netlist - see MOS6500::run_instructions
+ *
+ * The state is copied in by the constructor, and copied back by
+ * save, the instructions work on the members.
+ */
+class mos6500_core
+{
+    bus_handler& bus;
+    const unsigned address_mask;
+
+    uint8_t A;
+    uint8_t X;
+    uint8_t Y;
+    uint8_t S;
+    uint8_t P;
+    uint16_t PC;
+    uint8_t opcode;
+
+    /* the byte after the opcode, if that was already read,
+     * see MOS6500::instruction_state::cycle
+     */
+    bool has_operand;
+    uint8_t operand;
+    unsigned cycles_done;
+
+    uint8_t read(uint16_t address);
+    void write(uint16_t address, uint8_t value);
+    uint8_t next_byte();
+    uint16_t next_word();
+    void push(uint8_t value);
+    uint8_t pull();
+
+    void set_NZ(uint8_t value);
+    void set_flag(uint8_t flag, bool value);
+    bool flag(uint8_t flag) const;
+
+    void ADC(uint8_t value);
+    void SBC(uint8_t value);
+    void compare(uint8_t reg, uint8_t value);
+    uint8_t ASL(uint8_t value);
+    uint8_t LSR(uint8_t value);
+    uint8_t ROL(uint8_t value);
+    uint8_t ROR(uint8_t value);
+
+    uint16_t address(unsigned mode, unsigned *cycles);
+    unsigned branch(bool condition);
+    unsigned execute();
+
+public:
+
+    mos6500_core(const MOS6500::instruction_state&,
+                 bus_handler&,
+                 unsigned address_bus_width);
+
+    /* the number of cycles of each opcode, without the extra cycles of
+     * crossing a page, and taking a branch - zero for the opcodes not
+     * documented
+     */
+    static const uint8_t cycle_counts[256];
+
+    unsigned long long run(unsigned long long count);
+
+    void save(MOS6500::instruction_state&) const;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,36 @@
+
+/* The netlist of mos6502.inc compiled to C++ code by nmos_compiler */
+
+#include "nmos_primitives.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace chipemu
+{
+namespace implementation
+{
+
+namespace
+{
+
+typedef compiled_primitives P;
+typedef void (*group_add_function)(nmos&);
+typedef void (*toggle_gates_function)(nmos&, bool);
+
+#include "mos6502_compiled.inc"
+
+}
+
+extern const compiled_netlist compiled_65XX;
+
+const compiled_netlist compiled_65XX =
+{
+    packed_size,
+    packed_checksum,
+    group_add_table,
+    toggle_gates_table
+};
+
+}
+}
@@ -15,10 +15,17 @@
 #include "mos65xx.h"
 
 #include "nmos.h"
+#include "nmos_bitsliced.h"
 
+#include <algorithm>
 #include <array>
 #include <cstring>
 #include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
 namespace chipemu
 {
@@ -39,6 +46,13 @@ static chip_description description_65XX =
     NODE::Vss
 };
 
+#ifdef CHIPEMU_COMPILED_NETLIST
+extern const compiled_netlist compiled_65XX;
+static const compiled_netlist *compiled_description_65XX = &compiled_65XX;
+#else
+static const compiled_netlist *compiled_description_65XX = nullptr;
+#endif
+
 namespace
 {
 
@@ -52,6 +66,342 @@ static constexpr node_id data_bus_ids[8] =
     {NODE::DB7, NODE::DB6, NODE::DB5, NODE::DB4,
      NODE::DB3, NODE::DB2, NODE::DB1, NODE::DB0};
 
+/* The gather tables used by implementation_6500::registers,
+ * least significant bit first.
+ */
+static constexpr node_id register_ids[64] =
+    {NODE::A0,    NODE::A1,    NODE::A2,    NODE::A3,
+     NODE::A4,    NODE::A5,    NODE::A6,    NODE::A7,
+     NODE::X0,    NODE::X1,    NODE::X2,    NODE::X3,
+     NODE::X4,    NODE::X5,    NODE::X6,    NODE::X7,
+     NODE::Y0,    NODE::Y1,    NODE::Y2,    NODE::Y3,
+     NODE::Y4,    NODE::Y5,    NODE::Y6,    NODE::Y7,
+     NODE::S0,    NODE::S1,    NODE::S2,    NODE::S3,
+     NODE::S4,    NODE::S5,    NODE::S6,    NODE::S7,
+     NODE::P0,    NODE::P1,    NODE::P2,    NODE::P3,
+     NODE::P4,    0,           NODE::P6,    NODE::P7,
+     NODE::PCL0,  NODE::PCL1,  NODE::PCL2,  NODE::PCL3,
+     NODE::PCL4,  NODE::PCL5,  NODE::PCL6,  NODE::PCL7,
+     NODE::PCH0,  NODE::PCH1,  NODE::PCH2,  NODE::PCH3,
+     NODE::PCH4,  NODE::PCH5,  NODE::PCH6,  NODE::PCH7,
+     NODE::NOTIR0, NODE::NOTIR1, NODE::NOTIR2, NODE::NOTIR3,
+     NODE::NOTIR4, NODE::NOTIR5, NODE::NOTIR6, NODE::NOTIR7};
+
+static constexpr node_id bus_ids[30] =
+    {NODE::DB0,   NODE::DB1,   NODE::DB2,   NODE::DB3,
+     NODE::DB4,   NODE::DB5,   NODE::DB6,   NODE::DB7,
+     NODE::AB0,   NODE::AB1,   NODE::AB2,   NODE::AB3,
+     NODE::AB4,   NODE::AB5,   NODE::AB6,   NODE::AB7,
+     NODE::AB8,   NODE::AB9,   NODE::AB10,  NODE::AB11,
+     NODE::AB12,  NODE::AB13,  NODE::AB14,  NODE::AB15,
+     NODE::RW,    NODE::SYNC,  NODE::RDY,   NODE::IRQ,
+     NODE::NMI,   NODE::RES};
+
+/* The pins of a chip created by create_specialized, see
+ * MOS6500::pin_constant
+ */
+class pin_usage
+{
+    const node_id *pinout;
+    unsigned pin_count;
+
+    void check(unsigned pin) const
+    {
+        if (pin == 0 or pin > pin_count or pinout[pin - 1] == 0
+                or pinout[pin - 1] == NODE::Vcc
+                or pinout[pin - 1] == NODE::Vss)
+        {
+            throw std::invalid_argument("pin");
+        }
+    }
+
+public:
+
+    typedef MOS6500::pin_constant pin_constant;
+
+    /* bit N is set, if the pin N + 1 is tied to a constant, or is read,
+     * the pins of the rails can always be read
+     */
+    uint64_t constant_pins;
+    uint64_t observed_pins;
+
+    specialization use;
+
+    pin_usage(const node_id *pinout_data,
+              unsigned pins,
+              const std::vector<pin_constant>& constants,
+              const std::vector<unsigned>& observed):
+        pinout(pinout_data),
+        pin_count(pins),
+        constant_pins(0),
+        observed_pins(0)
+    {
+        /* read by the accessors, and by run_cycles, even if the chip
+         * has no pin for some of those - the address bus pins are
+         * added below
+         */
+        std::vector<node_id> read(std::begin(data_bus_ids),
+                                  std::end(data_bus_ids));
+
+        read.insert(read.end(), {NODE::RW, NODE::SYNC, NODE::RDY,
+                                 NODE::IRQ, NODE::NMI, NODE::RES});
+
+        for (const pin_constant& constant : constants) {
+            check(constant.pin);
+
+            const node_id id = pinout[constant.pin - 1];
+
+            if ((constant_pins >> (constant.pin - 1)) & 1
+                    or id == NODE::CLK0IN
+                    or std::find(std::begin(data_bus_ids),
+                                 std::end(data_bus_ids),
+                                 id) != std::end(data_bus_ids))
+            {
+                throw std::invalid_argument("pin constant");
+            }
+            constant_pins |= uint64_t(1) << (constant.pin - 1);
+            if (not constant.value) {
+                use.held_low.push_back(id);
+            }
+        }
+        for (unsigned pin : observed) {
+            check(pin);
+            observed_pins |= uint64_t(1) << (pin - 1);
+        }
+        for (unsigned pin = 1; pin <= pin_count; ++pin) {
+            const node_id id = pinout[pin - 1];
+
+            if (id == 0 or id == NODE::Vcc or id == NODE::Vss) {
+                observed_pins |= uint64_t(1) << (pin - 1);
+                continue;
+            }
+
+            if (std::find(read.begin(), read.end(), id) != read.end()
+                    or std::find(std::begin(address_bus_ids),
+                                 std::end(address_bus_ids),
+                                 id) != std::end(address_bus_ids))
+            {
+                observed_pins |= uint64_t(1) << (pin - 1);
+            }
+            if ((observed_pins >> (pin - 1)) & 1) {
+                use.observed.push_back(id);
+            }
+            if (std::find(use.held_low.begin(), use.held_low.end(), id)
+                    == use.held_low.end())
+            {
+                use.inputs.push_back(id);
+            }
+        }
+        for (node_id id : read) {
+            use.observed.push_back(id);
+        }
+        for (node_id id : register_ids) {
+            if (id != 0) {
+                use.observed.push_back(id);
+            }
+        }
+    }
+};
+
+/* Passes every access on, remembering the last one - used by
+ * implementation_6500::save_instruction_state
+ */
+class recording_bus : public bus_handler
+{
+    bus_handler& bus;
+
+public:
+
+    unsigned char value;
+
+    explicit recording_bus(bus_handler& target):
+        bus(target),
+        value(0)
+    {}
+
+    virtual unsigned char read(unsigned address) final
+    {
+        return value = bus.read(address);
+    }
+
+    virtual unsigned char fetch(unsigned address) final
+    {
+        return value = bus.fetch(address);
+    }
+
+    virtual void write(unsigned address, unsigned char data) final
+    {
+        bus.write(address, data);
+    }
+};
+
+/* Feeds a sequence of instructions to the CPU, no matter what address it
+ * reads - used by implementation_6500::load_instruction_state
+ *
+ * The reads before the first opcode fetch return zero, a fetch returns
+ * the next opcode, the reads after that return the bytes following
+ * the opcode, repeating the last one, writes are ignored.
+ */
+class feeding_bus : public bus_handler
+{
+    const std::vector<std::vector<unsigned char>>& program;
+
+public:
+
+    unsigned fetches;
+    unsigned reads;
+
+    explicit feeding_bus(
+                const std::vector<std::vector<unsigned char>>& instructions):
+        program(instructions),
+        fetches(0),
+        reads(0)
+    {}
+
+    virtual unsigned char read(unsigned) final
+    {
+        if (fetches == 0 or fetches > program.size()) {
+            return 0;
+        }
+
+        const std::vector<unsigned char>& bytes = program[fetches - 1];
+
+        if (bytes.size() == 1) {
+            return 0;
+        }
+        return bytes[std::min<size_t>(++reads, bytes.size() - 1)];
+    }
+
+    virtual unsigned char fetch(unsigned) final
+    {
+        reads = 0;
+        if (fetches >= program.size()) {
+            return 0;
+        }
+        return program[fetches++][0];
+    }
+
+    virtual void write(unsigned, unsigned char) final
+    {}
+};
+
+/* Records the accesses of an instruction level run, and replays them to
+ * a switch level run, used by implementation_6500::fast_forward for
+ * validating the former
+ *
+ * While recording, the accesses are passed on to the target. While
+ * replaying, an access matching the next one recorded consumes it, the
+ * others are taken to be the dummy accesses the instruction level run
+ * leaves out: a read returns the last value seen at its address, a write
+ * must be the extra write of a read-modify-write instruction - to the
+ * address of the next write recorded, or repeating the previous one.
+ * Anything else is a mismatch.
+ */
+class replay_bus : public bus_handler
+{
+    enum kind {read_access, fetch_access, write_access};
+
+    struct access
+    {
+        kind type;
+        unsigned address;
+        unsigned char value;
+    };
+
+    bus_handler *bus;
+    std::vector<access> accesses;
+    size_t next;
+    std::map<unsigned, unsigned char> memory;
+
+    bool is_write(size_t index, unsigned address) const
+    {
+        return index < accesses.size()
+               and accesses[index].type == write_access
+               and accesses[index].address == address;
+    }
+
+    unsigned char replay(kind type, unsigned address, unsigned char value)
+    {
+        if (next < accesses.size() and accesses[next].type == type
+                and accesses[next].address == address
+                and (type != write_access or accesses[next].value == value))
+        {
+            memory[address] = accesses[next].value;
+            return accesses[next++].value;
+        }
+        if (type == fetch_access
+                or (type == write_access
+                    and not is_write(next, address)
+                    and not (is_write(next - 1, address)
+                             and accesses[next - 1].value == value)))
+        {
+            mismatch = true;
+        }
+        return memory[address];
+    }
+
+public:
+
+    bool mismatch;
+
+    /* records the accesses made via target, or replays them without a
+     * target
+     */
+    explicit replay_bus(bus_handler *target):
+        bus(target),
+        next(0),
+        mismatch(false)
+    {}
+
+    /* starts replaying the accesses recorded by another replay_bus */
+    explicit replay_bus(const replay_bus& recorded):
+        bus(nullptr),
+        accesses(recorded.accesses),
+        next(0),
+        mismatch(false)
+    {}
+
+    bool all_replayed() const
+    {
+        return next == accesses.size();
+    }
+
+    virtual unsigned char read(unsigned address) final
+    {
+        if (bus == nullptr) {
+            return replay(read_access, address, 0);
+        }
+
+        const unsigned char value = bus->read(address);
+
+        accesses.push_back({read_access, address, value});
+        return value;
+    }
+
+    virtual unsigned char fetch(unsigned address) final
+    {
+        if (bus == nullptr) {
+            return replay(fetch_access, address, 0);
+        }
+
+        const unsigned char value = bus->fetch(address);
+
+        accesses.push_back({fetch_access, address, value});
+        return value;
+    }
+
+    virtual void write(unsigned address, unsigned char value) final
+    {
+        if (bus == nullptr) {
+            replay(write_access, address, value);
+        }
+        else {
+            bus->write(address, value);
+            accesses.push_back({write_access, address, value});
+        }
+    }
+};
+
 class implementation_6500 : protected nmos,
                             protected virtual MOS6500
 {
@@ -59,18 +409,28 @@ protected:
 
     const node_id * const pinout;
 
+    /* see pin_usage, no pin is constant, and every pin is read, unless
+     * the chip is specialized
+     */
+    const uint64_t constant_pins;
+    const uint64_t observed_pins;
+
 public:
 
     virtual void pin_write(unsigned index, bool value) noexcept
     {
-        if (index > 0 and index <= pin_count()) {
+        if (index > 0 and index <= pin_count()
+                and not ((constant_pins >> (index - 1)) & 1))
+        {
             set_node(pinout[index - 1], value);
         }
     }
 
     virtual bool pin_read(unsigned index) const noexcept
     {
-        if (index > 0 and index <= pin_count()) {
+        if (index > 0 and index <= pin_count()
+                and ((observed_pins >> (index - 1)) & 1))
+        {
             return get_node(pinout[index - 1]);
         }
         else {
@@ -171,12 +531,229 @@ public:
         return static_cast<unsigned char>(read_nodes(ids, 8));
     }
 
+    virtual register_file registers() const noexcept final
+    {
+        const uint64_t regs = gather_nodes(register_ids, 64);
+        const uint64_t bus = gather_nodes(bus_ids, 30);
+        auto byte = [](uint64_t bits, unsigned index) {
+            return static_cast<unsigned char>(bits >> (index * 8));
+        };
+        register_file result;
+
+        result.A = byte(regs, 0);
+        result.X = byte(regs, 1);
+        result.Y = byte(regs, 2);
+        result.S = byte(regs, 3);
+        result.P = byte(regs, 4);
+        result.PCL = byte(regs, 5);
+        result.PCH = byte(regs, 6);
+        result.IR = byte(regs, 7);
+        result.PC = (unsigned(result.PCH) << 8) + result.PCL;
+        result.data_bus = byte(bus, 0);
+        result.address_bus = unsigned(bus >> 8)
+                             & ((1u << address_bus_width()) - 1);
+        result.RW = (bus >> 24) & 1;
+        result.SYNC = (bus >> 25) & 1;
+        result.RDY = (bus >> 26) & 1;
+        result.IRQ = (bus >> 27) & 1;
+        result.NMI = (bus >> 28) & 1;
+        result.RES = (bus >> 29) & 1;
+        return result;
+    }
+
+    virtual void run_cycles(unsigned long long count,
+                            bus_handler& bus) final
+    {
+        const unsigned width = address_bus_width();
+        const node_id *address_ids = address_bus_ids + (16 - width);
+
+        while (count-- > 0) {
+            set_node(NODE::CLK0IN, false);
+            nmos::recalc();
+            set_node(NODE::CLK0IN, true);
+            nmos::recalc();
+
+            unsigned address = read_nodes(address_ids, width);
+
+            if (get_node(NODE::RW)) {
+                unsigned char value = get_node(NODE::SYNC)
+                                      ? bus.fetch(address)
+                                      : bus.read(address);
+
+                write_nodes(data_bus_ids, 8, value);
+            }
+            else {
+                bus.write(address, static_cast<unsigned char>(
+                                       read_nodes(data_bus_ids, 8)));
+            }
+        }
+    }
+
+    virtual instruction_state
+    save_instruction_state(bus_handler& bus,
+                           unsigned long long& cycles) final
+    {
+        recording_bus recorder(bus);
+        instruction_state state;
+
+        /* RDY held low, or an opcode halting the CPU */
+        for (unsigned limit = 256; ; --limit) {
+            if (limit == 0) {
+                throw std::runtime_error("save_instruction_state");
+            }
+            run_cycles(1, recorder);
+            ++cycles;
+            if (not get_node(NODE::SYNC)) {
+                continue;
+            }
+            state.PC = PC();
+            state.opcode = recorder.value;
+            run_cycles(1, recorder);
+            ++cycles;
+            state.operand = recorder.value;
+
+            /* an interrupt, or reset sequence replaces the opcode in IR
+             * with BRK, and does not increment PC
+             */
+            if (static_cast<unsigned char>(~IR()) == state.opcode
+                    and PC() == ((state.PC + 1) & 0xffff))
+            {
+                break;
+            }
+        }
+        state.A = A();
+        state.X = X();
+        state.Y = Y();
+        state.S = S();
+        state.P = P() | 0x30;
+        state.cycle = 2;
+        return state;
+    }
+
+    virtual void load_instruction_state(const instruction_state& state) final
+    {
+        typedef std::vector<unsigned char> bytes;
+        const std::vector<bytes> program = {
+            bytes{0xa2, static_cast<unsigned char>(state.S - 1)}, /* LDX # */
+            bytes{0x9a},                                          /* TXS */
+            bytes{0xa9, state.A},                                 /* LDA # */
+            bytes{0xa0, state.Y},                                 /* LDY # */
+            bytes{0xa2, state.X},                                 /* LDX # */
+            bytes{0x28, state.P},                                 /* PLP */
+            bytes{0x4c, static_cast<unsigned char>(state.PC),     /* JMP */
+                  static_cast<unsigned char>(state.PC >> 8)},
+            bytes{state.opcode, state.operand}
+        };
+        feeding_bus feeder(program);
+
+        /* the instruction being run might take at most seven cycles,
+         * the ones above take 23 cycles
+         */
+        for (unsigned limit = 64; feeder.fetches < program.size(); --limit) {
+            if (limit == 0) {
+                throw std::runtime_error("load_instruction_state");
+            }
+            run_cycles(1, feeder);
+        }
+        if (state.cycle == 2) {
+            run_cycles(1, feeder);
+        }
+    }
+
+    virtual unsigned long long fast_forward(unsigned long long count,
+                                            bus_handler& bus,
+                                            bool validate) final
+    {
+        if (not get_node(NODE::RDY) or not get_node(NODE::IRQ)
+                or not get_node(NODE::NMI) or not get_node(NODE::RES))
+        {
+            run_cycles(count, bus);
+            return count;
+        }
+
+        unsigned long long cycles = 0;
+        instruction_state state = save_instruction_state(bus, cycles);
+        std::unique_ptr<MOS6500> reference;
+        replay_bus recorder(&bus);
+
+        if (validate) {
+            reference.reset(clone());
+        }
+
+        const unsigned long long instruction_cycles =
+            run_instructions(state,
+                             count > cycles ? count - cycles : 0,
+                             validate ? recorder : bus,
+                             address_bus_width());
+
+        if (validate and instruction_cycles > 0) {
+            replay_bus replay(recorder);
+            const unsigned mask = (1u << address_bus_width()) - 1;
+
+            reference->run_cycles(instruction_cycles, replay);
+
+            const register_file regs = reference->registers();
+
+            if (replay.mismatch or not replay.all_replayed()) {
+                throw std::runtime_error("fast_forward: bus accesses");
+            }
+            if (state.cycle != 1 or not regs.SYNC
+                    or regs.address_bus != (state.PC & mask))
+            {
+                throw std::runtime_error("fast_forward: PC");
+            }
+            reference->run_cycles(1, replay);
+            if (reference->A() != state.A or reference->X() != state.X
+                    or reference->Y() != state.Y
+                    or reference->S() != state.S
+                    or (reference->P() & 0xcf) != (state.P & 0xcf))
+            {
+                throw std::runtime_error("fast_forward: registers");
+            }
+        }
+
+        cycles += instruction_cycles;
+        load_instruction_state(state);
+
+        if (validate) {
+            if (A() != state.A or X() != state.X or Y() != state.Y
+                    or S() != state.S or (P() & 0xcf) != (state.P & 0xcf)
+                    or (state.cycle == 1 and PC() != state.PC))
+            {
+                throw std::runtime_error("fast_forward: load");
+            }
+        }
+
+        if (cycles < count) {
+            run_cycles(count - cycles, bus);
+            cycles = count;
+        }
+        return cycles;
+    }
+
     implementation_6500(const node_id *pinout_data):
-        nmos(description_65XX),
-        pinout(pinout_data)
+        nmos(description_65XX, compiled_description_65XX),
+        pinout(pinout_data),
+        constant_pins(0),
+        observed_pins(~uint64_t(0))
     {
     }
 
+    implementation_6500(const node_id *pinout_data,
+                        const pin_usage& usage,
+                        const std::vector<pin_constant>& constants):
+        nmos(description_65XX,
+             implementation::netlist::get(description_65XX, usage.use),
+             compiled_description_65XX),
+        pinout(pinout_data),
+        constant_pins(usage.constant_pins),
+        observed_pins(usage.observed_pins)
+    {
+        for (const pin_constant& constant : constants) {
+            set_node(pinout[constant.pin - 1], constant.value);
+        }
+    }
+
     virtual ~implementation_6500() {}
 };
 
@@ -206,6 +783,13 @@ public:
         implementation_6500(pinout_6502)
     {}
 
+    implementation_6502(const std::vector<pin_constant>& constants,
+                        const std::vector<unsigned>& observed):
+        implementation_6500(pinout_6502,
+                            pin_usage(pinout_6502, 40, constants, observed),
+                            constants)
+    {}
+
     virtual unsigned pin_count() const noexcept final
     {
         return 40;
@@ -221,12 +805,91 @@ public:
         return 16;
     }
 
+    virtual MOS6502 *clone() const final
+    {
+        return new implementation_6502(*this);
+    }
+
     virtual ~implementation_6502() {}
 };
 
 /***************** 6502 *****************************************************/
 
 
+/***************** 6502 lanes ***********************************************/
+
+class implementation_6502_lanes : public MOS6502_lanes,
+                                  protected nmos_bitsliced
+{
+public:
+
+    implementation_6502_lanes():
+        nmos_bitsliced(description_65XX)
+    {}
+
+    virtual const char *name() const noexcept final
+    {
+        return "MOS6502 lanes";
+    }
+
+    virtual unsigned lane_count() const noexcept final
+    {
+        return nmos_bitsliced::lane_count;
+    }
+
+    virtual unsigned pin_count() const noexcept final
+    {
+        return 40;
+    }
+
+    virtual void pin_write(unsigned lane,
+                           unsigned index,
+                           bool value) noexcept final
+    {
+        if (index > 0 and index <= pin_count()) {
+            set_node(lane, pinout_6502[index - 1], value);
+        }
+    }
+
+    virtual void pin_write_all(unsigned index, bool value) noexcept final
+    {
+        if (index > 0 and index <= pin_count()) {
+            set_node_all_lanes(pinout_6502[index - 1], value);
+        }
+    }
+
+    virtual bool pin_read(unsigned lane, unsigned index) const noexcept final
+    {
+        if (index > 0 and index <= pin_count()) {
+            return get_node(lane, pinout_6502[index - 1]);
+        }
+        else {
+            return false;
+        }
+    }
+
+    virtual unsigned read_address_bus(unsigned lane) const noexcept final
+    {
+        return read_nodes(lane, address_bus_ids, 16);
+    }
+
+    virtual unsigned char read_data_bus(unsigned lane) const noexcept final
+    {
+        return static_cast<unsigned char>(read_nodes(lane, data_bus_ids, 8));
+    }
+
+    virtual void write_data_bus(unsigned lane,
+                                unsigned char value) noexcept final
+    {
+        write_nodes(lane, data_bus_ids, 8, value);
+    }
+
+    virtual ~implementation_6502_lanes() {}
+};
+
+/***************** 6502 lanes ***********************************************/
+
+
 /***************** 6503 *****************************************************/
 
 
@@ -247,6 +910,13 @@ public:
         implementation_6500(pinout_6503)
     {}
 
+    implementation_6503(const std::vector<pin_constant>& constants,
+                        const std::vector<unsigned>& observed):
+        implementation_6500(pinout_6503,
+                            pin_usage(pinout_6503, 28, constants, observed),
+                            constants)
+    {}
+
     virtual unsigned pin_count() const noexcept final
     {
         return 28;
@@ -262,6 +932,11 @@ public:
         return 11;
     }
 
+    virtual MOS6503 *clone() const final
+    {
+        return new implementation_6503(*this);
+    }
+
     virtual ~implementation_6503() {}
 };
 
@@ -287,6 +962,13 @@ public:
         implementation_6500(pinout_6504)
     {}
 
+    implementation_6504(const std::vector<pin_constant>& constants,
+                        const std::vector<unsigned>& observed):
+        implementation_6500(pinout_6504,
+                            pin_usage(pinout_6504, 28, constants, observed),
+                            constants)
+    {}
+
     virtual unsigned pin_count() const noexcept final
     {
         return 28;
@@ -302,6 +984,11 @@ public:
         return 12;
     }
 
+    virtual MOS6504 *clone() const final
+    {
+        return new implementation_6504(*this);
+    }
+
     virtual ~implementation_6504() {}
 };
 
@@ -327,6 +1014,13 @@ public:
         implementation_6500(pinout_6505)
     {}
 
+    implementation_6505(const std::vector<pin_constant>& constants,
+                        const std::vector<unsigned>& observed):
+        implementation_6500(pinout_6505,
+                            pin_usage(pinout_6505, 28, constants, observed),
+                            constants)
+    {}
+
     virtual unsigned pin_count() const noexcept final
     {
         return 28;
@@ -342,6 +1036,11 @@ public:
         return 11;
     }
 
+    virtual MOS6505 *clone() const final
+    {
+        return new implementation_6505(*this);
+    }
+
     virtual ~implementation_6505() {}
 };
 
@@ -481,6 +1180,29 @@ public:
         return 16;
     }
 
+    /* the state of the netlist, followed by AEC, and the I/O port */
+    virtual std::vector<unsigned char> snapshot() const final
+    {
+        std::vector<unsigned char> blob;
+
+        save_state(blob);
+        blob.push_back(is_aec_high ? 1 : 0);
+        blob.push_back(ioports);
+        blob.push_back(iodirs);
+        return blob;
+    }
+
+    virtual void restore(const std::vector<unsigned char>& blob) final
+    {
+        if (blob.size() < 3) {
+            throw std::invalid_argument("snapshot");
+        }
+        restore_state(blob.data(), blob.size() - 3);
+        is_aec_high = blob[blob.size() - 3] != 0;
+        ioports = blob[blob.size() - 2];
+        iodirs = blob[blob.size() - 1];
+    }
+
     virtual ~implementation_6500_with_IO() {}
 };
 
@@ -518,6 +1240,11 @@ public:
         return "MOS6510";
     }
 
+    virtual MOS6510 *clone() const final
+    {
+        return new implementation_6510(*this);
+    }
+
     virtual ~implementation_6510() {}
 };
 
@@ -559,6 +1286,11 @@ public:
         return "MOS6510-1";
     }
 
+    virtual MOS6510_1 *clone() const final
+    {
+        return new implementation_6510_1(*this);
+    }
+
     virtual ~implementation_6510_1() {}
 };
 
@@ -600,6 +1332,11 @@ public:
         return "MOS6510-2";
     }
 
+    virtual MOS6510_2 *clone() const final
+    {
+        return new implementation_6510_2(*this);
+    }
+
     virtual ~implementation_6510_2() {}
 };
 
@@ -609,18 +1346,70 @@ public:
 
 MOS6500::~MOS6500() {}
 
+bus_handler::~bus_handler() {}
+
+bool MOS6500::load_netlist(const char *path)
+{
+    using namespace implementation;
+
+    auto topology = netlist::load(path, description_65XX);
+
+    if (topology) {
+        netlist::install(description_65XX, topology);
+    }
+    return topology != nullptr;
+}
+
+void MOS6500::save_netlist(const char *path)
+{
+    using namespace implementation;
+
+    netlist::get(description_65XX)->save(path);
+}
+
+void MOS6500::renumber_netlist(bool renumber)
+{
+    using namespace implementation;
+
+    netlist::install(description_65XX,
+                     std::make_shared<const netlist>(description_65XX,
+                        renumber ? node_order::connectivity
+                                 : node_order::description));
+}
+
 MOS6502 *MOS6502::create()
 {
     return new implementation::implementation_6502;
 }
 
+MOS6502 *MOS6502::create_specialized(
+                    const std::vector<pin_constant>& constants,
+                    const std::vector<unsigned>& observed)
+{
+    return new implementation::implementation_6502(constants, observed);
+}
+
 MOS6502::~MOS6502() {}
 
+MOS6502_lanes *MOS6502_lanes::create()
+{
+    return new implementation::implementation_6502_lanes;
+}
+
+MOS6502_lanes::~MOS6502_lanes() {}
+
 MOS6503 *MOS6503::create()
 {
     return new implementation::implementation_6503;
 }
 
+MOS6503 *MOS6503::create_specialized(
+                    const std::vector<pin_constant>& constants,
+                    const std::vector<unsigned>& observed)
+{
+    return new implementation::implementation_6503(constants, observed);
+}
+
 MOS6503::~MOS6503() {}
 
 MOS6504 *MOS6504::create()
@@ -628,6 +1417,13 @@ MOS6504 *MOS6504::create()
     return new implementation::implementation_6504;
 }
 
+MOS6504 *MOS6504::create_specialized(
+                    const std::vector<pin_constant>& constants,
+                    const std::vector<unsigned>& observed)
+{
+    return new implementation::implementation_6504(constants, observed);
+}
+
 MOS6504::~MOS6504() {}
 
 MOS6505 *MOS6505::create()
@@ -635,6 +1431,13 @@ MOS6505 *MOS6505::create()
     return new implementation::implementation_6505;
 }
 
+MOS6505 *MOS6505::create_specialized(
+                    const std::vector<pin_constant>& constants,
+                    const std::vector<unsigned>& observed)
+{
+    return new implementation::implementation_6505(constants, observed);
+}
+
 MOS6505::~MOS6505() {}
 
 MOS6510 *MOS6510::create()
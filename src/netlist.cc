@@ -0,0 +1,1165 @@
+
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <unordered_set>
+#include <cstdio>
+#include <cstring>
+
+#ifdef CHIPEMU_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "netlist.h"
+
+using std::vector;
+
+namespace chipemu
+{
+namespace implementation
+{
+
+namespace
+{
+
+/* The format of a netlist image:
+ *
+ *   image_header
+ *   node_offsets  - node_count + 1 id_type values
+ *   node_ids      - node_count + 1 id_type values, the id of each node
+ *                   in the chip_description
+ *   nodes         - packed_size id_type values
+ *   pullups       - node_count + 1 bytes
+ *
+ * Stored in the native byte order, word_size is sizeof(id_type).
+ * The power, and ground fields hold the ids used in the netlist.
+ */
+struct image_header
+{
+    char magic[8];
+    uint32_t word_size;
+    uint32_t node_count;
+    uint32_t transistor_count;
+    uint32_t max_gate_count;
+    uint32_t packed_size;
+    uint32_t layout_checksum;
+    uint32_t description_checksum;
+    uint32_t power;
+    uint32_t ground;
+};
+
+static constexpr char image_magic[8] = {'c', 'h', 'i', 'p', 'n', 'e', 't', '3'};
+
+static size_t
+image_bytes(size_t node_count, size_t packed_size, size_t word_size)
+{
+    return sizeof(image_header)
+        + 2 * (node_count + 1) * word_size
+        + packed_size * word_size
+        + (node_count + 1);
+}
+
+/* utility type, used while constructing the
+ * internal nodes
+ */
+struct construct_node
+{
+    bool is_pullup;
+    vector<unsigned> gates;
+    vector<unsigned> sibling_connectors;
+
+    construct_node(bool is_pullup): is_pullup(is_pullup) {}
+};
+
+/* FNV-1a hash */
+class fnv1a
+{
+    uint32_t hash;
+
+public:
+
+    fnv1a(): hash(2166136261u) {}
+
+    void add(uint16_t value)
+    {
+        hash = (hash ^ (value & 0xff)) * 16777619u;
+        hash = (hash ^ (value >> 8)) * 16777619u;
+    }
+
+    void add(uint32_t value)
+    {
+        add(uint16_t(value));
+        add(uint16_t(value >> 16));
+    }
+
+    uint32_t value() const
+    {
+        return hash;
+    }
+};
+
+/* A transistor is identified by its gate, and the unordered
+ * pair of its legs.
+ */
+struct transistor_key
+{
+    uint32_t gate;
+    uint32_t low;
+    uint32_t high;
+
+    bool operator==(const transistor_key& other) const
+    {
+        return gate == other.gate and low == other.low and high == other.high;
+    }
+};
+
+struct transistor_key_hash
+{
+    size_t operator()(const transistor_key& key) const
+    {
+        uint64_t value = (uint64_t(key.low) << 32) | key.high;
+
+        value ^= uint64_t(key.gate) * 0x9e3779b97f4a7c15u;
+        return size_t(value ^ (value >> 29));
+    }
+};
+
+unsigned
+find_root(vector<unsigned>& parent, unsigned x)
+{
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+} // anonym namespace
+
+template<typename id_type>
+static vector<construct_node>
+create_construct_nodes(const basic_chip_description<id_type>& desc)
+{
+    vector<construct_node> nodes;
+
+    nodes.emplace_back(false);
+    for (unsigned index = 0; index < desc.node_count; ++index) {
+        nodes.emplace_back(desc.pullups[index]);
+    }
+
+    return nodes;
+}
+
+/* The transistors of the netlist, without duplicates, and without the
+ * transistors gated by power, or ground. The rails never toggle - their
+ * groups are always empty - and every transistor starts in the off state,
+ * thus a transistor gated by a rail is never switched on, it can not
+ * affect the simulation in any way.
+ * If used is not nullptr, only the transistors marked in it are kept.
+ */
+template<typename id_type>
+static vector<const basic_transdef<id_type>*>
+setup_transistors(const basic_chip_description<id_type>& desc,
+                  vector<construct_node>& nodes,
+                  const vector<bool> *used)
+{
+    vector<const basic_transdef<id_type>*> transistors;
+    std::unordered_set<transistor_key, transistor_key_hash> known;
+    const basic_transdef<id_type> *tdef = desc.transistors;
+
+    known.reserve(desc.transistor_count);
+    for (;tdef != desc.transistors + desc.transistor_count; ++tdef) {
+        if (tdef->gate >= nodes.size()
+                or tdef->c1 >= nodes.size()
+                or tdef->c2 >= nodes.size())
+        {
+            throw std::out_of_range("node id");
+        }
+        if (tdef->gate == desc.node_power or tdef->gate == desc.node_ground) {
+            continue;
+        }
+        if (used != nullptr and not (*used)[tdef - desc.transistors]) {
+            continue;
+        }
+
+        transistor_key key = {tdef->gate,
+                              std::min(tdef->c1, tdef->c2),
+                              std::max(tdef->c1, tdef->c2)};
+
+        if (known.insert(key).second) {
+            unsigned index = unsigned(transistors.size());
+
+            transistors.push_back(tdef);
+            nodes[tdef->gate].gates.push_back(index);
+            nodes[tdef->c1].sibling_connectors.push_back(index);
+            nodes[tdef->c2].sibling_connectors.push_back(index);
+        }
+    }
+    if (transistors.size() > std::numeric_limits<id_type>::max()) {
+        throw std::out_of_range("transistor count");
+    }
+
+    return transistors;
+}
+
+/* The transistors kept in a netlist specialized for a use of the chip,
+ * indexed by the transistor indices of the chip_description.
+ *
+ * First the nodes which might ever be high are found: power, the nodes
+ * with a pullup - unless held low - the inputs, and every node connected
+ * via transistors which might be switched on to one of those. A transistor
+ * might be switched on, if its gate might be high. Starting with every
+ * transistor off, the sets grow until nothing changes. A node never
+ * found to be high stays low, it never toggles the transistors it gates,
+ * those are left out.
+ *
+ * The value of a node depends on the nodes in its channel-connected
+ * component, and on the gates of the transistors with a leg in it.
+ * The components the observed nodes depend on are found by following
+ * those gates backwards, the transistors of other components are left
+ * out. The gate of every transistor with a leg in an observed component
+ * is in an observed component as well, so no node of a dropped component
+ * gates a transistor of an observed one - thus the order the nodes of the
+ * observed components are queued, and evaluated in does not change.
+ */
+template<typename id_type>
+static vector<bool>
+specialized_transistors(const basic_chip_description<id_type>& desc,
+                        const specialization& use)
+{
+    const unsigned count = desc.node_count + 1;
+    const basic_transdef<id_type> *tdefs = desc.transistors;
+    const unsigned power = desc.node_power;
+    const unsigned ground = desc.node_ground;
+    vector<bool> might_be_high(count, false);
+    vector<bool> might_be_on(desc.transistor_count, false);
+    vector<bool> source(count, false);
+    vector<unsigned> parent(count);
+
+    auto is_rail = [&](unsigned id) {
+        return id == power or id == ground;
+    };
+    auto check = [&](unsigned id) {
+        if (id == 0 or id >= count) {
+            throw std::out_of_range("node id");
+        }
+        return id;
+    };
+
+    for (unsigned id = 1; id < count; ++id) {
+        source[id] = desc.pullups[id - 1];
+    }
+    for (unsigned id : use.held_low) {
+        source[check(id)] = false;
+    }
+    for (unsigned id : use.inputs) {
+        source[check(id)] = true;
+    }
+
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+        for (unsigned id = 0; id < count; ++id) {
+            parent[id] = id;
+        }
+        for (unsigned i = 0; i < desc.transistor_count; ++i) {
+            if (might_be_on[i]
+                    and not is_rail(tdefs[i].c1)
+                    and not is_rail(tdefs[i].c2))
+            {
+                parent[find_root(parent, tdefs[i].c1)] =
+                    find_root(parent, tdefs[i].c2);
+            }
+        }
+
+        vector<bool> high_component(count, false);
+
+        for (unsigned id = 1; id < count; ++id) {
+            if (source[id] and not is_rail(id)) {
+                high_component[find_root(parent, id)] = true;
+            }
+        }
+        for (unsigned i = 0; i < desc.transistor_count; ++i) {
+            if (might_be_on[i] and tdefs[i].c1 == power
+                    and not is_rail(tdefs[i].c2))
+            {
+                high_component[find_root(parent, tdefs[i].c2)] = true;
+            }
+            if (might_be_on[i] and tdefs[i].c2 == power
+                    and not is_rail(tdefs[i].c1))
+            {
+                high_component[find_root(parent, tdefs[i].c1)] = true;
+            }
+        }
+        for (unsigned id = 1; id < count; ++id) {
+            if (not is_rail(id) and not might_be_high[id]
+                    and high_component[find_root(parent, id)])
+            {
+                might_be_high[id] = true;
+                changed = true;
+            }
+        }
+        for (unsigned i = 0; i < desc.transistor_count; ++i) {
+            if (not might_be_on[i] and might_be_high[tdefs[i].gate]) {
+                might_be_on[i] = true;
+                changed = true;
+            }
+        }
+    }
+
+    /* parent holds the components of the final state at this point */
+    vector<vector<unsigned>> component_gates(count);
+    vector<bool> observed(count, false);
+    vector<unsigned> pending;
+
+    auto observe = [&](unsigned id) {
+        if (not is_rail(id)) {
+            const unsigned root = find_root(parent, id);
+
+            if (not observed[root]) {
+                observed[root] = true;
+                pending.push_back(root);
+            }
+        }
+    };
+
+    for (unsigned i = 0; i < desc.transistor_count; ++i) {
+        if (might_be_on[i]) {
+            if (not is_rail(tdefs[i].c1)) {
+                component_gates[find_root(parent, tdefs[i].c1)]
+                    .push_back(tdefs[i].gate);
+            }
+            else if (not is_rail(tdefs[i].c2)) {
+                component_gates[find_root(parent, tdefs[i].c2)]
+                    .push_back(tdefs[i].gate);
+            }
+        }
+    }
+    for (unsigned id : use.observed) {
+        observe(check(id));
+    }
+    while (not pending.empty()) {
+        const unsigned root = pending.back();
+
+        pending.pop_back();
+        for (unsigned gate : component_gates[root]) {
+            observe(gate);
+        }
+    }
+
+    vector<bool> used(desc.transistor_count, false);
+
+    for (unsigned i = 0; i < desc.transistor_count; ++i) {
+        const unsigned leg = is_rail(tdefs[i].c1) ? tdefs[i].c2 : tdefs[i].c1;
+
+        used[i] = might_be_on[i] and not is_rail(leg)
+                  and observed[find_root(parent, leg)];
+    }
+    return used;
+}
+
+/* The reverse Cuthill-McKee order of the nodes, in the graph where each
+ * transistor connects its gate, and its two legs. Nodes are visited in
+ * breadth first order, the neighbours of a node by increasing degree,
+ * thus nodes evaluated together end up with nearby ids. Power, and
+ * ground are left out of the graph - they are connected to almost
+ * everything. The nodes not connected to anything, and the rails are
+ * put at the end.
+ *
+ * Returns the id in the chip_description of each new id, starting with
+ * the unused id zero.
+ */
+template<typename id_type>
+static vector<unsigned>
+connectivity_order(const vector<construct_node>& nodes,
+                   const vector<const basic_transdef<id_type>*>& tdefs,
+                   unsigned power,
+                   unsigned ground)
+{
+    const unsigned count = unsigned(nodes.size());
+    vector<vector<unsigned>> adjacent(count);
+
+    auto connect = [&](unsigned a, unsigned b) {
+        if (a != b and a != power and a != ground
+                and b != power and b != ground)
+        {
+            adjacent[a].push_back(b);
+            adjacent[b].push_back(a);
+        }
+    };
+
+    for (const basic_transdef<id_type> *tdef : tdefs) {
+        connect(tdef->gate, tdef->c1);
+        connect(tdef->gate, tdef->c2);
+        connect(tdef->c1, tdef->c2);
+    }
+
+    auto by_degree = [&](unsigned a, unsigned b) {
+        if (adjacent[a].size() != adjacent[b].size()) {
+            return adjacent[a].size() < adjacent[b].size();
+        }
+        return a < b;
+    };
+
+    vector<unsigned> starts;
+
+    for (unsigned id = 1; id < count; ++id) {
+        vector<unsigned>& list = adjacent[id];
+
+        std::sort(list.begin(), list.end());
+        list.erase(std::unique(list.begin(), list.end()), list.end());
+        if (not list.empty()) {
+            starts.push_back(id);
+        }
+    }
+    for (unsigned id = 1; id < count; ++id) {
+        std::sort(adjacent[id].begin(), adjacent[id].end(), by_degree);
+    }
+    std::sort(starts.begin(), starts.end(), by_degree);
+
+    vector<unsigned> order;
+    vector<bool> placed(count, false);
+
+    order.reserve(count);
+    for (unsigned start : starts) {
+        if (placed[start]) continue;
+
+        size_t head = order.size();
+
+        placed[start] = true;
+        order.push_back(start);
+        while (head < order.size()) {
+            for (unsigned next : adjacent[order[head++]]) {
+                if (not placed[next]) {
+                    placed[next] = true;
+                    order.push_back(next);
+                }
+            }
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    for (unsigned id = 1; id < count; ++id) {
+        if (not placed[id] and id != power and id != ground) {
+            order.push_back(id);
+        }
+    }
+    order.push_back(power);
+    if (ground != power) {
+        order.push_back(ground);
+    }
+    order.insert(order.begin(), 0);
+    return order;
+}
+
+/* The checksum of the chip_description, and of the specialization
+ * the netlist is built for, if any - a specialized netlist is not loaded
+ * in place of the complete one.
+ */
+template<typename id_type>
+static uint32_t
+compute_description_checksum(const basic_chip_description<id_type>& desc,
+                             const specialization *use)
+{
+    fnv1a sum;
+
+    sum.add(uint32_t(desc.node_count));
+    sum.add(uint32_t(desc.transistor_count));
+    sum.add(desc.node_power);
+    sum.add(desc.node_ground);
+    for (unsigned i = 0; i < desc.node_count; ++i) {
+        sum.add(uint16_t(desc.pullups[i] ? 1 : 0));
+    }
+    for (unsigned i = 0; i < desc.transistor_count; ++i) {
+        sum.add(desc.transistors[i].gate);
+        sum.add(desc.transistors[i].c1);
+        sum.add(desc.transistors[i].c2);
+    }
+    if (use != nullptr) {
+        for (const vector<unsigned> *ids : {&use->held_low,
+                                            &use->inputs,
+                                            &use->observed})
+        {
+            sum.add(uint32_t(ids->size()));
+            for (unsigned id : *ids) {
+                sum.add(uint32_t(id));
+            }
+        }
+    }
+    return sum.value();
+}
+
+template<typename id_type>
+basic_netlist<id_type>::basic_netlist(const chip_description& desc,
+                                      node_order ordering)
+{
+    build(desc, nullptr, ordering);
+}
+
+template<typename id_type>
+basic_netlist<id_type>::basic_netlist(const chip_description& desc,
+                                      const specialization& use,
+                                      node_order ordering)
+{
+    build(desc, &use, ordering);
+}
+
+template<typename id_type>
+void
+basic_netlist<id_type>::build(const chip_description& desc,
+                              const specialization *use,
+                              node_order ordering)
+{
+    if (desc.node_count >= std::numeric_limits<id_type>::max()) {
+        throw std::out_of_range("node count");
+    }
+
+    vector<bool> used;
+
+    if (use != nullptr) {
+        used = specialized_transistors(desc, *use);
+    }
+
+    auto cnodes = create_construct_nodes(desc);
+    auto tdefs = setup_transistors(desc, cnodes,
+                                   use != nullptr ? &used : nullptr);
+    vector<id_type> packed_nodes;
+    vector<id_type> offsets;
+    vector<id_type> original(cnodes.size());
+    vector<id_type> renumbered(cnodes.size());
+    unsigned max_gate_count = 0;
+
+    if (ordering == node_order::connectivity) {
+        vector<unsigned> order = connectivity_order(cnodes, tdefs,
+                                                    desc.node_power,
+                                                    desc.node_ground);
+
+        std::copy(order.begin(), order.end(), original.begin());
+    }
+    else {
+        for (unsigned id = 0; id < cnodes.size(); ++id) {
+            original[id] = id_type(id);
+        }
+    }
+    for (unsigned id = 0; id < cnodes.size(); ++id) {
+        renumbered[original[id]] = id_type(id);
+    }
+
+    offsets.push_back(0);
+    for (id_type id = 1; id < cnodes.size(); ++id) {
+        const construct_node& cnode = cnodes[original[id]];
+
+        if (packed_nodes.size() >= std::numeric_limits<id_type>::max()) {
+            throw std::out_of_range("netlist size");
+        }
+        offsets.push_back(id_type(packed_nodes.size()));
+        max_gate_count = std::max(max_gate_count,
+                                  unsigned(cnode.gates.size()));
+        packed_nodes.push_back(id_type(cnode.gates.size()));
+        packed_nodes.push_back(id_type(cnode.sibling_connectors.size()));
+        for (unsigned index : cnode.gates) {
+            packed_nodes.push_back(id_type(index));
+            packed_nodes.push_back(renumbered[tdefs[index]->c1]);
+            packed_nodes.push_back(renumbered[tdefs[index]->c2]);
+        }
+        for (unsigned index : cnode.sibling_connectors) {
+            const basic_transdef<id_type> *tdef = tdefs[index];
+            const id_type c1 = renumbered[tdef->c1];
+            const id_type c2 = renumbered[tdef->c2];
+
+            packed_nodes.push_back(id_type(index));
+            packed_nodes.push_back(c1 == id ? c2 : c1);
+        }
+    }
+    if (packed_nodes.size() >= std::numeric_limits<id_type>::max()) {
+        throw std::out_of_range("netlist size");
+    }
+
+    /* assemble the image */
+    const size_t size = image_bytes(desc.node_count, packed_nodes.size(),
+                                    sizeof(id_type));
+    image_header header;
+
+    std::memcpy(header.magic, image_magic, sizeof(header.magic));
+    header.word_size = sizeof(id_type);
+    header.node_count = desc.node_count;
+    header.transistor_count = uint32_t(tdefs.size());
+    header.max_gate_count = max_gate_count;
+    header.packed_size = uint32_t(packed_nodes.size());
+    header.layout_checksum = 0;
+    header.description_checksum = compute_description_checksum(desc, use);
+    header.power = renumbered[desc.node_power];
+    header.ground = renumbered[desc.node_ground];
+
+    buffer.resize((size + sizeof(buffer[0]) - 1) / sizeof(buffer[0]));
+    unsigned char *data = reinterpret_cast<unsigned char*>(buffer.data());
+    std::memcpy(data, &header, sizeof(header));
+    data += sizeof(header);
+    std::memcpy(data, offsets.data(), offsets.size() * sizeof(id_type));
+    data += offsets.size() * sizeof(id_type);
+    std::memcpy(data, original.data(), original.size() * sizeof(id_type));
+    data += original.size() * sizeof(id_type);
+    std::memcpy(data, packed_nodes.data(),
+                packed_nodes.size() * sizeof(id_type));
+    data += packed_nodes.size() * sizeof(id_type);
+    for (id_type id : original) {
+        *data++ = cnodes[id].is_pullup ? 1 : 0;
+    }
+
+    attach(buffer.data(), size);
+    layout_checksum = compute_checksum();
+    reinterpret_cast<image_header*>(buffer.data())->layout_checksum =
+        layout_checksum;
+    derive_tables();
+}
+
+/* Set up the pointers into an image, returns false if the sizes in its
+ * header do not match the image - the contents are checked by load.
+ */
+template<typename id_type>
+bool
+basic_netlist<id_type>::attach(const void *data, size_t size)
+{
+    image_header header;
+
+    if (size < sizeof(header)) return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, image_magic, sizeof(header.magic)) != 0
+            or header.word_size != sizeof(id_type)
+            or header.node_count >= std::numeric_limits<id_type>::max()
+            or header.packed_size >= std::numeric_limits<id_type>::max()
+            or header.power > header.node_count
+            or header.ground > header.node_count
+            or size != image_bytes(header.node_count, header.packed_size,
+                                   sizeof(id_type)))
+    {
+        return false;
+    }
+
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+
+    image_size = size;
+    node_offsets = reinterpret_cast<const id_type*>(bytes + sizeof(header));
+    original_ids = node_offsets + header.node_count + 1;
+    nodes = original_ids + header.node_count + 1;
+    pullups = reinterpret_cast<const uint8_t*>(nodes + header.packed_size);
+    nodes_count = header.node_count;
+    transistors = header.transistor_count;
+    max_gates = header.max_gate_count;
+    packed = header.packed_size;
+    layout_checksum = header.layout_checksum;
+    description_checksum = header.description_checksum;
+    power = id_type(header.power);
+    ground = id_type(header.ground);
+    if (original_ids[0] != 0) return false;
+    internal_ids.assign(nodes_count + 1, 0);
+    for (unsigned id = 1; id <= nodes_count; ++id) {
+        const id_type original = original_ids[id];
+
+        if (original == 0 or original > nodes_count
+                or internal_ids[original] != 0)
+        {
+            return false;
+        }
+        internal_ids[original] = id_type(id);
+    }
+    return true;
+}
+
+/* Builds what is derived from an image, only called once the image is
+ * verified.
+ */
+template<typename id_type>
+void
+basic_netlist<id_type>::derive_tables()
+{
+    build_change_lists();
+    build_group_tables();
+}
+
+/* Every entry of the packed nodes is within the image, and every node id,
+ * and transistor index in those is valid - the nmos engine indexes its
+ * state with them, without checking. One pass over the packed nodes.
+ */
+template<typename id_type>
+bool
+basic_netlist<id_type>::check_ranges() const
+{
+    auto is_node = [this](id_type id) {
+        return id != 0 and id <= nodes_count;
+    };
+
+    if (power == 0 or ground == 0) return false;
+    for (unsigned id = 1; id <= nodes_count; ++id) {
+        const size_t offset = node_offsets[id];
+
+        if (offset + header_size > packed) return false;
+
+        const id_type *entry = nodes + offset;
+        const size_t size = header_size
+                            + gate_entry_size * size_t(gate_count(entry))
+                            + sibling_entry_size * size_t(sibling_count(entry));
+
+        if (offset + size > packed or gate_count(entry) > max_gates) {
+            return false;
+        }
+
+        const id_type *gate = gates(entry);
+
+        for (id_type i = 0; i < gate_count(entry); ++i) {
+            if (gate[0] >= transistors
+                    or not is_node(gate[1]) or not is_node(gate[2]))
+            {
+                return false;
+            }
+            gate += gate_entry_size;
+        }
+
+        const id_type *sibs = siblings(entry);
+
+        for (id_type i = 0; i < sibling_count(entry); ++i) {
+            if (sibs[0] >= transistors or not is_node(sibs[1])) {
+                return false;
+            }
+            sibs += sibling_entry_size;
+        }
+    }
+    return true;
+}
+
+/* The entries of each node are sorted by the node ids of the
+ * chip_description, the order the nodes are queued in by the nmos engine,
+ * whichever node_order the netlist was built with.
+ */
+template<typename id_type>
+void
+basic_netlist<id_type>::build_change_lists()
+{
+    change_offsets.assign(nodes_count + 2, 0);
+    change_entries.clear();
+    for (unsigned id = 1; id <= nodes_count; ++id) {
+        const id_type *entry = node(id_type(id));
+        const id_type *gate = gates(entry);
+        const size_t first = change_entries.size();
+
+        for (id_type i = 0; i < gate_count(entry); ++i) {
+            const id_type c1 = gate[1];
+            const id_type c2 = gate[2];
+            const bool c1_is_rail = (c1 == power or c1 == ground);
+
+            change_entries.push_back({c1, c2, not c1_is_rail});
+            change_entries.push_back({c2, c1, c1_is_rail});
+            gate += gate_entry_size;
+        }
+        std::stable_sort(change_entries.begin() + first, change_entries.end(),
+                         [this](const change_entry& a, const change_entry& b) {
+                             return original_ids[a.node]
+                                    < original_ids[b.node];
+                         });
+        change_offsets[id + 1] = uint32_t(change_entries.size());
+    }
+    change_offsets[0] = change_offsets[1];
+}
+
+namespace
+{
+
+/* The search of basic_nmos::group_add, in a single component, with the
+ * state of its transistors given by the bits of state.
+ */
+template<typename id_type>
+struct group_search
+{
+    typedef basic_netlist<id_type> netlist;
+
+    const netlist& topology;
+    const vector<int>& transistor_bits;
+    const unsigned state;
+    vector<bool>& visited;
+    vector<id_type> members;
+    bool power;
+    bool ground;
+
+    group_search(const netlist& topology,
+                 const vector<int>& transistor_bits,
+                 unsigned state,
+                 vector<bool>& visited):
+        topology(topology),
+        transistor_bits(transistor_bits),
+        state(state),
+        visited(visited),
+        power(false),
+        ground(false)
+    {}
+
+    void add(id_type id)
+    {
+        const id_type *node = topology.node(id);
+        const id_type *sibs = netlist::siblings(node);
+
+        visited[id] = true;
+        members.push_back(id);
+        for (id_type i = 0; i < netlist::sibling_count(node); ++i, sibs += 2) {
+            const int bit = transistor_bits[sibs[0]];
+
+            if (bit < 0 or ((state >> bit) & 1) == 0) continue;
+            if (sibs[1] == topology.ground) {
+                ground = true;
+            }
+            else if (sibs[1] == topology.power) {
+                power = true;
+            }
+            else if (not visited[sibs[1]]) {
+                add(sibs[1]);
+            }
+        }
+    }
+};
+
+}
+
+/* Components are found with union-find over the transistors connecting
+ * two nodes, then the groups of the small ones are computed with
+ * group_search. Identical member lists are only stored once.
+ */
+template<typename id_type>
+void
+basic_netlist<id_type>::build_group_tables()
+{
+    vector<std::pair<id_type, id_type>> legs(transistors);
+    vector<unsigned> parent(nodes_count + 1);
+    auto is_rail = [this](id_type id) {
+        return id == power or id == ground;
+    };
+
+    for (unsigned id = 1; id <= nodes_count; ++id) {
+        const id_type *entry = node(id_type(id));
+        const id_type *gate = gates(entry);
+
+        for (id_type i = 0; i < gate_count(entry); ++i) {
+            legs[gate[0]] = {gate[1], gate[2]};
+            gate += gate_entry_size;
+        }
+    }
+    for (unsigned id = 0; id <= nodes_count; ++id) {
+        parent[id] = id;
+    }
+    for (const std::pair<id_type, id_type>& leg : legs) {
+        if (not is_rail(leg.first) and not is_rail(leg.second)) {
+            parent[find_root(parent, leg.first)] =
+                find_root(parent, leg.second);
+        }
+    }
+
+    /* the nodes, and transistors of each component, in id order */
+    vector<vector<id_type>> component_nodes(nodes_count + 1);
+    vector<vector<id_type>> transistor_lists(nodes_count + 1);
+
+    for (unsigned id = 1; id <= nodes_count; ++id) {
+        if (not is_rail(id_type(id))) {
+            component_nodes[find_root(parent, id)].push_back(id_type(id));
+        }
+    }
+    for (unsigned t = 0; t < transistors; ++t) {
+        const id_type c1 = legs[t].first;
+        const id_type c2 = legs[t].second;
+
+        if (c1 == c2 or (is_rail(c1) and is_rail(c2))) continue;
+
+        const unsigned root = find_root(parent, is_rail(c1) ? c2 : c1);
+
+        transistor_lists[root].push_back(id_type(t));
+    }
+
+    group_tables.assign(nodes_count + 1, {0, no_table, 0});
+    table_transistor_list.clear();
+    group_entries.clear();
+    member_list.clear();
+
+    vector<int> transistor_bits(transistors, -1);
+    vector<bool> visited(nodes_count + 1, false);
+    std::map<vector<id_type>, uint32_t> known_members;
+
+    for (unsigned root = 1; root <= nodes_count; ++root) {
+        const vector<id_type>& list = transistor_lists[root];
+
+        if (component_nodes[root].size() < 2
+                or list.size() > max_table_transistors)
+        {
+            continue;
+        }
+
+        const uint32_t first = uint32_t(table_transistor_list.size());
+
+        for (size_t bit = 0; bit < list.size(); ++bit) {
+            transistor_bits[list[bit]] = int(bit);
+            table_transistor_list.push_back(list[bit]);
+        }
+        for (id_type id : component_nodes[root]) {
+            group_tables[id] = {first,
+                                uint32_t(list.size()),
+                                uint32_t(group_entries.size())};
+            for (unsigned state = 0; state < (1u << list.size()); ++state) {
+                group_search<id_type> search(*this, transistor_bits,
+                                             state, visited);
+                uint32_t members;
+
+                search.add(id);
+                for (id_type member : search.members) {
+                    visited[member] = false;
+                }
+                if (search.members.size() == 1) {
+                    members = search.members[0];
+                }
+                else {
+                    auto known = known_members.insert(
+                        {search.members, uint32_t(member_list.size())});
+
+                    if (known.second) {
+                        member_list.insert(member_list.end(),
+                                           search.members.begin(),
+                                           search.members.end());
+                    }
+                    members = known.first->second;
+                }
+                group_entries.push_back({members,
+                                         uint16_t(search.members.size()),
+                                         search.power,
+                                         search.ground});
+            }
+        }
+        for (id_type t : list) {
+            transistor_bits[t] = -1;
+        }
+    }
+}
+
+template<typename id_type>
+const void*
+basic_netlist<id_type>::image() const
+{
+    return node_offsets == nullptr ? nullptr
+        : reinterpret_cast<const unsigned char*>(node_offsets)
+            - sizeof(image_header);
+}
+
+/* FNV-1a hash of the node layout */
+template<typename id_type>
+uint32_t
+basic_netlist<id_type>::compute_checksum() const
+{
+    fnv1a sum;
+
+    for (unsigned id = 0; id <= nodes_count; ++id) {
+        sum.add(node_offsets[id]);
+        sum.add(original_ids[id]);
+    }
+    for (size_t i = 0; i < packed; ++i) {
+        sum.add(nodes[i]);
+    }
+    return sum.value();
+}
+
+template<typename id_type>
+void
+basic_netlist<id_type>::save(const char *path) const
+{
+    FILE *file = fopen(path, "wb");
+
+    if (file == nullptr) {
+        throw std::runtime_error("unable to write netlist");
+    }
+
+    bool success = fwrite(image(), 1, image_size, file) == image_size;
+
+    if (fclose(file) != 0 or not success) {
+        throw std::runtime_error("unable to write netlist");
+    }
+}
+
+#ifdef CHIPEMU_HAVE_MMAP
+
+static std::shared_ptr<const void>
+map_file(const char *path, size_t& size)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+
+    if (fd < 0) return nullptr;
+    if (fstat(fd, &info) != 0 or info.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+    size = size_t(info.st_size);
+
+    void *address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+
+    close(fd);
+    if (address == MAP_FAILED) return nullptr;
+    return std::shared_ptr<const void>(address,
+            [size](const void *pointer) {
+                munmap(const_cast<void*>(pointer), size);
+            });
+}
+
+#endif
+
+template<typename id_type>
+std::shared_ptr<const basic_netlist<id_type>>
+basic_netlist<id_type>::load(const char *path, const chip_description& desc)
+{
+    std::shared_ptr<basic_netlist> result(new basic_netlist);
+
+#ifdef CHIPEMU_HAVE_MMAP
+    size_t size = 0;
+
+    result->mapping = map_file(path, size);
+    if (not result->mapping
+            or not result->attach(result->mapping.get(), size))
+    {
+        return nullptr;
+    }
+#else
+    FILE *file = fopen(path, "rb");
+
+    if (file == nullptr) return nullptr;
+
+    vector<unsigned char> data;
+    unsigned char chunk[4096];
+    size_t count;
+
+    while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + count);
+    }
+    fclose(file);
+    result->buffer.resize((data.size() + sizeof(result->buffer[0]) - 1)
+                          / sizeof(result->buffer[0]));
+    std::memcpy(result->buffer.data(), data.data(), data.size());
+    if (not result->attach(result->buffer.data(), data.size())) {
+        return nullptr;
+    }
+#endif
+
+    if (result->description_checksum
+            != compute_description_checksum(desc, nullptr)
+            or result->nodes_count != desc.node_count
+            or result->transistors > desc.transistor_count
+            or result->external_id(result->power) != desc.node_power
+            or result->external_id(result->ground) != desc.node_ground
+            or result->layout_checksum != result->compute_checksum()
+            or not result->check_ranges())
+    {
+        return nullptr;
+    }
+    result->derive_tables();
+    return result;
+}
+
+namespace
+{
+
+template<typename id_type>
+struct cache
+{
+    struct entry
+    {
+        std::weak_ptr<const basic_netlist<id_type>> shared;
+        std::shared_ptr<const basic_netlist<id_type>> installed;
+    };
+
+    /* the address of the chip_description, and the ids listed in the
+     * specialization, each list terminated by a zero
+     */
+    typedef std::pair<const basic_chip_description<id_type>*,
+                      vector<unsigned>> specialized_key;
+
+    static std::mutex mutex;
+    static std::map<const basic_chip_description<id_type>*, entry> entries;
+    static std::map<specialized_key,
+                    std::weak_ptr<const basic_netlist<id_type>>> specialized;
+};
+
+template<typename id_type>
+std::mutex cache<id_type>::mutex;
+
+template<typename id_type>
+std::map<const basic_chip_description<id_type>*,
+         typename cache<id_type>::entry> cache<id_type>::entries;
+
+template<typename id_type>
+std::map<typename cache<id_type>::specialized_key,
+         std::weak_ptr<const basic_netlist<id_type>>>
+    cache<id_type>::specialized;
+
+}
+
+/* The netlists already built, and still used by some chip,
+ * indexed by the address of their chip_description.
+ */
+template<typename id_type>
+std::shared_ptr<const basic_netlist<id_type>>
+basic_netlist<id_type>::get(const chip_description& desc)
+{
+    std::lock_guard<std::mutex> lock(cache<id_type>::mutex);
+    auto& entry = cache<id_type>::entries[&desc];
+    std::shared_ptr<const basic_netlist> result = entry.shared.lock();
+
+    if (not result) {
+        result = std::make_shared<const basic_netlist>(desc);
+        entry.shared = result;
+    }
+    return result;
+}
+
+template<typename id_type>
+std::shared_ptr<const basic_netlist<id_type>>
+basic_netlist<id_type>::get(const chip_description& desc,
+                            const specialization& use)
+{
+    typename cache<id_type>::specialized_key key;
+
+    key.first = &desc;
+    for (const vector<unsigned> *ids : {&use.held_low,
+                                        &use.inputs,
+                                        &use.observed})
+    {
+        vector<unsigned> sorted(*ids);
+
+        std::sort(sorted.begin(), sorted.end());
+        key.second.insert(key.second.end(), sorted.begin(), sorted.end());
+        key.second.push_back(0);
+    }
+
+    std::lock_guard<std::mutex> lock(cache<id_type>::mutex);
+    auto& entry = cache<id_type>::specialized[key];
+    std::shared_ptr<const basic_netlist> result = entry.lock();
+
+    if (not result) {
+        result = std::make_shared<const basic_netlist>(desc, use);
+        entry = result;
+    }
+    return result;
+}
+
+template<typename id_type>
+void
+basic_netlist<id_type>::install(const chip_description& desc,
+                                std::shared_ptr<const basic_netlist> topology)
+{
+    std::lock_guard<std::mutex> lock(cache<id_type>::mutex);
+    auto& entry = cache<id_type>::entries[&desc];
+
+    entry.shared = topology;
+    entry.installed = topology;
+}
+
+template class basic_netlist<uint16_t>;
+template class basic_netlist<uint32_t>;
+
+}
+}
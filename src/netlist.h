@@ -0,0 +1,381 @@
+
+#ifndef CHIPEMU_NETLIST_H
+#define CHIPEMU_NETLIST_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace chipemu
+{
+namespace implementation
+{
+
+/* Node ids, offsets and transistor indices are all stored in id_type,
+ * which is uint16_t for the compact layout used by the 6500 family,
+ * and uint32_t for netlists with more than 65534 nodes, or transistors.
+ * See the typedefs after the templates.
+ */
+
+template<typename id_type>
+struct basic_transdef
+{
+    const id_type gate;
+    const id_type c1;
+    const id_type c2;
+
+    basic_transdef(id_type a, id_type b, id_type c):
+        gate(a),
+        c1(b),
+        c2(c)
+    { }
+};
+
+template<typename id_type>
+struct basic_chip_description
+{
+    const unsigned node_count;
+    const bool *pullups;
+    const unsigned transistor_count;
+    const basic_transdef<id_type> *transistors;
+    const id_type node_power;
+    const id_type node_ground;
+};
+
+/* The order of the nodes in a netlist
+ *
+ *   description   - the ids of the chip_description are kept
+ *   connectivity  - the nodes are renumbered, nodes connected via a
+ *                   transistor get nearby ids, see netlist.cc
+ */
+enum class node_order
+{
+    description,
+    connectivity
+};
+
+/* The use of a chip a netlist can be specialized for, node ids are those
+ * of the chip_description.
+ *
+ *   held_low - nodes set low before the first recalc, and never set
+ *              high afterwards
+ *   inputs   - every other node set from outside of the chip, via set_node
+ *   observed - the nodes read from outside of the chip
+ *
+ * The netlist built for such a use leaves out the transistors which can
+ * never be switched on, and the transistors none of the observed nodes
+ * depend on, see specialized_transistors in netlist.cc. The values of
+ * the observed nodes are exactly the same as with the complete netlist,
+ * the values of the other nodes are undefined.
+ */
+struct specialization
+{
+    std::vector<unsigned> held_low;
+    std::vector<unsigned> inputs;
+    std::vector<unsigned> observed;
+};
+
+/* The topology of a chip, built from a chip_description
+ *
+ * A netlist is immutable once it is built, and the same instance is
+ * shared by every chip built from the same chip_description,
+ * see netlist::get. The state of the nodes and transistors is not stored
+ * here, but in the chip instances - see nmos.
+ *
+ * Transistors are indexed 0 .. transistor_count() - 1, in the order
+ * they appear in the chip_description, duplicates, and transistors gated
+ * by power, or ground removed - see setup_transistors in netlist.cc
+ * A netlist can also be built for a specific use of the chip, with fewer
+ * transistors, see specialization.
+ *
+ * The nodes are identified by the ids of the chip_description outside
+ * of the netlist, but inside - in the packed nodes, in power, ground,
+ * and in the state of a chip indexed by node id - those might be
+ * renumbered, see node_order. Use internal_id, and external_id to
+ * convert between the two.
+ *
+ * nodes + node_offsets[id] yields the starting address of
+ *  the node with the specific id, in an id_type pointer
+ *
+ *  the internal structure of node at   const id_type *node  :
+ *  node[0] == number of transistor gates this node controls
+ *  node[1] == number of sibling nodes this node is connected to,
+ *             via gates controlled by other nodes
+ *
+ *  starting at node[2] are node[0] gate entries, three id_type values
+ *   each: the index of the transistor, and the ids of the two nodes
+ *   connected to its legs
+ *
+ *  following those are node[1] sibling entries, two id_type values each:
+ *   the index of a transistor connecting this node to a sibling, and
+ *   the id of the sibling
+ *
+ * All of this is stored in one contiguous image, which can be written
+ * to a file with save, and loaded - mapped into memory when possible -
+ * with load, see netlist.cc about the format of the image.
+ *
+ * The nodes to queue after a node toggled, the legs of all transistors
+ * gated by the node, are also listed in the node id order of the
+ * chip_description, see change_entry.
+ *
+ * The groups of the nodes in small channel-connected components are
+ * precomputed for every state of the transistors, see group_entry.
+ *
+ * Those lists, and tables are not part of the image, they are derived
+ * from it each time an image is loaded, in linear time - keeping them
+ * out of the image leaves its format independent of the engine.
+ */
+template<typename id_type>
+class basic_netlist
+{
+public:
+
+    /* One leg of a transistor gated by a node. When the node turns the
+     * transistor off, every leg is queued. When the node turns it on,
+     * only one leg is queued - the first one unless that is power, or
+     * ground, marked as on_high - and only if the two legs differ.
+     */
+    struct change_entry
+    {
+        id_type node;
+        id_type other_leg;
+        bool on_high;
+    };
+
+    /* The nodes connected via the legs of transistors - power, and
+     * ground not counted - form channel-connected components. A group
+     * never spans more than one component. If a component of more than
+     * one node has at most max_table_transistors transistors with a leg
+     * in it, the group of each of its nodes is listed for every state of
+     * those transistors: the nodes of the group in the order group_add
+     * visits them, and whether the group contains power, or ground.
+     *
+     * members is the offset of the list of nodes, or the id of the
+     * only node, when member_count is one.
+     */
+    struct group_entry
+    {
+        uint32_t members;
+        uint16_t member_count;
+        bool power;
+        bool ground;
+    };
+
+    /* The groups of a node, 1 << transistor_count entries at groups */
+    struct group_table
+    {
+        uint32_t transistors;
+        uint32_t transistor_count;
+        uint32_t groups;
+    };
+
+    static constexpr unsigned max_table_transistors = 4;
+
+    static constexpr unsigned header_size = 2;
+    static constexpr unsigned gate_entry_size = 3;
+    static constexpr unsigned sibling_entry_size = 2;
+
+    typedef basic_chip_description<id_type> chip_description;
+
+    explicit basic_netlist(const chip_description&,
+                           node_order = node_order::description);
+
+    basic_netlist(const chip_description&,
+                  const specialization&,
+                  node_order = node_order::description);
+
+    basic_netlist(const basic_netlist&) = delete;
+    basic_netlist& operator=(const basic_netlist&) = delete;
+
+    static std::shared_ptr<const basic_netlist> get(const chip_description&);
+
+    /* The netlists specialized for the same use are shared as well */
+    static std::shared_ptr<const basic_netlist> get(const chip_description&,
+                                                    const specialization&);
+
+    /* Make get return the specified netlist for the chip_description,
+     * as long as the process runs.
+     */
+    static void install(const chip_description&,
+                        std::shared_ptr<const basic_netlist>);
+
+    /* Returns nullptr if the file can not be read, or if it was not
+     * saved from a netlist built from the same chip_description.
+     */
+    static std::shared_ptr<const basic_netlist> load(const char *path,
+                                                     const chip_description&);
+
+    /* throws std::runtime_error on failure */
+    void save(const char *path) const;
+
+    unsigned node_count() const
+    {
+        return nodes_count;
+    }
+
+    unsigned transistor_count() const
+    {
+        return transistors;
+    }
+
+    unsigned max_gate_count() const
+    {
+        return max_gates;
+    }
+
+    /* id is a node id of the chip_description, 1 .. node_count() */
+    id_type internal_id(unsigned id) const
+    {
+        return internal_ids[id];
+    }
+
+    id_type external_id(id_type id) const
+    {
+        return original_ids[id];
+    }
+
+    bool is_pullup(id_type id) const
+    {
+        return pullups[id] != 0;
+    }
+
+    const id_type *node(id_type id) const
+    {
+        return nodes + node_offsets[id];
+    }
+
+    static id_type gate_count(const id_type *node)
+    {
+        return node[0];
+    }
+
+    static id_type sibling_count(const id_type *node)
+    {
+        return node[1];
+    }
+
+    static const id_type *gates(const id_type *node)
+    {
+        return node + header_size;
+    }
+
+    static const id_type *siblings(const id_type *node)
+    {
+        return node + header_size + gate_entry_size * gate_count(node);
+    }
+
+    const change_entry *changes_begin(id_type id) const
+    {
+        return change_entries.data() + change_offsets[id];
+    }
+
+    const change_entry *changes_end(id_type id) const
+    {
+        return change_entries.data() + change_offsets[id + 1];
+    }
+
+    /* nullptr if the node is not in a small component */
+    const group_table *groups(id_type id) const
+    {
+        const group_table *table = group_tables.data() + id;
+
+        return table->transistor_count == no_table ? nullptr : table;
+    }
+
+    /* the indices of the transistors with a leg in the component */
+    const id_type *table_transistors(const group_table& table) const
+    {
+        return table_transistor_list.data() + table.transistors;
+    }
+
+    /* bit N of state is the state of the transistor number N of
+     * the component, see table_transistors
+     */
+    const group_entry& group(const group_table& table, unsigned state) const
+    {
+        return group_entries[table.groups + state];
+    }
+
+    id_type group_member(const group_entry& entry, unsigned index) const
+    {
+        if (entry.member_count == 1) {
+            return id_type(entry.members);
+        }
+        return member_list[entry.members + index];
+    }
+
+    size_t packed_size() const
+    {
+        return packed;
+    }
+
+    uint32_t checksum() const
+    {
+        return layout_checksum;
+    }
+
+    id_type power;
+    id_type ground;
+
+private:
+
+    /* The image is either owned by the netlist, or mapped from a file */
+    std::vector<uint32_t> buffer;
+    std::shared_ptr<const void> mapping;
+    size_t image_size;
+
+    const id_type *node_offsets;
+    const id_type *original_ids;
+    const id_type *nodes;
+    const uint8_t *pullups;
+    unsigned nodes_count;
+    unsigned transistors;
+    unsigned max_gates;
+    size_t packed;
+    uint32_t layout_checksum;
+    uint32_t description_checksum;
+
+    std::vector<id_type> internal_ids;
+    std::vector<uint32_t> change_offsets;
+    std::vector<change_entry> change_entries;
+
+    /* indexed by node id, the transistor_count of the nodes not in
+     * a small component is no_table
+     */
+    static constexpr uint32_t no_table = ~uint32_t(0);
+    std::vector<group_table> group_tables;
+    std::vector<id_type> table_transistor_list;
+    std::vector<group_entry> group_entries;
+    std::vector<id_type> member_list;
+
+    basic_netlist():
+        image_size(0),
+        node_offsets(nullptr),
+        original_ids(nullptr),
+        nodes(nullptr),
+        pullups(nullptr)
+    {}
+
+    void build(const chip_description&, const specialization*, node_order);
+    const void *image() const;
+    bool attach(const void *image, size_t size);
+    bool check_ranges() const;
+    void derive_tables();
+    void build_change_lists();
+    void build_group_tables();
+    uint32_t compute_checksum() const;
+};
+
+typedef basic_transdef<uint16_t> transdef;
+typedef basic_chip_description<uint16_t> chip_description;
+typedef basic_netlist<uint16_t> netlist;
+
+typedef basic_transdef<uint32_t> wide_transdef;
+typedef basic_chip_description<uint32_t> wide_chip_description;
+typedef basic_netlist<uint32_t> wide_netlist;
+
+}
+}
+
+#endif
@@ -4,187 +4,76 @@
 #include <stdexcept>
 #include <functional>
 #include <memory>
-#include <tuple>
 #include <limits>
-#include <set>
+#include <utility>
 
 #include <cinttypes>
 
-#include "nmos.h"
+#include "nmos_primitives.h"
+#include "snapshot.h"
 
 using std::vector;
-using std::pair;
-using std::make_pair;
-using std::tie;
 
 namespace chipemu
 {
 namespace implementation
 {
-namespace
-{
 
-/* Internal node representation
- *
- * nmos::nodes         stores the nodes
- * nmos::node_offsets  stores the offset of each node in nmos::nodes
- *
- * nodes.data() + nodes_offsets[id] yields the starting address of
- *  the node with the specific id, in a uint16_t pointer
+/* The current queue of changed nodes
  *
- *  the internal structure of node at   uint16_t *node  :
- *  node[0] == flags
- *  node[1] == number of transistor gates this node controls
- *  node[2] == number of sibling nodes this node is connected to,
- *             via gates controlled by other nodes
- *
- *  starting at node[3] up to node[3 + node[1]*2 - 1] are the
- *   transistors controlled by the node described
- *   each transistor consists of two uint16_t values, which containt
- *   *) a flag in the least significant bit, representing the current
- *      state of the transistor ( 1 - on, 0 - off )
- *   *) the id of a node connected to a leg of the transistor,
- *      left shifted by one ( to leave the LSB free for the flag )
- *
- *  starting at node[3 + node[1]*2]
- *   up to node[2 + node[1]*2 + node[2] - 1] are offsets of
- *   transistor legs connecting this node to other nodes
+ * A node is never in the queue twice while its node_in_changelist flag
+ * is set, but group_add clears that flag on nodes which might still be
+ * waiting in the queue - thus the queue grows on demand.
  */
-
-enum node_flags : uint16_t {
-    node_is_pullup       = 0b00001,
-    node_is_pulldown     = 0b00010,
-    node_is_high         = 0b00100,
-    node_in_changelist   = 0b01000,
-    node_in_group        = 0b10000,
-};
-
-static constexpr uint16_t header_size = 3;
-
-static uint16_t
-node_gate_count(uint16_t *node)
-{
-    return node[1];
-}
-
-static uint16_t
-node_sibling_count(uint16_t *node)
-{
-    return node[2];
-}
-
-static uint16_t*
-node_gates(uint16_t *node)
-{
-    return node + header_size;
-}
-
-static uint16_t*
-node_sibling_connectors(uint16_t *node)
-{
-    return node + header_size + (2 * node_gate_count(node));
-}
-
-static uint16_t
-lookup_leg(uint16_t *nodes, uint16_t id,
-           uint16_t gate_node_off, const struct transdef *tdef)
-{
-    uint16_t count = node_gate_count(nodes + gate_node_off);
-    uint16_t *leg = node_gates(nodes + gate_node_off);
-    for (uint16_t i = 0; i < count; ++i, leg += 2) {
-        if (leg[0] >> 1 == tdef->c1 and leg[1] >> 1 == tdef->c2) {
-            if (leg[0] >> 1 == id) {
-                return leg + 1 - nodes;
-            }
-            else {
-                return leg -  nodes;
-            }
-        }
-    }
-    throw std::logic_error("building nodes");
-}
-
-
-/* utility type, used while constructing the
- * internal nodes
- */
-struct construct_node
-{
-    bool is_pullup;
-    vector<transdef> gates;
-    vector<const transdef*> sibling_connectors;
-
-    construct_node(bool is_pullup): is_pullup(is_pullup) {}
-};
-
-} // anonym namespace
-
-inline bool
-transdef::operator==(const transdef& other) const
-{
-    return (gate == other.gate) &&
-        ((c1 == other.c1 && c2 == other.c2)
-         || (c1 == other.c2 && c2 == other.c1));
-}
-
-static vector<construct_node>
-create_construct_nodes(const chip_description& desc)
+template<typename id_type>
+void
+basic_nmos<id_type>::changed_queue_init()
 {
-    vector<construct_node> nodes;
+    size_t size = 1;
 
-    nodes.emplace_back(false);
-    for (unsigned index = 0; index < desc.node_count; ++index) {
-        nodes.emplace_back(desc.pullups[index]);
+    while (size <= node_count()) {
+        size *= 2;
     }
-
-    return nodes;
+    changed_queue.resize(size);
+    changed_eating = changed_feeding = 0;
 }
 
-
-/* The current queue of changed nodes */
+template<typename id_type>
 void
-nmos::changed_queue_init()
+basic_nmos<id_type>::changed_queue_grow()
 {
-    changed_queue.resize(node_count() * 32);
-    changed_eating = changed_feeding = changed_queue.begin();
+    vector<id_type> queue(changed_queue.size() * 2);
+
+    auto tail = std::copy(changed_queue.begin() + changed_eating,
+                          changed_queue.end(), queue.begin());
+    std::copy(changed_queue.begin(),
+              changed_queue.begin() + changed_eating, tail);
+    changed_eating = 0;
+    changed_feeding = changed_queue.size();
+    changed_queue.swap(queue);
 }
 
-inline uint16_t
-nmos::changed_pop()
+template<typename id_type>
+inline id_type
+basic_nmos<id_type>::changed_pop()
 {
     assert(changed_eating != changed_feeding);
 
-    uint16_t id = *changed_eating;
-    ++changed_eating;
-    if (changed_eating == changed_queue.end()) {
-        changed_eating = changed_queue.begin();
-    }
+    id_type id = changed_queue[changed_eating];
+    changed_eating = (changed_eating + 1) & (changed_queue.size() - 1);
     return id;
 }
 
-inline void
-nmos::changed_push(uint16_t id)
-{
-    uint16_t *node = node_addr(id);
-
-    if (*node & node_in_changelist) return;
-
-    *changed_feeding = id;
-    ++changed_feeding;
-    if (changed_feeding == changed_queue.end()) {
-        changed_feeding = changed_queue.begin();
-    }
-    *(node_addr(id)) |= node_in_changelist;
-}
-
+template<typename id_type>
 inline bool
-nmos::changed_is_empty() const
+basic_nmos<id_type>::changed_is_empty() const
 {
     return changed_eating == changed_feeding;
 }
 
+template<typename id_type>
 inline void
-nmos::changed_clear()
+basic_nmos<id_type>::changed_clear()
 {
     changed_feeding = changed_eating;
 }
@@ -192,34 +81,10 @@ nmos::changed_clear()
 
 
 /* The currently inspected group of nodes */
+template<typename id_type>
 inline void
-nmos::group_update_value(uint16_t flags)
-{
-    switch (group_current_value) {
-        case group_contains::nothing:
-            if (flags & node_is_high) {
-                group_current_value = group_contains::high;
-            }
-        case group_contains::pullup:
-            if (flags & node_is_pullup) {
-                group_current_value = group_contains::pullup;
-            }
-        case group_contains::pulldown:
-            if (flags & node_is_pulldown) {
-                group_current_value = group_contains::pulldown;
-            }
-        case group_contains::power:
-        case group_contains::ground:
-        case group_contains::high:
-            break;
-    }
-}
-
-inline void
-nmos::group_add(uint16_t id)
+basic_nmos<id_type>::group_add(id_type id)
 {
-    uint16_t *node = node_addr(id);
-
     if (id == ground) {
         group_current_value = group_contains::ground;
     }
@@ -228,41 +93,94 @@ nmos::group_add(uint16_t id)
             group_current_value = group_contains::power;
         }
     }
-    else if (not (node[0] & node_in_group)) {
-        node[0] |= node_in_group;
-        node[0] &= ~node_in_changelist;
-        *(group_tail++) = id;
-        group_update_value(*node);
-        uint16_t sibling_count = node_sibling_count(node);
-        uint16_t *sibs = node_sibling_connectors(node);
-        for (uint16_t i = 0; i < sibling_count; ++i) {
-            uint16_t leg = nodes[sibs[i]];
-            if (leg & 1) {
-                group_add(leg >> 1);
+    else if (not (flags[id] & node_in_group)) {
+        const id_type *node = topology->node(id);
+
+        flags[id] |= node_in_group;
+        flags[id] &= ~node_in_changelist;
+        current_group[group_tail++] = id;
+        group_update_value(flags[id]);
+        id_type sibling_count = netlist::sibling_count(node);
+        const id_type *sibs = netlist::siblings(node);
+        for (id_type i = 0; i < sibling_count; ++i, sibs += 2) {
+            if (transistor_on[sibs[0]]) {
+                group_add(sibs[1]);
             }
         }
     }
 }
 
 
+template<typename id_type>
 inline void
-nmos::group_init()
+basic_nmos<id_type>::group_init()
 {
-    current_group.resize(node_count() * 32);   // how many should it be ??
+    current_group.resize(node_count());
 }
 
+template<typename id_type>
+template<bool use_compiled>
 inline void
-nmos::group_setup(uint16_t id)
+basic_nmos<id_type>::group_setup(id_type id)
 {
-    group_tail = current_group.begin();
+    group_tail = 0;
     group_current_value = group_contains::nothing;
-    group_add(id);
+    if (use_compiled) {
+        compiled->group_add[id](*this);
+    }
+    else if (const group_table *table = topology->groups(id)) {
+        group_lookup(*table);
+    }
+    else {
+        group_add(id);
+    }
+}
+
+/* The same group as group_add(id) would collect, in the same order,
+ * taken from the tables of the netlist, see basic_netlist::group_entry
+ * A rail in the group decides its value, regardless of the order
+ * group_add would have found it in.
+ */
+template<typename id_type>
+inline void
+basic_nmos<id_type>::group_lookup(const group_table& table)
+{
+    const id_type *transistors = topology->table_transistors(table);
+    unsigned state = 0;
+
+    for (unsigned i = 0; i < table.transistor_count; ++i) {
+        state |= unsigned(transistor_on[transistors[i]]) << i;
+    }
+
+    const group_entry& group = topology->group(table, state);
+
+    if (group.ground) {
+        group_current_value = group_contains::ground;
+    }
+    else if (group.power) {
+        group_current_value = group_contains::power;
+    }
+    for (unsigned i = 0; i < group.member_count; ++i) {
+        const id_type member = topology->group_member(group, i);
+
+        flags[member] &= ~node_in_changelist;
+        current_group[group_tail++] = member;
+        group_update_value(flags[member]);
+    }
 }
 
+template<typename id_type>
 inline bool
-nmos::group_get_value() const
+basic_nmos<id_type>::group_get_value() const
 {
-    switch (group_current_value) {
+    return is_high(group_current_value);
+}
+
+template<typename id_type>
+inline bool
+basic_nmos<id_type>::is_high(group_contains value)
+{
+    switch (value) {
         case group_contains::power:
         case group_contains::pullup:
         case group_contains::high:
@@ -275,129 +193,61 @@ nmos::group_get_value() const
     __builtin_unreachable();
 }
 
+template<typename id_type>
 inline bool
-nmos::is_group_empty() const
+basic_nmos<id_type>::is_group_empty() const
 {
-    return group_tail == current_group.cbegin();
+    return group_tail == 0;
 }
 
-inline uint16_t
-nmos::group_pop()
+template<typename id_type>
+inline id_type
+basic_nmos<id_type>::group_pop()
 {
-    uint16_t id = *--group_tail;
+    id_type id = current_group[--group_tail];
 
-    nodes[node_offsets[id]] &= ~node_in_group;
+    flags[id] &= ~node_in_group;
     return id;
 }
 
-static void
-setup_transistors(const chip_description& desc,
-				  vector<construct_node>& nodes)
-{
-    const transdef *tdef = desc.transistors;
-
-    for (;tdef != desc.transistors + desc.transistor_count; ++tdef) {
-        if (tdef->gate >= nodes.size()
-                or tdef->c1 >= nodes.size()
-                or tdef->c2 >= nodes.size())
-        {
-            throw std::out_of_range("node id");
-        }
-        if (std::none_of(desc.transistors, tdef,
-                    [tdef](const transdef& t) { return t == *tdef; }))
-        {
-            nodes[tdef->gate].gates.push_back(*tdef);
-            nodes[tdef->c1].sibling_connectors.push_back(tdef);
-            nodes[tdef->c2].sibling_connectors.push_back(tdef);
-        }
-    }
-}
-
-static pair<vector<uint16_t>, vector<uint16_t>>
-create_nodes(const vector<construct_node>& cnodes)
-{
-    vector<uint16_t> nodes;
-    vector<uint16_t> node_offsets;
-
-    node_offsets.push_back(0);
-    for (uint16_t i = 1; i < cnodes.size(); ++i) {
-        assert(std::numeric_limits<uint16_t>::max() > nodes.size());
-
-        node_offsets.push_back(uint16_t(nodes.size()));
-        nodes.push_back(cnodes[i].is_pullup ? node_is_pullup : 0);
-        nodes.push_back(uint16_t(cnodes[i].gates.size()));
-        nodes.push_back(uint16_t(cnodes[i].sibling_connectors.size()));
-        nodes.resize(nodes.size() + cnodes[i].gates.size() * 2);
-        nodes.resize(nodes.size() + cnodes[i].sibling_connectors.size());
-    }
-    for (uint16_t nodei = 1; nodei < cnodes.size(); ++nodei) {
-        const construct_node *cnode = cnodes.data() + nodei;
-        uint16_t *node = nodes.data() + node_offsets[nodei];
-        uint16_t *leg = node_gates(node);
-        for (uint16_t i = 0; i < cnode->gates.size(); ++i) {
-            *leg++ = cnode->gates[i].c1 << 1;
-            *leg++ = cnode->gates[i].c2 << 1;
-        }
-    }
-    for (uint16_t nodei = 1; nodei < cnodes.size(); ++nodei) {
-        const construct_node *cnode = cnodes.data() + nodei;
-        uint16_t *node = nodes.data() + node_offsets[nodei];
-        auto connectors = node_sibling_connectors(node);
-        for (uint16_t i = 0; i < cnode->sibling_connectors.size(); ++i) {
-            auto tdef = cnode->sibling_connectors[i];
-            uint16_t gn_off = node_offsets[tdef->gate];
-            connectors[i] = lookup_leg(nodes.data(), nodei, gn_off, tdef);
-        }
-    }
-
-    return make_pair(node_offsets, nodes);
-}
-
-inline uint16_t*
-nmos::node_addr(uint16_t id)
-{
-    return nodes.data() + node_offsets[id];
-}
-
-inline const uint16_t*
-nmos::node_addr(uint16_t id) const
-{
-    return nodes.data() + node_offsets[id];
-}
-
+template<typename id_type>
 bool
-nmos::get_node(unsigned id) const noexcept
+basic_nmos<id_type>::get_node(unsigned id) const noexcept
 {
     if (id > 0 and id <= node_count()) {
-        return (*(node_addr(id))) & node_is_high;
+        return flags[topology->internal_id(id)] & node_is_high;
     }
     else {
         return false;
     }
 }
 
+template<typename id_type>
 void
-nmos::set_node(unsigned id, bool high) noexcept
+basic_nmos<id_type>::set_node(unsigned id, bool high) noexcept
 {
     if (id > 0 and id <= node_count()) {
-        uint16_t *node = node_addr(id);
+        const id_type internal = topology->internal_id(id);
+        uint8_t& node = flags[internal];
 
-        if ((*node & node_is_pullup) and not high) {
-            *node &= ~node_is_pullup;
-            *node |= node_is_pulldown;
+        if ((node & node_is_pullup) and not high) {
+            node &= ~node_is_pullup;
+            node |= node_is_pulldown;
         }
-        else if (high and not (*node & node_is_pullup)) {
-            *node |= node_is_pullup;
-            *node &= ~node_is_pulldown;
+        else if (high and not (node & node_is_pullup)) {
+            node |= node_is_pullup;
+            node &= ~node_is_pulldown;
         }
         else return;
 
-        changed_push(id);
+        changed_push(internal);
     }
 }
 
+template<typename id_type>
 unsigned
-nmos::read_nodes(const uint16_t* ids, unsigned count) const noexcept
+basic_nmos<id_type>::read_nodes(const id_type* ids,
+                                unsigned count) const noexcept
 {
     unsigned value = 0;
 
@@ -407,12 +257,33 @@ nmos::read_nodes(const uint16_t* ids, unsigned count) const noexcept
     return value;
 }
 
+/* A gather table is just a list of node ids, each translated to the
+ * index of its flags in the netlist.
+ */
+template<typename id_type>
+uint64_t
+basic_nmos<id_type>::gather_nodes(const id_type *ids,
+                                  unsigned count) const noexcept
+{
+    const uint8_t *node_flags = flags.data();
+    uint64_t bits = 0;
+
+    for (unsigned index = 0; index < count; ++index) {
+        const id_type id = topology->internal_id(ids[index]);
+        uint64_t high = (node_flags[id] & node_is_high) ? 1 : 0;
+
+        bits |= high << index;
+    }
+    return bits;
+}
+
+template<typename id_type>
 void
-nmos::write_nodes(const uint16_t* ids,
-                       unsigned count,
-                       unsigned value) noexcept
+basic_nmos<id_type>::write_nodes(const id_type* ids,
+                                 unsigned count,
+                                 unsigned value) noexcept
 {
-    const uint16_t *id = ids + count;
+    const id_type *id = ids + count;
 
     while (id-- != ids) {
         set_node(*id, value & 1);
@@ -420,125 +291,294 @@ nmos::write_nodes(const uint16_t* ids,
     }
 }
 
-nmos::nmos(const chip_description& desc):
-    power(desc.node_power),
-    ground(desc.node_ground)
+template<typename id_type>
+basic_nmos<id_type>::basic_nmos(const basic_chip_description<id_type>& desc,
+                                const compiled_netlist *compiled_code):
+    basic_nmos(desc, netlist::get(desc), compiled_code)
 {
-    auto cnodes = create_construct_nodes(desc);
-    setup_transistors(desc, cnodes);
-    tie(node_offsets, nodes) = create_nodes(cnodes);
-    desc_nodes_count = desc.node_count;
+}
+
+template<typename id_type>
+basic_nmos<id_type>::basic_nmos(const basic_chip_description<id_type>& desc,
+                                std::shared_ptr<const netlist> topology_data,
+                                const compiled_netlist *compiled_code):
+    topology(std::move(topology_data)),
+    compiled(nullptr),
+    power(topology->power),
+    ground(topology->ground)
+{
+    if (compiled_code != nullptr
+            and compiled_code->packed_size == topology->packed_size()
+            and compiled_code->checksum == topology->checksum())
+    {
+        compiled = compiled_code;
+    }
     desc_transistor_count = desc.transistor_count;
+    evaluated_nodes = 0;
+    counters = empty_stats();
+    flags.resize(node_count() + 1);
+    for (id_type id = 1; id <= node_count(); ++id) {
+        flags[id] = topology->is_pullup(id) ? node_is_pullup : 0;
+    }
+    transistor_on.resize(topology->transistor_count());
     changed_queue_init();
-    change_order.resize(node_count());
     group_init();
-    node_addr(power)[0] |= node_is_high;
+    recalc_epoch = 0;
+    CHIPEMU_STATS(toggle_epochs.resize(node_count() + 1, 0));
+    flags[power] |= node_is_high;
 }
 
+template<typename id_type>
 unsigned
-nmos::node_count() const noexcept
+basic_nmos<id_type>::node_count() const noexcept
 {
-    return desc_nodes_count;
+    return topology->node_count();
 }
 
+template<typename id_type>
 unsigned
-nmos::transistor_count() const noexcept
+basic_nmos<id_type>::transistor_count() const noexcept
 {
     return desc_transistor_count;
 }
 
+/* Queues the nodes affected by the transistors gated by a node, which
+ * just toggled - in node id order, see basic_netlist::change_entry
+ */
+template<typename id_type>
 inline void
-nmos::add_ordered_change(uint16_t id)
+basic_nmos<id_type>::queue_changes(id_type id, bool high)
+{
+    typedef typename netlist::change_entry change_entry;
+
+    const change_entry *end = topology->changes_end(id);
+
+    for (const change_entry *entry = topology->changes_begin(id);
+         entry != end;
+         ++entry)
+    {
+        if (high) {
+            if (not entry->on_high) continue;
+            if ((flags[entry->node] & node_is_high)
+                    == (flags[entry->other_leg] & node_is_high))
+            {
+                continue;
+            }
+        }
+        CHIPEMU_STATS(++counters.ordered_changes);
+        changed_push(entry->node);
+    }
+}
+
+template<typename id_type>
+void
+basic_nmos<id_type>::next_recalc_epoch()
 {
-    change_order[change_count++] = id;
-    std::push_heap(change_order.begin(),
-            change_order.begin() + change_count,
-            std::greater<uint16_t>());
+    if (++recalc_epoch == 0) {
+        std::fill(toggle_epochs.begin(), toggle_epochs.end(), 0);
+        recalc_epoch = 1;
+    }
 }
 
+/* A node toggling again in the same recalc() is a glitch */
+template<typename id_type>
 inline void
-nmos::commit_ordered_changes()
+basic_nmos<id_type>::count_toggle(id_type id)
 {
-    while (change_count > 0) {
-        std::pop_heap(change_order.begin(),
-            change_order.begin() + change_count,
-            std::greater<uint16_t>());
-        changed_push(change_order[--change_count]);
+    if (toggle_epochs[id] == recalc_epoch) {
+        ++counters.glitches;
     }
+    toggle_epochs[id] = recalc_epoch;
 }
 
+template<typename id_type>
+template<bool use_compiled>
 inline void
-nmos::recalc_node(uint16_t id)
+basic_nmos<id_type>::recalc_node(id_type id)
 {
-    uint16_t *node = node_addr(id);
-
-    if (not (node[0] & node_in_changelist)) return;
-    node[0] &= ~node_in_changelist;
-    group_setup(id);
-    uint16_t high_value = group_get_value() ? node_is_high : 0;
+    CHIPEMU_STATS(++counters.nodes_popped);
+    if (not (flags[id] & node_in_changelist)) {
+        CHIPEMU_STATS(++counters.nodes_settled);
+        return;
+    }
+    flags[id] &= ~node_in_changelist;
+    group_setup<use_compiled>(id);
+    evaluated_nodes += group_tail;
+    CHIPEMU_STATS(count_group(counters, group_tail));
+    uint8_t high_value = group_get_value() ? node_is_high : 0;
     while (not is_group_empty()) {
-        uint16_t gid = group_pop();
-        uint16_t *node = node_addr(gid);
-
-        if ((*node & node_is_high) != high_value) {
-            *node ^= node_is_high;
-            uint16_t gate_count = node_gate_count(node);
-            uint16_t *leg = node_gates(node);
-            change_count = 0;
-            for (uint16_t i = 0; i < gate_count; ++i) {
-                leg[0] ^= 1;
-                leg[1] ^= 1;
-                uint16_t c1 = leg[0] >> 1;
-                uint16_t c2 = leg[1] >> 1;
-
-                if (high_value) {
-                    uint16_t flags_c1 = node_addr(c1)[0];
-                    uint16_t flags_c2 = node_addr(c2)[0];
-
-                    if ((flags_c1 & node_is_high) == (flags_c2 & node_is_high)) {
-                        leg += 2;
-                        continue;
-                    }
-                    if (c1 != power and c1 != ground) {
-                        add_ordered_change(c1);
-                    }
-                    else {
-                        add_ordered_change(c2);
-                    }
-                }
-                else {
-                    add_ordered_change(c1);
-                    add_ordered_change(c2);
-                }
-                leg += 2;
+        id_type gid = group_pop();
+        if ((flags[gid] & node_is_high) != high_value) {
+            flags[gid] ^= node_is_high;
+            CHIPEMU_STATS(counters.transistors_toggled +=
+                          netlist::gate_count(topology->node(gid)));
+            CHIPEMU_STATS(count_toggle(gid));
+            if (use_compiled) {
+                compiled->toggle_gates[gid](*this, high_value != 0);
+                continue;
+            }
+            const id_type *node = topology->node(gid);
+            id_type gate_count = netlist::gate_count(node);
+            const id_type *gate = netlist::gates(node);
+            for (id_type i = 0; i < gate_count; ++i, gate += 3) {
+                transistor_on.flip(gate[0]);
             }
-            commit_ordered_changes();
+            queue_changes(gid, high_value != 0);
         }
     }
 }
 
+template<typename id_type>
+template<bool use_compiled>
 inline void
-nmos::recalc_nodes()
+basic_nmos<id_type>::recalc_nodes()
 {
     while (not changed_is_empty()) {
-        recalc_node(changed_pop());
+        CHIPEMU_STATS(count_queue_length(counters,
+            (changed_feeding - changed_eating) & (changed_queue.size() - 1)));
+        recalc_node<use_compiled>(changed_pop());
     }
 }
 
+template<typename id_type>
 void
-nmos::stabilize_network() noexcept
+basic_nmos<id_type>::stabilize_network() noexcept
 {
-    for (uint16_t i = 1; i <= node_count(); ++i) {
-        changed_push(i);
+    for (id_type i = 1; i <= node_count(); ++i) {
+        changed_push(topology->internal_id(i));
     }
-    recalc_nodes();
+    recalc();
 }
 
+template<typename id_type>
 void
-nmos::recalc() noexcept
+basic_nmos<id_type>::recalc() noexcept
 {
-    recalc_nodes();
+    CHIPEMU_STATS(next_recalc_epoch());
+    if (parallel.enabled()) {
+        parallel.recalc(*this);
+    }
+    else if (compiled != nullptr) {
+        recalc_nodes<true>();
+    }
+    else {
+        recalc_nodes<false>();
+    }
+}
+
+template<typename id_type>
+unsigned long long
+basic_nmos<id_type>::evaluated_node_count() const noexcept
+{
+    return evaluated_nodes;
+}
+
+template<typename id_type>
+unsigned
+basic_nmos<id_type>::thread_count() const noexcept
+{
+    return parallel.thread_count();
+}
+
+template<typename id_type>
+void
+basic_nmos<id_type>::set_thread_count(unsigned count)
+{
+    parallel.set_thread_count(count);
+}
+
+template<typename id_type>
+chip_stats
+basic_nmos<id_type>::stats() const noexcept
+{
+    return counters;
+}
+
+template<typename id_type>
+void
+basic_nmos<id_type>::reset_stats() noexcept
+{
+    counters = empty_stats();
 }
 
+/* The state saved by snapshot:
+ *
+ *   nmos_snapshot_header
+ *   flags           - node_count() + 1 bytes
+ *   transistor_on   - the words of the bitmap, see bit_vector
+ *   the contents of the changed queue, queue_length id_type values
+ *
+ * The group, and the ordered changes are always empty between two
+ * calls to recalc(), those are not saved.
+ */
+template<typename id_type>
+void
+basic_nmos<id_type>::save_state(vector<unsigned char>& blob) const
+{
+    snapshot_writer writer(blob);
+    size_t mask = changed_queue.size() - 1;
+    nmos_snapshot_header header = {
+        topology->checksum(),
+        uint32_t(node_count()),
+        uint32_t(transistor_on.size()),
+        uint32_t((changed_feeding - changed_eating) & mask)
+    };
+
+    writer.write(header);
+    writer.write(flags.data(), flags.size());
+    writer.write(transistor_on.data(), transistor_on.word_count());
+    for (size_t i = changed_eating; i != changed_feeding; i = (i + 1) & mask) {
+        writer.write(changed_queue[i]);
+    }
+}
+
+template<typename id_type>
+void
+basic_nmos<id_type>::restore_state(const unsigned char *blob, size_t size)
+{
+    snapshot_reader reader(blob, size);
+    auto header = reader.read<nmos_snapshot_header>();
+
+    if (header.checksum != topology->checksum()
+            or header.node_count != node_count()
+            or header.transistor_count != transistor_on.size()
+            or size != sizeof(header)
+                       + flags.size() * sizeof(flags[0])
+                       + transistor_on.word_count() * sizeof(uint64_t)
+                       + header.queue_length * sizeof(id_type))
+    {
+        throw std::invalid_argument("snapshot");
+    }
+
+    reader.read(flags.data(), flags.size());
+    reader.read(transistor_on.data(), transistor_on.word_count());
+    while (changed_queue.size() <= header.queue_length) {
+        changed_queue.resize(changed_queue.size() * 2);
+    }
+    reader.read(changed_queue.data(), header.queue_length);
+    changed_eating = 0;
+    changed_feeding = header.queue_length;
+}
+
+template<typename id_type>
+vector<unsigned char>
+basic_nmos<id_type>::snapshot() const
+{
+    vector<unsigned char> blob;
+
+    save_state(blob);
+    return blob;
+}
+
+template<typename id_type>
+void
+basic_nmos<id_type>::restore(const vector<unsigned char>& blob)
+{
+    restore_state(blob.data(), blob.size());
+}
+
+template class basic_nmos<uint16_t>;
+template class basic_nmos<uint32_t>;
+
 }
 }
@@ -2,10 +2,15 @@
 #ifndef CHIPEMU_CHIP_BASE_H
 #define CHIPEMU_CHIP_BASE_H
 
+#include "bit_vector.h"
 #include "chipemu.h"
+#include "netlist.h"
+#include "nmos_parallel.h"
+#include "stats.h"
 
 #include <cstdint>
 #include <cstddef>
+#include <memory>
 #include <vector>
 
 namespace chipemu
@@ -13,43 +18,65 @@ namespace chipemu
 namespace implementation
 {
 
-struct transdef
+template<typename id_type> class basic_nmos;
+template<typename id_type> class basic_partitioned_nmos;
+
+/* Evaluation code generated for one specific chip_description
+ * by nmos_compiler, see nmos_compiler.cc
+ *
+ * The generated code depends on the exact layout of the netlist,
+ * the layout it was generated for is identified by packed_size and checksum,
+ * see basic_netlist::packed_size and basic_netlist::checksum.
+ */
+template<typename id_type>
+struct basic_compiled_netlist
 {
-    const uint16_t gate;
-    const uint16_t c1;
-    const uint16_t c2;
-
-    bool operator==(const transdef&) const;
-
-    transdef(uint16_t a, uint16_t b, uint16_t c):
-        gate(a),
-        c1(b),
-        c2(c)
-    { }
+    size_t packed_size;
+    uint32_t checksum;
+    void (* const *group_add)(basic_nmos<id_type>&);
+    void (* const *toggle_gates)(basic_nmos<id_type>&, bool high);
 };
 
-struct chip_description
-{
-    const unsigned node_count;
-    const bool *pullups;
-    const unsigned transistor_count;
-    const transdef *transistors;
-    const uint16_t node_power;
-    const uint16_t node_ground;
-};
-
-class nmos : public virtual chipemu::chip
+/* The nmos engine
+ *
+ * The topology is held in a netlist, shared with every other chip
+ * built from the same chip_description. An instance only owns the state
+ * of the network: the flags of the nodes, one byte per node, indexed by
+ * node id, the state of each transistor ( 1 - on, 0 - off ), one bit per
+ * transistor, indexed by transistor index, and the work areas used by
+ * recalc().
+ *
+ * The width of node ids is a template parameter, see basic_netlist.
+ */
+template<typename id_type>
+class basic_nmos : public virtual chipemu::chip
 {
 private:
 
-    void recalc_node(uint16_t);
-    void recalc_nodes();
+    friend struct compiled_primitives;
+    friend class parallel_recalc<id_type>;
+    friend class basic_partitioned_nmos<id_type>;
+
+    typedef basic_netlist<id_type> netlist;
+    typedef basic_compiled_netlist<id_type> compiled_netlist;
+    typedef typename netlist::group_table group_table;
+    typedef typename netlist::group_entry group_entry;
+
+    std::shared_ptr<const netlist> topology;
+    const compiled_netlist *compiled;
 
-    std::vector<uint16_t> changed_queue;
-    typename std::vector<uint16_t>::iterator changed_eating, changed_feeding;
+    std::vector<uint8_t> flags;
+    bit_vector transistor_on;
 
-    std::vector<uint16_t> current_group;
-    typename std::vector<uint16_t>::iterator group_tail;
+    template<bool use_compiled> void recalc_node(id_type);
+    template<bool use_compiled> void recalc_nodes();
+
+    /* a ring buffer, the capacity is always a power of two */
+    std::vector<id_type> changed_queue;
+    size_t changed_eating, changed_feeding;
+
+    std::vector<id_type> current_group;
+    size_t group_tail;
 
     enum class group_contains {
         nothing,
@@ -63,42 +90,64 @@ private:
     group_contains group_current_value;
 
     void changed_queue_init();
+    void changed_queue_grow();
     void group_init();
-    void group_update_value(uint16_t);
-    void group_add(uint16_t);
+    static void update_group_value(group_contains&, uint8_t);
+    void group_update_value(uint8_t);
+    void group_add(id_type);
+    void group_lookup(const group_table&);
 
-    uint16_t changed_pop();
-    void changed_push(uint16_t id);
+    id_type changed_pop();
+    void changed_push(id_type id);
     bool changed_is_empty() const;
     void changed_clear();
 
-    void group_setup(uint16_t);
+    template<bool use_compiled> void group_setup(id_type);
     bool group_get_value() const;
+    static bool is_high(group_contains);
     bool is_group_empty() const;
-    uint16_t group_pop();
+    id_type group_pop();
+
+    void queue_changes(id_type, bool high);
+    void count_toggle(id_type);
+    void next_recalc_epoch();
+    unsigned desc_transistor_count;
+    unsigned long long evaluated_nodes;
+    chip_stats counters;
+
+    /* the recalc() call each node last toggled in, for counting glitches,
+     * only used with CHIPEMU_ENABLE_STATS
+     */
+    std::vector<uint32_t> toggle_epochs;
+    uint32_t recalc_epoch;
+    parallel_recalc<id_type> parallel;
 
-    uint16_t *node_addr(uint16_t id);
-    const uint16_t *node_addr(uint16_t id) const;
+protected:
 
-    std::vector<uint16_t> nodes;
-    std::vector<uint16_t> node_offsets;
-    std::vector<uint16_t> change_order;
+    /* the ids of the rails in the netlist, see basic_netlist::internal_id */
+    const id_type power;
+    const id_type ground;
 
-    void add_ordered_change(uint16_t);
-    size_t change_count;
-    void commit_ordered_changes();
-    uint16_t desc_nodes_count;
-    uint16_t desc_transistor_count;
+    basic_nmos(const basic_chip_description<id_type>& desc,
+               const compiled_netlist *compiled = nullptr);
 
-protected:
+    /* A chip using the specified netlist, e.g. one specialized
+     * for the chip_description, see specialization
+     */
+    basic_nmos(const basic_chip_description<id_type>& desc,
+               std::shared_ptr<const netlist> topology,
+               const compiled_netlist *compiled = nullptr);
 
-    const uint16_t power;
-    const uint16_t ground;
+    unsigned read_nodes(const id_type*, unsigned count) const noexcept;
 
-    nmos(const chip_description& desc);
+    /* bit N of the result is set if the node ids[N] is high,
+     * at most 64 nodes
+     */
+    uint64_t gather_nodes(const id_type *ids, unsigned count) const noexcept;
+    void write_nodes(const id_type*, unsigned count, unsigned value) noexcept;
 
-    unsigned read_nodes(const uint16_t*, unsigned count) const noexcept;
-    void write_nodes(const uint16_t*, unsigned count, unsigned value) noexcept;
+    void save_state(std::vector<unsigned char>&) const;
+    void restore_state(const unsigned char*, size_t);
 
 public:
 
@@ -108,9 +157,26 @@ public:
     virtual unsigned transistor_count() const noexcept final;
     virtual void stabilize_network() noexcept override;
     virtual void recalc() noexcept override;
+    virtual unsigned long long evaluated_node_count() const noexcept final;
+    virtual chip_stats stats() const noexcept final;
+    virtual void reset_stats() noexcept final;
+
+    /* The number of threads used by recalc, see parallel_recalc,
+     * the compiled netlist is not used with more than one thread.
+     */
+    unsigned thread_count() const noexcept;
+    void set_thread_count(unsigned);
+    virtual std::vector<unsigned char> snapshot() const override;
+    virtual void restore(const std::vector<unsigned char>&) override;
 
 };
 
+typedef basic_compiled_netlist<uint16_t> compiled_netlist;
+typedef basic_nmos<uint16_t> nmos;
+
+/* for netlists too large for the compact layout */
+typedef basic_nmos<uint32_t> wide_nmos;
+
 }
 }
 
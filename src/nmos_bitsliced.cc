@@ -0,0 +1,438 @@
+
+#include <cassert>
+#include <algorithm>
+#include <stdexcept>
+#include <numeric>
+#include <limits>
+
+#include "nmos_bitsliced.h"
+#include "snapshot.h"
+
+using std::vector;
+
+namespace chipemu
+{
+namespace implementation
+{
+
+/* Internal representation
+ *
+ * The topology is stored in compressed rows:
+ *
+ *  gate_transistors[gate_offsets[id]] up to
+ *  gate_transistors[gate_offsets[id + 1] - 1]
+ *     the transistors controlled by the node with the specific id
+ *
+ *  siblings[sibling_offsets[id]] up to
+ *  siblings[sibling_offsets[id + 1] - 1]
+ *     the transistors connecting the node to other nodes, each
+ *     paired with the node on the other leg of the transistor
+ *
+ * Both lists follow the order of the transistors in the chip_description,
+ * just like the lists built by the nmos engine.
+ *
+ * changed_lanes[id] is the set of lanes, in which the node is waiting
+ * in the changed_queue - the equivalent of the node_in_changelist flag.
+ */
+
+template<typename container>
+static void
+csr_offsets(container& offsets)
+{
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+}
+
+nmos_bitsliced::nmos_bitsliced(const chip_description& desc):
+    power(desc.node_power),
+    ground(desc.node_ground)
+{
+    const transdef *tdefs = desc.transistors;
+    const size_t count = desc.node_count + 1;
+
+    if (desc.node_count >= std::numeric_limits<uint16_t>::max()
+            or desc.transistor_count > std::numeric_limits<uint16_t>::max())
+    {
+        throw std::out_of_range("netlist size");
+    }
+    desc_nodes_count = uint16_t(desc.node_count);
+    desc_transistor_count = uint16_t(desc.transistor_count);
+    evaluated_nodes = 0;
+    counters = empty_stats();
+
+    gate_offsets.assign(count + 1, 0);
+    sibling_offsets.assign(count + 1, 0);
+    for (unsigned i = 0; i < desc.transistor_count; ++i) {
+        if (tdefs[i].gate >= count
+                or tdefs[i].c1 >= count
+                or tdefs[i].c2 >= count)
+        {
+            throw std::out_of_range("node id");
+        }
+        ++gate_offsets[tdefs[i].gate + 1];
+        ++sibling_offsets[tdefs[i].c1 + 1];
+        ++sibling_offsets[tdefs[i].c2 + 1];
+    }
+    csr_offsets(gate_offsets);
+    csr_offsets(sibling_offsets);
+
+    gate_transistors.resize(gate_offsets.back());
+    siblings.resize(sibling_offsets.back());
+    transistor_c1.resize(desc.transistor_count);
+    transistor_c2.resize(desc.transistor_count);
+
+    vector<uint32_t> gate_fill(gate_offsets.begin(), gate_offsets.end() - 1);
+    vector<uint32_t> sibling_fill(sibling_offsets.begin(),
+                                  sibling_offsets.end() - 1);
+    for (unsigned i = 0; i < desc.transistor_count; ++i) {
+        const transdef& t = tdefs[i];
+        const uint16_t index = uint16_t(i);
+
+        transistor_c1[i] = t.c1;
+        transistor_c2[i] = t.c2;
+        gate_transistors[gate_fill[t.gate]++] = index;
+        siblings[sibling_fill[t.c1]++] = {index, t.c2};
+        siblings[sibling_fill[t.c2]++] = {index, t.c1};
+    }
+
+    /* initial state, same as in the nmos engine */
+    high.assign(count, 0);
+    pullup.assign(count, 0);
+    pulldown.assign(count, 0);
+    for (unsigned index = 0; index < desc.node_count; ++index) {
+        if (desc.pullups[index]) {
+            pullup[index + 1] = ~lane_word(0);
+        }
+    }
+    high[power] = ~lane_word(0);
+
+    /* every transistor starts in the off state, even the ones gated by
+     * power, which never toggles
+     */
+    transistor_on.assign(desc.transistor_count, 0);
+    changed_lanes.assign(count, 0);
+    group_lanes.assign(count, 0);
+}
+
+inline void
+nmos_bitsliced::changed_push(uint16_t id, lane_word lanes)
+{
+    lanes &= ~changed_lanes[id];
+    if (lanes == 0 or id == power or id == ground) return;
+
+    changed_lanes[id] |= lanes;
+    changed_queue.push_back({id, lanes});
+}
+
+void
+nmos_bitsliced::group_add(uint16_t id, lane_word lanes, group_value& value)
+{
+    group_members.push_back({id, lanes});
+    group_lanes[id] |= lanes;
+    changed_lanes[id] &= ~lanes;
+
+    /* the first node with a flag decides, except that a pulldown
+     * overrides a pullup found earlier
+     */
+    const lane_word to_pulldown = lanes & pulldown[id]
+                                  & (value.undecided | value.pullup);
+    const lane_word undecided = lanes & value.undecided & ~pulldown[id];
+    const lane_word to_pullup = undecided & pullup[id];
+    const lane_word to_high = undecided & ~pullup[id] & high[id];
+
+    value.undecided &= ~(to_pulldown | to_pullup | to_high);
+    value.pullup = (value.pullup & ~to_pulldown) | to_pullup;
+    value.pulldown |= to_pulldown;
+    value.high |= to_high;
+
+    for (uint32_t i = sibling_offsets[id]; i < sibling_offsets[id + 1]; ++i) {
+        const sibling& sib = siblings[i];
+        lane_word on = lanes & transistor_on[sib.transistor];
+
+        if (on == 0) continue;
+
+        if (sib.node == ground) {
+            value.ground |= on;
+        }
+        else if (sib.node == power) {
+            value.power |= on;
+        }
+        else {
+            on &= ~group_lanes[sib.node];
+            if (on != 0) {
+                group_add(sib.node, on, value);
+            }
+        }
+    }
+}
+
+/* Evaluate the group of a node, in the specified lanes
+ *
+ * The value of a group is decided in the same order as in the nmos
+ * engine:
+ *   connected to ground -> low
+ *   connected to power -> high
+ *   otherwise decided by the nodes in the order they were visited in,
+ *    see group_add
+ *
+ * The members are updated in the reverse of that order, just like
+ * in the nmos engine, thus the changed nodes are queued in the same
+ * order in each lane, as in a single chip.
+ */
+inline void
+nmos_bitsliced::recalc_node(uint16_t id, lane_word lanes)
+{
+    CHIPEMU_STATS(++counters.nodes_popped);
+    lanes &= changed_lanes[id];
+    if (lanes == 0) {
+        CHIPEMU_STATS(++counters.nodes_settled);
+        return;
+    }
+
+    group_value group = {0, 0, lanes, 0, 0, 0};
+
+    group_members.clear();
+    group_add(id, lanes, group);
+    evaluated_nodes += group_members.size();
+    CHIPEMU_STATS(count_group(counters, group_members.size()));
+
+    const lane_word value = ~group.ground
+                          & (group.power | group.high | group.pullup);
+
+    while (not group_members.empty()) {
+        const uint16_t gid = group_members.back().node;
+        const lane_word in_group = group_members.back().lanes;
+        const lane_word new_high = (high[gid] & ~in_group) | (value & in_group);
+        const lane_word diff = new_high ^ high[gid];
+
+        group_members.pop_back();
+        group_lanes[gid] &= ~in_group;
+        if (diff == 0) continue;
+
+        high[gid] = new_high;
+        ordered_changes.clear();
+        CHIPEMU_STATS(counters.transistors_toggled +=
+                      gate_offsets[gid + 1] - gate_offsets[gid]);
+        for (uint32_t i = gate_offsets[gid]; i < gate_offsets[gid + 1]; ++i) {
+            const uint16_t t = gate_transistors[i];
+            const uint16_t c1 = transistor_c1[t];
+            const uint16_t c2 = transistor_c2[t];
+            const lane_word turned_on = diff & new_high;
+            const lane_word turned_off = diff & ~new_high;
+            const lane_word connects = turned_on & (high[c1] ^ high[c2]);
+
+            transistor_on[t] ^= diff;
+            if (c1 != power and c1 != ground) {
+                ordered_changes.push_back({c1, turned_off | connects});
+                ordered_changes.push_back({c2, turned_off});
+            }
+            else {
+                ordered_changes.push_back({c1, turned_off});
+                ordered_changes.push_back({c2, turned_off | connects});
+            }
+        }
+        std::stable_sort(ordered_changes.begin(), ordered_changes.end());
+        CHIPEMU_STATS(counters.ordered_changes += ordered_changes.size());
+        for (const change& c : ordered_changes) {
+            changed_push(c.node, c.lanes);
+        }
+    }
+}
+
+inline void
+nmos_bitsliced::recalc_nodes()
+{
+    while (not changed_queue.empty()) {
+        CHIPEMU_STATS(count_queue_length(counters, changed_queue.size()));
+
+        change c = changed_queue.front();
+
+        changed_queue.pop_front();
+        recalc_node(c.node, c.lanes);
+    }
+}
+
+bool
+nmos_bitsliced::get_node(unsigned lane, unsigned id) const noexcept
+{
+    if (lane < lane_count and id > 0 and id <= node_count()) {
+        return (high[id] >> lane) & 1;
+    }
+    else {
+        return false;
+    }
+}
+
+void
+nmos_bitsliced::set_node(unsigned lane, unsigned id, bool value) noexcept
+{
+    if (lane < lane_count and id > 0 and id <= node_count()) {
+        const lane_word bit = lane_word(1) << lane;
+
+        if ((pullup[id] & bit) and not value) {
+            pullup[id] &= ~bit;
+            pulldown[id] |= bit;
+        }
+        else if (value and not (pullup[id] & bit)) {
+            pullup[id] |= bit;
+            pulldown[id] &= ~bit;
+        }
+        else return;
+
+        changed_push(uint16_t(id), bit);
+    }
+}
+
+void
+nmos_bitsliced::set_node_all_lanes(unsigned id, bool value) noexcept
+{
+    if (id > 0 and id <= node_count()) {
+        const lane_word old_pullup = pullup[id];
+
+        if (value) {
+            pullup[id] = ~lane_word(0);
+            pulldown[id] &= old_pullup;
+        }
+        else {
+            pulldown[id] |= old_pullup;
+            pullup[id] = 0;
+        }
+        changed_push(uint16_t(id), pullup[id] ^ old_pullup);
+    }
+}
+
+unsigned
+nmos_bitsliced::read_nodes(unsigned lane,
+                           const uint16_t* ids,
+                           unsigned count) const noexcept
+{
+    unsigned value = 0;
+
+    for (unsigned index = 0; index < count; ++index) {
+        value = (value << 1) + (get_node(lane, ids[index]) ? 1 : 0);
+    }
+    return value;
+}
+
+void
+nmos_bitsliced::write_nodes(unsigned lane,
+                            const uint16_t* ids,
+                            unsigned count,
+                            unsigned value) noexcept
+{
+    const uint16_t *id = ids + count;
+
+    while (id-- != ids) {
+        set_node(lane, *id, value & 1);
+        value >>= 1;
+    }
+}
+
+unsigned
+nmos_bitsliced::node_count() const noexcept
+{
+    return desc_nodes_count;
+}
+
+unsigned
+nmos_bitsliced::transistor_count() const noexcept
+{
+    return desc_transistor_count;
+}
+
+void
+nmos_bitsliced::stabilize_network() noexcept
+{
+    for (uint16_t i = 1; i <= node_count(); ++i) {
+        changed_push(i, ~lane_word(0));
+    }
+    recalc_nodes();
+}
+
+void
+nmos_bitsliced::recalc() noexcept
+{
+    recalc_nodes();
+}
+
+unsigned long long
+nmos_bitsliced::evaluated_node_count() const noexcept
+{
+    return evaluated_nodes;
+}
+
+chip_stats
+nmos_bitsliced::stats() const noexcept
+{
+    return counters;
+}
+
+void
+nmos_bitsliced::reset_stats() noexcept
+{
+    counters = empty_stats();
+}
+
+/* The state saved by snapshot:
+ *
+ *   the node count, the transistor count, and the length of the queue,
+ *    three uint32_t values
+ *   high, pullup, pulldown, changed_lanes - node_count() + 1 lane words each
+ *   transistor_on - one lane word per transistor
+ *   the contents of the changed queue, a node id, and a lane word
+ *    for each entry
+ */
+vector<unsigned char>
+nmos_bitsliced::snapshot() const
+{
+    vector<unsigned char> blob;
+    snapshot_writer writer(blob);
+
+    writer.write(uint32_t(node_count()));
+    writer.write(uint32_t(transistor_count()));
+    writer.write(uint32_t(changed_queue.size()));
+    writer.write(high.data(), high.size());
+    writer.write(pullup.data(), pullup.size());
+    writer.write(pulldown.data(), pulldown.size());
+    writer.write(changed_lanes.data(), changed_lanes.size());
+    writer.write(transistor_on.data(), transistor_on.size());
+    for (const change& entry : changed_queue) {
+        writer.write(entry.node);
+        writer.write(entry.lanes);
+    }
+    return blob;
+}
+
+void
+nmos_bitsliced::restore(const vector<unsigned char>& blob)
+{
+    snapshot_reader reader(blob.data(), blob.size());
+    uint32_t nodes = reader.read<uint32_t>();
+    uint32_t transistors = reader.read<uint32_t>();
+    uint32_t queue_length = reader.read<uint32_t>();
+
+    if (nodes != node_count()
+            or transistors != transistor_count()
+            or blob.size() != 3 * sizeof(uint32_t)
+                              + 4 * high.size() * sizeof(lane_word)
+                              + transistor_on.size() * sizeof(lane_word)
+                              + queue_length * (sizeof(uint16_t)
+                                                + sizeof(lane_word)))
+    {
+        throw std::invalid_argument("snapshot");
+    }
+
+    reader.read(high.data(), high.size());
+    reader.read(pullup.data(), pullup.size());
+    reader.read(pulldown.data(), pulldown.size());
+    reader.read(changed_lanes.data(), changed_lanes.size());
+    reader.read(transistor_on.data(), transistor_on.size());
+    changed_queue.clear();
+    while (queue_length-- > 0) {
+        uint16_t id = reader.read<uint16_t>();
+
+        changed_queue.push_back({id, reader.read<lane_word>()});
+    }
+}
+
+}
+}
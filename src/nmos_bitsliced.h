@@ -0,0 +1,137 @@
+
+#ifndef CHIPEMU_NMOS_BITSLICED_H
+#define CHIPEMU_NMOS_BITSLICED_H
+
+#include "nmos.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+
+namespace chipemu
+{
+namespace implementation
+{
+
+/* Bit-sliced variant of the nmos engine
+ *
+ * Every node flag, and every transistor state is stored as a lane word,
+ * bit N of each word belonging to the N-th instance of the chip.
+ * All instances share the same netlist, but each of them can be driven
+ * with different inputs, and one recalc() call advances all of them.
+ *
+ * The algorithm follows the one in the nmos engine: a queue of changed
+ * nodes, each entry holding the set of lanes the node changed in.
+ * The group of a node is discovered in all of those lanes at once,
+ * by flooding a lane mask along the transistors which are on.
+ */
+class nmos_bitsliced : public virtual chipemu::chip
+{
+public:
+
+    typedef uint64_t lane_word;
+    static constexpr unsigned lane_count = 64;
+
+private:
+
+    struct sibling
+    {
+        uint16_t transistor;
+        uint16_t node;
+    };
+
+    struct change
+    {
+        uint16_t node;
+        lane_word lanes;
+
+        bool operator<(const change& other) const
+        {
+            return node < other.node;
+        }
+    };
+
+    /* the topology */
+    std::vector<uint32_t> gate_offsets;
+    std::vector<uint16_t> gate_transistors;
+    std::vector<uint32_t> sibling_offsets;
+    std::vector<sibling> siblings;
+    std::vector<uint16_t> transistor_c1;
+    std::vector<uint16_t> transistor_c2;
+
+    /* the state of all lanes */
+    std::vector<lane_word> high;
+    std::vector<lane_word> pullup;
+    std::vector<lane_word> pulldown;
+    std::vector<lane_word> transistor_on;
+    std::vector<lane_word> changed_lanes;
+
+    std::deque<change> changed_queue;
+
+    /* scratch area used while evaluating a group - group_members lists
+     * each node with the lanes it joined the group in, in the order
+     * group_add reached it, which in every lane is the order the nmos
+     * engine visits the group in
+     */
+    std::vector<lane_word> group_lanes;
+    std::vector<change> group_members;
+    std::vector<change> ordered_changes;
+
+    /* The value of a group, in each lane, see update_group_value
+     * in nmos_primitives.h - a lane is in exactly one of the sets
+     * undecided, high, pullup and pulldown.
+     */
+    struct group_value
+    {
+        lane_word ground;
+        lane_word power;
+        lane_word undecided;
+        lane_word high;
+        lane_word pullup;
+        lane_word pulldown;
+    };
+
+    void group_add(uint16_t id, lane_word lanes, group_value&);
+    void changed_push(uint16_t id, lane_word lanes);
+    void recalc_node(uint16_t id, lane_word lanes);
+    void recalc_nodes();
+
+    uint16_t desc_nodes_count;
+    uint16_t desc_transistor_count;
+    unsigned long long evaluated_nodes;
+    chip_stats counters;
+
+protected:
+
+    const uint16_t power;
+    const uint16_t ground;
+
+    nmos_bitsliced(const chip_description& desc);
+
+    unsigned read_nodes(unsigned lane,
+                        const uint16_t*, unsigned count) const noexcept;
+    void write_nodes(unsigned lane,
+                     const uint16_t*, unsigned count, unsigned value) noexcept;
+
+public:
+
+    bool get_node(unsigned lane, unsigned id) const noexcept;
+    void set_node(unsigned lane, unsigned id, bool) noexcept;
+    void set_node_all_lanes(unsigned id, bool) noexcept;
+    virtual unsigned node_count() const noexcept final;
+    virtual unsigned transistor_count() const noexcept final;
+    virtual void stabilize_network() noexcept override;
+    virtual void recalc() noexcept override;
+    virtual unsigned long long evaluated_node_count() const noexcept final;
+    virtual chip_stats stats() const noexcept final;
+    virtual void reset_stats() noexcept final;
+    virtual std::vector<unsigned char> snapshot() const override;
+    virtual void restore(const std::vector<unsigned char>&) override;
+
+};
+
+}
+}
+
+#endif
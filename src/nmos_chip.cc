@@ -0,0 +1,272 @@
+
+#include "nmos_chip.h"
+
+#include "nmos.h"
+#include "nmos_partitioned.h"
+#include "visual6502.h"
+
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace chipemu
+{
+namespace implementation
+{
+namespace
+{
+
+/* The chip_description of a loaded netlist, and the data it refers to */
+template<typename id_type>
+struct loaded_description
+{
+    std::string chip_name;
+    std::map<std::string, uint32_t> node_names;
+    std::vector<basic_transdef<id_type>> transistors;
+    std::unique_ptr<bool[]> pullups;
+    basic_chip_description<id_type> description;
+
+    static std::vector<basic_transdef<id_type>>
+    convert_transistors(const visual6502_netlist& source)
+    {
+        std::vector<basic_transdef<id_type>> result;
+        const uint32_t *t = source.transistors.data();
+
+        result.reserve(source.transistor_count());
+        for (unsigned i = 0; i < source.transistor_count(); ++i, t += 3) {
+            result.emplace_back(id_type(t[0]), id_type(t[1]), id_type(t[2]));
+        }
+        return result;
+    }
+
+    static std::unique_ptr<bool[]>
+    convert_pullups(const visual6502_netlist& source)
+    {
+        std::unique_ptr<bool[]> result(new bool[source.node_count()]);
+
+        for (unsigned i = 0; i < source.node_count(); ++i) {
+            result[i] = source.pullups[i + 1];
+        }
+        return result;
+    }
+
+    loaded_description(const char *name, visual6502_netlist&& source):
+        chip_name(name),
+        node_names(std::move(source.node_names)),
+        transistors(convert_transistors(source)),
+        pullups(convert_pullups(source)),
+        description{source.node_count(),
+                    pullups.get(),
+                    unsigned(transistors.size()),
+                    transistors.data(),
+                    id_type(source.power),
+                    id_type(source.ground)}
+    {}
+};
+
+/* The parts of nmos_chip which do not depend on the engine */
+template<typename id_type>
+class named_nodes : protected loaded_description<id_type>,
+                    public nmos_chip
+{
+    typedef loaded_description<id_type> loaded;
+
+protected:
+
+    named_nodes(const char *name, visual6502_netlist&& source):
+        loaded(name, std::move(source))
+    {}
+
+public:
+
+    virtual const char *name() const noexcept final
+    {
+        return loaded::chip_name.c_str();
+    }
+
+    virtual unsigned node_id(const char *node_name) const noexcept final
+    {
+        try {
+            auto entry = loaded::node_names.find(node_name);
+
+            if (entry != loaded::node_names.end()) {
+                return entry->second;
+            }
+        }
+        catch (...) {
+        }
+        return 0;
+    }
+};
+
+template<typename id_type>
+class implementation_nmos_chip : public named_nodes<id_type>,
+                                 public basic_nmos<id_type>
+{
+    typedef loaded_description<id_type> loaded;
+    typedef basic_nmos<id_type> engine;
+
+public:
+
+    implementation_nmos_chip(const char *name, visual6502_netlist&& source):
+        named_nodes<id_type>(name, std::move(source)),
+        engine(loaded::description)
+    {}
+
+    virtual partition_report partitions() const final
+    {
+        partition_report report;
+
+        report.regions.push_back({engine::node_count(),
+                                  engine::transistor_count(),
+                                  0});
+        report.component_count = 0;
+        report.cut_size = 0;
+        report.balance = 1;
+        return report;
+    }
+
+    virtual bool get_node(unsigned id) const noexcept final
+    {
+        return engine::get_node(id);
+    }
+
+    virtual void set_node(unsigned id, bool value) noexcept final
+    {
+        engine::set_node(id, value);
+    }
+
+    virtual unsigned thread_count() const noexcept final
+    {
+        return engine::thread_count();
+    }
+
+    virtual void set_thread_count(unsigned count) final
+    {
+        engine::set_thread_count(count);
+    }
+
+    virtual ~implementation_nmos_chip() {}
+};
+
+template<typename id_type>
+class partitioned_nmos_chip : public named_nodes<id_type>,
+                              public basic_partitioned_nmos<id_type>
+{
+    typedef loaded_description<id_type> loaded;
+    typedef basic_partitioned_nmos<id_type> engine;
+
+public:
+
+    partitioned_nmos_chip(const char *name,
+                          visual6502_netlist&& source,
+                          unsigned region_count):
+        named_nodes<id_type>(name, std::move(source)),
+        engine(loaded::description, region_count)
+    {}
+
+    virtual partition_report partitions() const final
+    {
+        return engine::report();
+    }
+
+    virtual bool get_node(unsigned id) const noexcept final
+    {
+        return engine::get_node(id);
+    }
+
+    virtual void set_node(unsigned id, bool value) noexcept final
+    {
+        engine::set_node(id, value);
+    }
+
+    virtual unsigned thread_count() const noexcept final
+    {
+        return unsigned(engine::report().regions.size());
+    }
+
+    virtual void set_thread_count(unsigned) final
+    {
+        throw std::logic_error("partitioned chip");
+    }
+
+    virtual ~partitioned_nmos_chip() {}
+};
+
+/* The size of the packed nodes of a netlist built from source, counting
+ * every transistor not gated by a rail - duplicates are left out of the
+ * netlist as well, thus the actual size can only be smaller.
+ */
+size_t
+packed_size_limit(const visual6502_netlist& source)
+{
+    typedef basic_netlist<uint16_t> layout;
+
+    const size_t entries_per_transistor =
+        layout::gate_entry_size + 2 * layout::sibling_entry_size;
+    size_t transistor_count = 0;
+    const uint32_t *t = source.transistors.data();
+
+    for (unsigned i = 0; i < source.transistor_count(); ++i, t += 3) {
+        if (t[0] != source.power and t[0] != source.ground) {
+            ++transistor_count;
+        }
+    }
+    return layout::header_size * size_t(source.node_count())
+           + entries_per_transistor * transistor_count;
+}
+
+/* The compact layout is used, when the netlist surely fits into it,
+ * see basic_netlist - decided before building anything, so the source
+ * is only converted once.
+ */
+template<template<typename> class chip_type, typename... arguments>
+nmos_chip *
+make_chip(const char *name, visual6502_netlist&& source, arguments... args)
+{
+    const unsigned compact_limit = std::numeric_limits<uint16_t>::max();
+
+    if (source.node_count() < compact_limit
+            and source.transistor_count() <= compact_limit
+            and packed_size_limit(source) < compact_limit)
+    {
+        return new chip_type<uint16_t>(name, std::move(source), args...);
+    }
+    return new chip_type<uint32_t>(name, std::move(source), args...);
+}
+
+}
+}
+
+nmos_chip *nmos_chip::load(const char *name,
+                           const char *transdefs_path,
+                           const char *segdefs_path,
+                           const char *nodenames_path)
+{
+    using namespace implementation;
+
+    return make_chip<implementation_nmos_chip>(
+        name,
+        load_visual6502(transdefs_path, segdefs_path, nodenames_path));
+}
+
+nmos_chip *nmos_chip::load_partitioned(const char *name,
+                                       const char *transdefs_path,
+                                       const char *segdefs_path,
+                                       const char *nodenames_path,
+                                       unsigned region_count)
+{
+    using namespace implementation;
+
+    return make_chip<partitioned_nmos_chip>(
+        name,
+        load_visual6502(transdefs_path, segdefs_path, nodenames_path),
+        region_count);
+}
+
+nmos_chip::~nmos_chip() {}
+
+}
@@ -0,0 +1,223 @@
+
+/* nmos_compiler
+ *
+ * Generates C++ code for evaluating the netlist in mos6502.inc
+ * with the nmos engine. The generated code contains two functions for
+ * each node:
+ *
+ *   group_add_<id>     - the recursive group search of nmos::group_add,
+ *                        with the positions of the transistors
+ *                        connecting the siblings in the transistor
+ *                        bitmap, and the ids of the siblings as constants
+ *
+ *   toggle_gates_<id>  - the loop over the gates in nmos::recalc_node,
+ *                        unrolled, with the resulting changes already
+ *                        ordered by node id, i.e. no heap is needed
+ *
+ * The output is included by mos6502_compiled.cc, see CMakeLists.txt
+ *
+ * usage: nmos_compiler > mos6502_compiled.inc
+ */
+
+#include "bit_vector.h"
+#include "netlist.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <vector>
+
+namespace chipemu
+{
+namespace implementation
+{
+
+#include "mos6502.inc"
+
+static const chip_description description =
+{
+    sizeof(pullups) / sizeof(pullups[0]),
+    pullups,
+    sizeof(transistors) / sizeof(transistors[0]),
+    transistors,
+    NODE::Vcc,
+    NODE::Vss
+};
+
+namespace
+{
+
+struct candidate
+{
+    uint16_t target;
+    uint16_t c1;
+    uint16_t c2;
+
+    bool operator<(const candidate& other) const
+    {
+        return target < other.target;
+    }
+};
+
+class compiler
+{
+    const netlist topology;
+    FILE *out;
+
+    bool is_rail(uint16_t id) const
+    {
+        return id == description.node_power or id == description.node_ground;
+    }
+
+    void emit_group_add(uint16_t id);
+    void emit_toggle_gates(uint16_t id);
+    void emit_table(const char *name, const char *type, const char *prefix);
+
+public:
+
+    compiler(FILE *output):
+        topology(description),
+        out(output)
+    {}
+
+    void run();
+};
+
+void
+compiler::emit_group_add(uint16_t id)
+{
+    fprintf(out, "static void\ngroup_add_%u(nmos& chip)\n{\n", id);
+    if (id == description.node_ground) {
+        fprintf(out, "    P::group_add_ground(chip);\n}\n\n");
+        return;
+    }
+    if (id == description.node_power) {
+        fprintf(out, "    P::group_add_power(chip);\n}\n\n");
+        return;
+    }
+
+    const uint16_t *node = topology.node(id);
+    const uint16_t *sibs = netlist::siblings(node);
+
+    if (netlist::sibling_count(node) > 0) {
+        fprintf(out, "    const uint64_t *on = P::transistor_on(chip);\n\n");
+    }
+    fprintf(out, "    if (P::flags(chip)[%u] & node_in_group) return;\n", id);
+    fprintf(out, "    P::group_add(chip, %u);\n", id);
+    for (uint16_t i = 0; i < netlist::sibling_count(node); ++i, sibs += 2) {
+        const uint16_t other = sibs[1];
+
+        fprintf(out, "    if (on[%zu] & 0x%" PRIx64 "u) ",
+                bit_vector::word_index(sibs[0]),
+                bit_vector::bit_mask(sibs[0]));
+        if (other == description.node_ground) {
+            fprintf(out, "P::group_add_ground(chip);\n");
+        }
+        else if (other == description.node_power) {
+            fprintf(out, "P::group_add_power(chip);\n");
+        }
+        else {
+            fprintf(out, "group_add_%u(chip);\n", other);
+        }
+    }
+    fprintf(out, "}\n\n");
+}
+
+void
+compiler::emit_toggle_gates(uint16_t id)
+{
+    const uint16_t *node = topology.node(id);
+    const uint16_t gate_count = netlist::gate_count(node);
+    const uint16_t *gate = netlist::gates(node);
+
+    if (gate_count == 0) return;
+
+    std::vector<candidate> on_changes;
+    std::vector<uint16_t> off_changes;
+
+    fprintf(out, "static void\ntoggle_gates_%u(nmos& chip, bool high)\n{\n",
+            id);
+    fprintf(out, "    uint8_t *flags = P::flags(chip);\n");
+    fprintf(out, "    uint64_t *on = P::transistor_on(chip);\n\n");
+    for (uint16_t i = 0; i < gate_count; ++i, gate += 3) {
+        const uint16_t c1 = gate[1];
+        const uint16_t c2 = gate[2];
+
+        fprintf(out, "    on[%zu] ^= 0x%" PRIx64 "u;\n",
+                bit_vector::word_index(gate[0]),
+                bit_vector::bit_mask(gate[0]));
+        on_changes.push_back({is_rail(c1) ? c2 : c1, c1, c2});
+        off_changes.push_back(c1);
+        off_changes.push_back(c2);
+    }
+
+    std::stable_sort(on_changes.begin(), on_changes.end());
+    std::sort(off_changes.begin(), off_changes.end());
+    off_changes.erase(std::unique(off_changes.begin(), off_changes.end()),
+                      off_changes.end());
+
+    fprintf(out, "    if (high) {\n");
+    for (auto change : on_changes) {
+        if (change.c1 == change.c2) continue;
+        fprintf(out, "        if ((flags[%u] ^ flags[%u]) & node_is_high) "
+                     "P::changed_push(chip, %u);\n",
+                change.c1, change.c2, change.target);
+    }
+    fprintf(out, "    }\n    else {\n");
+    for (auto target : off_changes) {
+        fprintf(out, "        P::changed_push(chip, %u);\n", target);
+    }
+    fprintf(out, "    }\n}\n\n");
+}
+
+void
+compiler::emit_table(const char *name, const char *type, const char *prefix)
+{
+    fprintf(out, "static %s const %s[] = {\n    nullptr", type, name);
+    for (uint16_t id = 1; id <= topology.node_count(); ++id) {
+        const uint16_t *node = topology.node(id);
+
+        if (prefix[0] == 't' and netlist::gate_count(node) == 0) {
+            fprintf(out, ",\n    toggle_gates_none");
+        }
+        else {
+            fprintf(out, ",\n    %s%u", prefix, id);
+        }
+    }
+    fprintf(out, "\n};\n\n");
+}
+
+void
+compiler::run()
+{
+    fprintf(out, "/* Generated by nmos_compiler - do not edit */\n\n");
+    for (uint16_t id = 1; id <= topology.node_count(); ++id) {
+        fprintf(out, "static void group_add_%u(nmos&);\n", id);
+    }
+    fprintf(out, "\n");
+    for (uint16_t id = 1; id <= topology.node_count(); ++id) {
+        emit_group_add(id);
+    }
+    fprintf(out, "static void\ntoggle_gates_none(nmos&, bool)\n{\n}\n\n");
+    for (uint16_t id = 1; id <= topology.node_count(); ++id) {
+        emit_toggle_gates(id);
+    }
+    emit_table("group_add_table", "group_add_function", "group_add_");
+    emit_table("toggle_gates_table", "toggle_gates_function",
+               "toggle_gates_");
+    fprintf(out, "static constexpr size_t packed_size = %zu;\n",
+            topology.packed_size());
+    fprintf(out, "static constexpr uint32_t packed_checksum = 0x%08" PRIx32
+                 ";\n", topology.checksum());
+}
+
+}
+
+}
+}
+
+int main()
+{
+    chipemu::implementation::compiler(stdout).run();
+    return 0;
+}
@@ -0,0 +1,531 @@
+
+#include "nmos_parallel.h"
+
+#include "nmos_primitives.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace chipemu
+{
+namespace implementation
+{
+
+namespace
+{
+
+/* The flags of nodes, and the state of transistors are read by the
+ * worker threads, while the committing thread writes them.
+ */
+template<typename T>
+inline T
+load_relaxed(const T& value)
+{
+    return __atomic_load_n(&value, __ATOMIC_RELAXED);
+}
+
+template<typename T>
+inline void
+store_relaxed(T& target, T value)
+{
+    __atomic_store_n(&target, value, __ATOMIC_RELAXED);
+}
+
+/* Fewer changed nodes than min_batch are not worth waking up
+ * the workers for. The larger a batch, the more groups are built in
+ * vain, since any group committed invalidates the groups touching it
+ * later in the same batch.
+ */
+constexpr size_t min_batch = 64;
+constexpr size_t max_batch = 1024;
+
+}
+
+template<typename id_type>
+class parallel_recalc<id_type>::pool
+{
+    typedef basic_nmos<id_type> nmos_type;
+    typedef typename nmos_type::group_contains group_contains;
+    typedef basic_netlist<id_type> netlist;
+    typedef typename netlist::change_entry change_entry;
+
+    struct group
+    {
+        std::vector<id_type> members;
+        group_contains value;
+        bool built;
+    };
+
+    /* The nodes already added to the group being built are marked
+     * in visited - the node_in_group flag can not be used by the workers.
+     * There is one builder for each thread, the last one belongs
+     * to the thread calling recalc.
+     */
+    struct builder
+    {
+        std::vector<uint32_t> visited;
+        uint32_t mark;
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<builder> builders;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned long long generation;
+    unsigned running;
+    bool stopping;
+
+    nmos_type *chip;
+    std::vector<id_type> batch;
+    size_t batch_size;
+    std::vector<group> groups;
+    std::unique_ptr<std::atomic<bool>[]> ready;
+    std::atomic<size_t> next;
+
+    /* nodes touched by the groups committed in the current batch are
+     * marked with the current epoch
+     */
+    std::vector<uint32_t> touched;
+    uint32_t epoch;
+
+    /* nodes already in a group built in the current batch are claimed
+     * with the current epoch, no group is built for those - in the serial
+     * engine, such nodes are already settled, when they are popped
+     */
+    std::unique_ptr<std::atomic<uint32_t>[]> claims;
+    size_t claims_size;
+
+    void add(builder&, id_type id, group&);
+    void build(builder&, id_type id, group&);
+    void speculate(size_t index, builder&);
+    bool is_valid(const group&) const;
+    void push(id_type id);
+    void commit(id_type id, const group&);
+    void run_batch(size_t size);
+    void work(unsigned index);
+    void stop();
+    void reset_claims();
+    void prepare(nmos_type&);
+
+    /* the groups built by the calling thread, when not using a group
+     * built by a worker
+     */
+    group scratch;
+
+public:
+
+    const unsigned count;
+
+    explicit pool(unsigned thread_count);
+    ~pool();
+
+    void recalc(nmos_type&);
+};
+
+template<typename id_type>
+parallel_recalc<id_type>::pool::pool(unsigned thread_count):
+    builders(thread_count),
+    generation(0),
+    running(0),
+    stopping(false),
+    chip(nullptr),
+    batch(max_batch),
+    batch_size(0),
+    groups(max_batch),
+    ready(new std::atomic<bool>[max_batch]),
+    next(0),
+    epoch(0),
+    claims_size(0),
+    count(thread_count)
+{
+    try {
+        for (unsigned i = 0; i + 1 < count; ++i) {
+            threads.emplace_back(&pool::work, this, i);
+        }
+    }
+    catch (...) {
+        stop();
+        throw;
+    }
+}
+
+template<typename id_type>
+parallel_recalc<id_type>::pool::~pool()
+{
+    stop();
+}
+
+template<typename id_type>
+void
+parallel_recalc<id_type>::pool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+}
+
+/* The same as basic_nmos::group_add, visiting nodes in the same order */
+template<typename id_type>
+void
+parallel_recalc<id_type>::pool::add(builder& b, id_type id, group& g)
+{
+    if (id == chip->ground) {
+        g.value = group_contains::ground;
+    }
+    else if (id == chip->power) {
+        if (g.value != group_contains::ground) {
+            g.value = group_contains::power;
+        }
+    }
+    else if (b.visited[id] != b.mark) {
+        const id_type *node = chip->topology->node(id);
+
+        b.visited[id] = b.mark;
+        claims[id].store(epoch, std::memory_order_relaxed);
+        g.members.push_back(id);
+        nmos_type::update_group_value(g.value, load_relaxed(chip->flags[id]));
+
+        id_type sibling_count = netlist::sibling_count(node);
+        const id_type *sibs = netlist::siblings(node);
+        for (id_type i = 0; i < sibling_count; ++i, sibs += 2) {
+            if (load_relaxed(chip->transistor_on.word(sibs[0]))
+                    & bit_vector::bit_mask(sibs[0]))
+            {
+                add(b, sibs[1], g);
+            }
+        }
+    }
+}
+
+template<typename id_type>
+void
+parallel_recalc<id_type>::pool::build(builder& b, id_type id, group& g)
+{
+    if (++b.mark == 0) {
+        std::fill(b.visited.begin(), b.visited.end(), 0);
+        b.mark = 1;
+    }
+    g.members.clear();
+    g.value = group_contains::nothing;
+    add(b, id, g);
+    g.built = true;
+}
+
+template<typename id_type>
+void
+parallel_recalc<id_type>::pool::speculate(size_t index, builder& b)
+{
+    const id_type id = batch[index];
+    group& g = groups[index];
+
+    if ((load_relaxed(chip->flags[id]) & node_in_changelist)
+            and claims[id].load(std::memory_order_relaxed) != epoch)
+    {
+        build(b, id, g);
+    }
+    else {
+        g.built = false;
+    }
+    ready[index].store(true, std::memory_order_release);
+}
+
+template<typename id_type>
+bool
+parallel_recalc<id_type>::pool::is_valid(const group& g) const
+{
+    if (not g.built) return false;
+    for (id_type id : g.members) {
+        if (touched[id] == epoch) return false;
+    }
+    return true;
+}
+
+/* basic_nmos::changed_push */
+template<typename id_type>
+void
+parallel_recalc<id_type>::pool::push(id_type id)
+{
+    uint8_t& flags = chip->flags[id];
+
+    if (flags & node_in_changelist) return;
+
+    chip->changed_queue[chip->changed_feeding] = id;
+    chip->changed_feeding =
+        (chip->changed_feeding + 1) & (chip->changed_queue.size() - 1);
+    if (chip->changed_feeding == chip->changed_eating) {
+        chip->changed_queue_grow();
+    }
+    store_relaxed(flags, uint8_t(flags | node_in_changelist));
+}
+
+/* The second half of basic_nmos::recalc_node, marking every node whose
+ * value changed, and both legs of every transistor toggled.
+ */
+template<typename id_type>
+void
+parallel_recalc<id_type>::pool::commit(id_type id, const group& g)
+{
+    std::vector<uint8_t>& flags = chip->flags;
+    bit_vector& transistor_on = chip->transistor_on;
+    const uint8_t high_value = nmos_type::is_high(g.value) ? node_is_high : 0;
+
+    store_relaxed(flags[id], uint8_t(flags[id] & ~node_in_changelist));
+    for (id_type member : g.members) {
+        store_relaxed(flags[member],
+                      uint8_t(flags[member] & ~node_in_changelist));
+    }
+    chip->evaluated_nodes += g.members.size();
+    CHIPEMU_STATS(count_group(chip->counters, g.members.size()));
+
+    for (size_t index = g.members.size(); index-- > 0; ) {
+        const id_type gid = g.members[index];
+
+        if ((flags[gid] & node_is_high) == high_value) continue;
+
+        store_relaxed(flags[gid], uint8_t(flags[gid] ^ node_is_high));
+        touched[gid] = epoch;
+
+        const id_type *node = chip->topology->node(gid);
+        id_type gate_count = netlist::gate_count(node);
+        const id_type *gate = netlist::gates(node);
+
+        CHIPEMU_STATS(chip->counters.transistors_toggled += gate_count);
+        CHIPEMU_STATS(chip->count_toggle(gid));
+        for (id_type i = 0; i < gate_count; ++i, gate += 3) {
+            uint64_t& word = transistor_on.word(gate[0]);
+
+            store_relaxed(word, uint64_t(word ^ bit_vector::bit_mask(gate[0])));
+            touched[gate[1]] = epoch;
+            touched[gate[2]] = epoch;
+        }
+
+        /* the same as basic_nmos::queue_changes */
+        const change_entry *end = chip->topology->changes_end(gid);
+
+        for (const change_entry *entry = chip->topology->changes_begin(gid);
+             entry != end;
+             ++entry)
+        {
+            if (high_value) {
+                if (not entry->on_high) continue;
+                if ((flags[entry->node] & node_is_high)
+                        == (flags[entry->other_leg] & node_is_high))
+                {
+                    continue;
+                }
+            }
+            CHIPEMU_STATS(++chip->counters.ordered_changes);
+            push(entry->node);
+        }
+    }
+}
+
+/* Runs on the calling thread, commits the nodes in the batch
+ * in order, building the groups the workers did not get to yet.
+ */
+template<typename id_type>
+void
+parallel_recalc<id_type>::pool::run_batch(size_t size)
+{
+    builder& own = builders.back();
+
+    for (size_t index = 0; index < size; ++index) {
+        const id_type id = batch[index];
+
+        CHIPEMU_STATS(++chip->counters.nodes_popped);
+        if (not (chip->flags[id] & node_in_changelist)) {
+            CHIPEMU_STATS(++chip->counters.nodes_settled);
+            continue;
+        }
+        while (not ready[index].load(std::memory_order_acquire)) {
+            size_t other = next.fetch_add(1);
+
+            if (other < size) {
+                speculate(other, own);
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+        if (is_valid(groups[index])) {
+            commit(id, groups[index]);
+        }
+        else {
+            build(own, id, scratch);
+            commit(id, scratch);
+        }
+    }
+}
+
+template<typename id_type>
+void
+parallel_recalc<id_type>::pool::work(unsigned index)
+{
+    unsigned long long seen = 0;
+    builder& own = builders[index];
+
+    while (true) {
+        size_t size;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            wake.wait(lock, [&] { return stopping or generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            size = batch_size;
+        }
+        for (size_t i = next.fetch_add(1); i < size; i = next.fetch_add(1)) {
+            speculate(i, own);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (--running == 0) {
+                done.notify_one();
+            }
+        }
+    }
+}
+
+template<typename id_type>
+void
+parallel_recalc<id_type>::pool::reset_claims()
+{
+    for (size_t i = 0; i < claims_size; ++i) {
+        claims[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+template<typename id_type>
+void
+parallel_recalc<id_type>::pool::prepare(nmos_type& target)
+{
+    const size_t node_count = target.node_count() + 1;
+
+    chip = &target;
+    if (touched.size() != node_count) {
+        touched.assign(node_count, 0);
+        claims.reset(new std::atomic<uint32_t>[node_count]);
+        claims_size = node_count;
+        reset_claims();
+        for (builder& b : builders) {
+            b.visited.assign(node_count, 0);
+            b.mark = 0;
+        }
+    }
+}
+
+template<typename id_type>
+void
+parallel_recalc<id_type>::pool::recalc(nmos_type& target)
+{
+    prepare(target);
+    while (chip->changed_eating != chip->changed_feeding) {
+        const size_t mask = chip->changed_queue.size() - 1;
+        const size_t length = (chip->changed_feeding - chip->changed_eating)
+                              & mask;
+
+        CHIPEMU_STATS(count_queue_length(chip->counters, length));
+        if (length < min_batch) {
+            const id_type id = chip->changed_queue[chip->changed_eating];
+
+            chip->changed_eating = (chip->changed_eating + 1) & mask;
+            CHIPEMU_STATS(++chip->counters.nodes_popped);
+            if (chip->flags[id] & node_in_changelist) {
+                build(builders.back(), id, scratch);
+                commit(id, scratch);
+            }
+            else {
+                CHIPEMU_STATS(++chip->counters.nodes_settled);
+            }
+            continue;
+        }
+
+        const size_t size = std::min(length, max_batch);
+
+        for (size_t i = 0; i < size; ++i) {
+            batch[i] = chip->changed_queue[(chip->changed_eating + i) & mask];
+            ready[i].store(false, std::memory_order_relaxed);
+        }
+        chip->changed_eating = (chip->changed_eating + size) & mask;
+        if (++epoch == 0) {
+            std::fill(touched.begin(), touched.end(), 0);
+            reset_claims();
+            epoch = 1;
+        }
+        next.store(0, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            batch_size = size;
+            running = unsigned(threads.size());
+            ++generation;
+        }
+        wake.notify_all();
+
+        run_batch(size);
+
+        std::unique_lock<std::mutex> lock(mutex);
+
+        done.wait(lock, [&] { return running == 0; });
+    }
+}
+
+template<typename id_type>
+parallel_recalc<id_type>::parallel_recalc(unsigned thread_count)
+{
+    set_thread_count(thread_count);
+}
+
+template<typename id_type>
+parallel_recalc<id_type>::parallel_recalc(const parallel_recalc& other):
+    parallel_recalc(other.thread_count())
+{}
+
+template<typename id_type>
+parallel_recalc<id_type>::~parallel_recalc()
+{}
+
+template<typename id_type>
+unsigned
+parallel_recalc<id_type>::thread_count() const noexcept
+{
+    return workers ? workers->count : 1;
+}
+
+template<typename id_type>
+void
+parallel_recalc<id_type>::set_thread_count(unsigned thread_count)
+{
+    workers.reset();
+    if (thread_count > 1) {
+        workers.reset(new pool(thread_count));
+    }
+}
+
+template<typename id_type>
+void
+parallel_recalc<id_type>::recalc(basic_nmos<id_type>& chip) noexcept
+{
+    workers->recalc(chip);
+}
+
+template class parallel_recalc<uint16_t>;
+template class parallel_recalc<uint32_t>;
+
+}
+}
@@ -0,0 +1,63 @@
+
+#ifndef CHIPEMU_NMOS_PARALLEL_H
+#define CHIPEMU_NMOS_PARALLEL_H
+
+#include <memory>
+
+namespace chipemu
+{
+namespace implementation
+{
+
+template<typename id_type> class basic_nmos;
+
+/* The multi-threaded mode of basic_nmos::recalc
+ *
+ * The result of a switch level simulation depends on the order groups are
+ * evaluated in, thus groups can not be committed in parallel without
+ * changing the results. Instead, the queue of changed nodes is processed
+ * in batches: the groups of the nodes in a batch are built by worker
+ * threads in parallel - speculatively, from the state at the start of the
+ * batch - while the calling thread commits them one by one, in queue
+ * order. A group is only used, if none of its nodes were touched by the
+ * groups committed before it in the same batch, otherwise it is rebuilt
+ * from the current state. The final state is therefore always identical
+ * to the one computed by the serial engine.
+ *
+ * Workers take the next node from the batch using a shared atomic index.
+ * The committing thread takes nodes from the same index, whenever the
+ * node it needs next was not taken yet.
+ *
+ * Copying a parallel_recalc starts a new set of threads.
+ */
+template<typename id_type>
+class parallel_recalc
+{
+public:
+
+    explicit parallel_recalc(unsigned thread_count = 1);
+    parallel_recalc(const parallel_recalc&);
+    parallel_recalc& operator=(const parallel_recalc&) = delete;
+    ~parallel_recalc();
+
+    /* 1 means no worker threads, recalc is done by the serial engine */
+    unsigned thread_count() const noexcept;
+    void set_thread_count(unsigned);
+
+    bool enabled() const noexcept
+    {
+        return workers != nullptr;
+    }
+
+    void recalc(basic_nmos<id_type>&) noexcept;
+
+private:
+
+    class pool;
+    std::unique_ptr<pool> workers;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,1154 @@
+#include "nmos_partitioned.h"
+
+#include "bit_vector.h"
+#include "nmos_primitives.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using std::vector;
+
+namespace chipemu
+{
+namespace implementation
+{
+
+namespace
+{
+
+/* Regions mostly wait for each other for a short time, thus a barrier
+ * spins for a while, before going to sleep - unless there are more
+ * threads than cores.
+ *
+ * The outboxes need no lock-free queues: an outbox is only written by the
+ * thread of its region before the barrier, and only read by the thread of
+ * the receiving region after it, thus the barrier is the only point where
+ * the threads synchronize - its mutex, and condition variable are only
+ * touched by threads going to sleep.
+ */
+constexpr unsigned spin_limit = 4096;
+
+/* The number of rounds a recalc is expected to take at most, in addition
+ * to one round for every node - a recalc taking more rounds than that is
+ * assumed to oscillate.
+ */
+constexpr unsigned simultaneous_rounds = 256;
+
+class spin_barrier
+{
+    std::atomic<unsigned> waiting;
+    std::atomic<unsigned> phase;
+    std::atomic<unsigned> sleeping;
+    std::mutex mutex;
+    std::condition_variable wake;
+    const unsigned count;
+    const unsigned spins;
+
+public:
+
+    explicit spin_barrier(unsigned thread_count):
+        waiting(0),
+        phase(0),
+        sleeping(0),
+        count(thread_count),
+        spins(thread_count <= std::thread::hardware_concurrency()
+              ? spin_limit : 0)
+    {}
+
+    void wait()
+    {
+        const unsigned current = phase.load(std::memory_order_acquire);
+
+        if (waiting.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+            waiting.store(0, std::memory_order_relaxed);
+            phase.store(current + 1);
+            if (sleeping.load() > 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                wake.notify_all();
+            }
+            return;
+        }
+        for (unsigned i = 0; i < spins; ++i) {
+            if (phase.load(std::memory_order_acquire) != current) return;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+
+        sleeping.fetch_add(1);
+        wake.wait(lock, [&] { return phase.load() != current; });
+        sleeping.fetch_sub(1);
+    }
+};
+
+void
+add_stats(chip_stats& total, const chip_stats& part)
+{
+    total.nodes_popped += part.nodes_popped;
+    total.nodes_settled += part.nodes_settled;
+    total.groups += part.groups;
+    for (unsigned i = 0; i < chip_stats::group_size_buckets; ++i) {
+        total.group_sizes[i] += part.group_sizes[i];
+    }
+    total.transistors_toggled += part.transistors_toggled;
+    total.ordered_changes += part.ordered_changes;
+    total.glitches += part.glitches;
+    total.changed_queue_high_water = std::max(total.changed_queue_high_water,
+                                              part.changed_queue_high_water);
+    total.group_high_water = std::max(total.group_high_water,
+                                      part.group_high_water);
+}
+
+/* Threads simulating regions are only pinned to cores,
+ * when each of them can have a core of its own.
+ */
+void
+pin_to_core(unsigned core, unsigned thread_count)
+{
+#ifdef __linux__
+    if (thread_count > std::thread::hardware_concurrency()) return;
+
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)core;
+    (void)thread_count;
+#endif
+}
+
+}
+
+/* The state, and the topology of one region, all node ids, and transistor
+ * indices are local to the region. The nodes of the region are numbered
+ * 0 .. n-1, power, and ground are n, and n+1.
+ *
+ * The nodes gating transistors of other regions are exported: for every
+ * destination region, such nodes are numbered in local order, and the
+ * destination imports them using the same numbers.
+ */
+template<typename id_type>
+class basic_partitioned_nmos<id_type>::region
+{
+    typedef basic_nmos<id_type> engine;
+    typedef typename engine::group_contains group_contains;
+
+    struct sibling
+    {
+        uint32_t transistor;
+        uint32_t node;
+    };
+
+    struct export_entry
+    {
+        uint32_t region;
+        uint32_t index;
+    };
+
+    void journal_node(uint32_t id);
+    void group_add(uint32_t id);
+    void toggle(uint32_t transistor, bool high);
+    void commit_ordered_changes();
+    void recalc_node(uint32_t id);
+
+public:
+
+    struct boundary_change
+    {
+        uint32_t index;
+        uint32_t high;
+    };
+
+    const uint32_t power;
+    const uint32_t ground;
+
+    /* local node id -> node id, local transistor -> transistor index */
+    vector<uint32_t> node_ids;
+    vector<uint32_t> transistor_ids;
+
+    vector<uint8_t> flags;
+    bit_vector transistor_on;
+
+    vector<uint32_t> transistor_c1;
+    vector<uint32_t> transistor_c2;
+    vector<uint32_t> gate_offsets;
+    vector<uint32_t> gates;
+    vector<uint32_t> sibling_offsets;
+    vector<sibling> siblings;
+    vector<uint32_t> export_offsets;
+    vector<export_entry> exports;
+
+    /* indexed by the source region, transistors gated by imported nodes */
+    vector<vector<uint32_t>> import_offsets;
+    vector<vector<uint32_t>> imports;
+
+    /* indexed by the destination region */
+    vector<vector<boundary_change>> outboxes;
+
+    std::deque<uint32_t> changed_queue;
+
+    vector<uint32_t> current_group;
+    size_t group_tail;
+    group_contains group_value;
+    vector<uint32_t> change_order;
+    size_t change_count;
+
+    unsigned long long evaluated_nodes;
+    chip_stats counters;
+
+    /* the recalc() call each node last toggled in, for counting glitches,
+     * only used with CHIPEMU_ENABLE_STATS
+     */
+    vector<uint32_t> toggle_epochs;
+    uint32_t recalc_epoch;
+
+    /* The previous state of the nodes, and transistors changed since
+     * the start of the current recalc, while journaling is set.
+     * An entry is only added at the first change, the one marked with
+     * the current epoch in the stamps.
+     */
+    bool journaling;
+    uint32_t epoch;
+    vector<uint32_t> node_stamps;
+    vector<uint32_t> transistor_stamps;
+    vector<std::pair<uint32_t, uint8_t>> node_journal;
+    vector<std::pair<uint32_t, bool>> transistor_journal;
+    std::deque<uint32_t> saved_queue;
+
+    region(const basic_partitioned_nmos&,
+           const vector<transistor_legs>&,
+           const vector<uint32_t>& local_transistor,
+           uint32_t index);
+
+    bool push(uint32_t id);
+    void enqueue(uint32_t id);
+    void step();
+    void next_recalc_epoch();
+    void begin_journal();
+    void end_journal();
+    void rollback();
+    void apply(uint32_t source, const vector<boundary_change>&);
+    size_t outbox_size() const;
+    void clear_outboxes();
+};
+
+template<typename id_type>
+basic_partitioned_nmos<id_type>::region::region(
+        const basic_partitioned_nmos& chip,
+        const vector<transistor_legs>& legs,
+        const vector<uint32_t>& local_transistor,
+        uint32_t index):
+    power(uint32_t(std::count(chip.layout.node_region.begin() + 1,
+                              chip.layout.node_region.end(), index))
+          - (index == 0 ? 2 : 0)),
+    ground(power + 1),
+    group_tail(0),
+    group_value(group_contains::nothing),
+    change_count(0),
+    evaluated_nodes(0),
+    counters(empty_stats()),
+    recalc_epoch(0),
+    journaling(false),
+    epoch(0)
+{
+    const netlist& topology = *chip.topology;
+    const vector<uint32_t>& node_region = chip.layout.node_region;
+    const vector<uint32_t>& transistor_region = chip.layout.transistor_region;
+    const unsigned region_count = unsigned(chip.layout.report.regions.size());
+    auto is_rail = [&](uint32_t id) {
+        return id == chip.power or id == chip.ground;
+    };
+    auto local = [&](uint32_t id) {
+        if (id == chip.power) return power;
+        if (id == chip.ground) return ground;
+        return chip.local_id[id];
+    };
+
+    for (uint32_t id = 1; id <= topology.node_count(); ++id) {
+        if (node_region[id] == index and not is_rail(id)) {
+            node_ids.push_back(id);
+        }
+    }
+    for (uint32_t t = 0; t < legs.size(); ++t) {
+        if (transistor_region[t] == index) {
+            transistor_ids.push_back(t);
+            transistor_c1.push_back(local(legs[t].c1));
+            transistor_c2.push_back(local(legs[t].c2));
+        }
+    }
+
+    flags.resize(power + 2);
+    for (uint32_t i = 0; i < power; ++i) {
+        flags[i] = topology.is_pullup(id_type(node_ids[i])) ? node_is_pullup : 0;
+    }
+    flags[power] = node_is_high;
+    transistor_on.resize(transistor_ids.size());
+
+    /* the gates, siblings, and exports of the nodes of this region */
+    vector<uint32_t> export_counts(region_count, 0);
+    size_t max_gates = 0;
+
+    gate_offsets.push_back(0);
+    sibling_offsets.push_back(0);
+    export_offsets.push_back(0);
+    for (uint32_t id : node_ids) {
+        const id_type *node = topology.node(id_type(id));
+        const id_type *gate = netlist::gates(node);
+        const id_type *sibs = netlist::siblings(node);
+        const size_t first_export = exports.size();
+
+        for (id_type i = 0; i < netlist::gate_count(node); ++i) {
+            const uint32_t t = gate[0];
+            const uint32_t destination = transistor_region[t];
+
+            if (destination == index) {
+                gates.push_back(local_transistor[t]);
+            }
+            else if (std::none_of(exports.begin() + first_export, exports.end(),
+                                  [&](const export_entry& e) {
+                                      return e.region == destination;
+                                  }))
+            {
+                exports.push_back({destination, export_counts[destination]++});
+            }
+            gate += netlist::gate_entry_size;
+        }
+        for (id_type i = 0; i < netlist::sibling_count(node); ++i) {
+            siblings.push_back({local_transistor[sibs[0]], local(sibs[1])});
+            sibs += netlist::sibling_entry_size;
+        }
+        max_gates = std::max<size_t>(max_gates, gates.size() - gate_offsets.back());
+        gate_offsets.push_back(uint32_t(gates.size()));
+        sibling_offsets.push_back(uint32_t(siblings.size()));
+        export_offsets.push_back(uint32_t(exports.size()));
+    }
+
+    /* the nodes of other regions gating transistors of this region,
+     * numbered the same way as the exports of those regions
+     */
+    import_offsets.assign(region_count, vector<uint32_t>(1, 0));
+    imports.resize(region_count);
+    for (uint32_t id = 1; id <= topology.node_count(); ++id) {
+        const uint32_t source = node_region[id];
+
+        if (source == index or is_rail(id)) continue;
+
+        const id_type *node = topology.node(id_type(id));
+        const id_type *gate = netlist::gates(node);
+        vector<uint32_t>& list = imports[source];
+
+        for (id_type i = 0; i < netlist::gate_count(node); ++i) {
+            if (transistor_region[gate[0]] == index) {
+                list.push_back(local_transistor[gate[0]]);
+            }
+            gate += netlist::gate_entry_size;
+        }
+        if (list.size() != import_offsets[source].back()) {
+            max_gates = std::max<size_t>(max_gates,
+                                         list.size() - import_offsets[source].back());
+            import_offsets[source].push_back(uint32_t(list.size()));
+        }
+    }
+
+    outboxes.resize(region_count);
+    CHIPEMU_STATS(toggle_epochs.resize(power, 0));
+    node_stamps.resize(power, 0);
+    transistor_stamps.resize(transistor_ids.size(), 0);
+    current_group.resize(power);
+    change_order.resize(2 * max_gates);
+}
+
+/* Queues a node regardless of its node_in_changelist flag,
+ * used when restoring a snapshot
+ */
+template<typename id_type>
+inline void
+basic_partitioned_nmos<id_type>::region::enqueue(uint32_t id)
+{
+    changed_queue.push_back(id);
+}
+
+template<typename id_type>
+inline void
+basic_partitioned_nmos<id_type>::region::journal_node(uint32_t id)
+{
+    if (journaling and node_stamps[id] != epoch) {
+        node_stamps[id] = epoch;
+        node_journal.emplace_back(id, flags[id]);
+    }
+}
+
+/* Power, and ground are never queued, their groups are always empty */
+template<typename id_type>
+inline bool
+basic_partitioned_nmos<id_type>::region::push(uint32_t id)
+{
+    if (id >= power or (flags[id] & node_in_changelist)) return false;
+
+    journal_node(id);
+    changed_queue.push_back(id);
+    flags[id] |= node_in_changelist;
+    return true;
+}
+
+/* The same as basic_nmos::group_add */
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::region::group_add(uint32_t id)
+{
+    if (id == ground) {
+        group_value = group_contains::ground;
+    }
+    else if (id == power) {
+        if (group_value != group_contains::ground) {
+            group_value = group_contains::power;
+        }
+    }
+    else if (not (flags[id] & node_in_group)) {
+        journal_node(id);
+        flags[id] |= node_in_group;
+        flags[id] &= ~node_in_changelist;
+        current_group[group_tail++] = id;
+        engine::update_group_value(group_value, flags[id]);
+        for (uint32_t i = sibling_offsets[id]; i < sibling_offsets[id + 1]; ++i) {
+            if (transistor_on[siblings[i].transistor]) {
+                group_add(siblings[i].node);
+            }
+        }
+    }
+}
+
+template<typename id_type>
+inline void
+basic_partitioned_nmos<id_type>::region::toggle(uint32_t t, bool high)
+{
+    const uint32_t c1 = transistor_c1[t];
+    const uint32_t c2 = transistor_c2[t];
+
+    if (journaling and transistor_stamps[t] != epoch) {
+        transistor_stamps[t] = epoch;
+        transistor_journal.emplace_back(t, transistor_on[t]);
+    }
+    transistor_on.flip(t);
+    if (high) {
+        if ((flags[c1] & node_is_high) == (flags[c2] & node_is_high)) {
+            return;
+        }
+        change_order[change_count++] = (c1 < power) ? c1 : c2;
+    }
+    else {
+        change_order[change_count++] = c1;
+        change_order[change_count++] = c2;
+    }
+}
+
+/* Local node ids are in ascending node id order, thus sorting them
+ * yields the order of basic_nmos::queue_changes.
+ */
+template<typename id_type>
+inline void
+basic_partitioned_nmos<id_type>::region::commit_ordered_changes()
+{
+    CHIPEMU_STATS(counters.ordered_changes += change_count);
+    std::sort(change_order.begin(), change_order.begin() + change_count);
+    for (size_t i = 0; i < change_count; ++i) {
+        push(change_order[i]);
+    }
+    change_count = 0;
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::region::recalc_node(uint32_t id)
+{
+    CHIPEMU_STATS(++counters.nodes_popped);
+    if (not (flags[id] & node_in_changelist)) {
+        CHIPEMU_STATS(++counters.nodes_settled);
+        return;
+    }
+    journal_node(id);
+    flags[id] &= ~node_in_changelist;
+    group_tail = 0;
+    group_value = group_contains::nothing;
+    group_add(id);
+    evaluated_nodes += group_tail;
+    CHIPEMU_STATS(count_group(counters, group_tail));
+
+    const bool high = engine::is_high(group_value);
+    const uint8_t high_value = high ? node_is_high : 0;
+
+    while (group_tail > 0) {
+        const uint32_t gid = current_group[--group_tail];
+
+        flags[gid] &= ~node_in_group;
+        if ((flags[gid] & node_is_high) == high_value) continue;
+
+        flags[gid] ^= node_is_high;
+        CHIPEMU_STATS(counters.transistors_toggled +=
+                      gate_offsets[gid + 1] - gate_offsets[gid]);
+        CHIPEMU_STATS(if (toggle_epochs[gid] == recalc_epoch) {
+                          ++counters.glitches;
+                      }
+                      toggle_epochs[gid] = recalc_epoch);
+        for (uint32_t i = gate_offsets[gid]; i < gate_offsets[gid + 1]; ++i) {
+            toggle(gates[i], high);
+        }
+        commit_ordered_changes();
+        for (uint32_t i = export_offsets[gid]; i < export_offsets[gid + 1]; ++i) {
+            outboxes[exports[i].region].push_back({exports[i].index, high});
+        }
+    }
+}
+
+/* Evaluates the nodes queued before the current round, the nodes queued
+ * by those are left for the next round - the same generations of nodes
+ * the queue of basic_nmos is processed in.
+ */
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::region::step()
+{
+    CHIPEMU_STATS(count_queue_length(counters, changed_queue.size()));
+    for (size_t count = changed_queue.size(); count > 0; --count) {
+        const uint32_t id = changed_queue.front();
+
+        changed_queue.pop_front();
+        recalc_node(id);
+    }
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::region::next_recalc_epoch()
+{
+    if (++recalc_epoch == 0) {
+        std::fill(toggle_epochs.begin(), toggle_epochs.end(), 0);
+        recalc_epoch = 1;
+    }
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::region::begin_journal()
+{
+    if (++epoch == 0) {
+        std::fill(node_stamps.begin(), node_stamps.end(), 0);
+        std::fill(transistor_stamps.begin(), transistor_stamps.end(), 0);
+        epoch = 1;
+    }
+    node_journal.clear();
+    transistor_journal.clear();
+    saved_queue = changed_queue;
+    journaling = true;
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::region::end_journal()
+{
+    journaling = false;
+}
+
+/* Restores the state saved at begin_journal */
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::region::rollback()
+{
+    for (const std::pair<uint32_t, uint8_t>& entry : node_journal) {
+        flags[entry.first] = entry.second;
+    }
+    for (const std::pair<uint32_t, bool>& entry : transistor_journal) {
+        transistor_on.set(entry.first, entry.second);
+    }
+    changed_queue.swap(saved_queue);
+    clear_outboxes();
+    end_journal();
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::region::apply(
+        uint32_t source,
+        const vector<boundary_change>& inbox)
+{
+    const vector<uint32_t>& offsets = import_offsets[source];
+    const vector<uint32_t>& list = imports[source];
+
+    for (const boundary_change& change : inbox) {
+        CHIPEMU_STATS(counters.transistors_toggled +=
+                      offsets[change.index + 1] - offsets[change.index]);
+        for (uint32_t i = offsets[change.index];
+             i < offsets[change.index + 1];
+             ++i)
+        {
+            toggle(list[i], change.high != 0);
+        }
+        commit_ordered_changes();
+    }
+}
+
+template<typename id_type>
+size_t
+basic_partitioned_nmos<id_type>::region::outbox_size() const
+{
+    size_t size = 0;
+
+    for (const vector<boundary_change>& outbox : outboxes) {
+        size += outbox.size();
+    }
+    return size;
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::region::clear_outboxes()
+{
+    for (vector<boundary_change>& outbox : outboxes) {
+        outbox.clear();
+    }
+}
+
+/* The threads simulating the regions, one for each region except
+ * region zero, which is simulated by the thread calling recalc.
+ * Each thread builds its own region, so the memory of the region is
+ * allocated close to the core running the thread.
+ */
+template<typename id_type>
+class basic_partitioned_nmos<id_type>::pool
+{
+    const basic_partitioned_nmos& chip;
+    const vector<transistor_legs> *legs;
+    const vector<uint32_t> *local_transistor;
+
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned long long generation;
+    unsigned running;
+    bool stopping;
+    std::exception_ptr failure;
+
+    spin_barrier barrier;
+    const unsigned round_limit;
+
+    /* the number of changes sent, and nodes queued in the current round,
+     * and in the previous one - the counter of the previous round is reset
+     * while the current one is counted
+     */
+    std::atomic<size_t> pending[2];
+
+    void build(unsigned index);
+    bool simulate(unsigned index);
+    void work(unsigned index);
+    void stop();
+    void wait_for_threads();
+
+public:
+
+    vector<std::unique_ptr<region>> parts;
+
+    pool(const basic_partitioned_nmos&,
+         const vector<transistor_legs>&,
+         const vector<uint32_t>& local_transistor);
+    ~pool();
+
+    bool recalc();
+};
+
+template<typename id_type>
+basic_partitioned_nmos<id_type>::pool::pool(
+        const basic_partitioned_nmos& target,
+        const vector<transistor_legs>& transistor_legs,
+        const vector<uint32_t>& local_transistor_index):
+    chip(target),
+    legs(&transistor_legs),
+    local_transistor(&local_transistor_index),
+    generation(0),
+    running(0),
+    stopping(false),
+    barrier(unsigned(target.layout.report.regions.size())),
+    round_limit(simultaneous_rounds + target.node_count()),
+    parts(target.layout.report.regions.size())
+{
+    pending[0].store(0, std::memory_order_relaxed);
+    pending[1].store(0, std::memory_order_relaxed);
+    try {
+        for (unsigned i = 1; i < parts.size(); ++i) {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            threads.emplace_back(&pool::work, this, i);
+            ++running;
+        }
+        build(0);
+        wait_for_threads();
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+    catch (...) {
+        stop();
+        throw;
+    }
+    legs = nullptr;
+    local_transistor = nullptr;
+}
+
+template<typename id_type>
+basic_partitioned_nmos<id_type>::pool::~pool()
+{
+    stop();
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::pool::stop()
+{
+    wait_for_threads();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::pool::wait_for_threads()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    done.wait(lock, [&] { return running == 0; });
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::pool::build(unsigned index)
+{
+    try {
+        parts[index].reset(new region(chip, *legs, *local_transistor, index));
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        failure = std::current_exception();
+    }
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::pool::work(unsigned index)
+{
+    unsigned long long seen = 0;
+
+    pin_to_core(index, unsigned(parts.size()));
+    build(index);
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            --running;
+            done.notify_all();
+            wake.wait(lock, [&] { return stopping or generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        simulate(index);
+    }
+}
+
+/* One thread simulating one region, round after round, until none of the
+ * regions has anything left to do. Each round ends with two barriers:
+ * once all regions are done sending, and once all regions are done
+ * reading the outboxes.
+ *
+ * Feedback loops spanning regions can oscillate when both sides are
+ * evaluated in the same round, e.g. the two halves of a latch flipping
+ * each other forever. Returns false after round_limit rounds, with the
+ * state of the region rolled back to the one at the start of recalc.
+ */
+template<typename id_type>
+bool
+basic_partitioned_nmos<id_type>::pool::simulate(unsigned index)
+{
+    region& self = *parts[index];
+    const bool bounded = parts.size() > 1;
+
+    CHIPEMU_STATS(self.next_recalc_epoch());
+    if (bounded) {
+        self.begin_journal();
+    }
+    for (unsigned round = 0; ; ++round) {
+        std::atomic<size_t>& work = pending[round & 1];
+        size_t left;
+
+        self.step();
+        left = self.outbox_size() + self.changed_queue.size();
+        if (left > 0) {
+            work.fetch_add(left, std::memory_order_relaxed);
+        }
+        barrier.wait();
+        if (work.load(std::memory_order_relaxed) == 0) break;
+
+        for (unsigned source = 0; source < parts.size(); ++source) {
+            if (source != index) {
+                self.apply(source, parts[source]->outboxes[index]);
+            }
+        }
+        barrier.wait();
+        self.clear_outboxes();
+        if (index == 0) {
+            work.store(0, std::memory_order_relaxed);
+        }
+        if (bounded and round + 1 == round_limit) {
+            self.rollback();
+            return false;
+        }
+    }
+    self.end_journal();
+    return true;
+}
+
+/* Returns false if the regions did not settle, see simulate */
+template<typename id_type>
+bool
+basic_partitioned_nmos<id_type>::pool::recalc()
+{
+    if (std::all_of(parts.begin(), parts.end(),
+                    [](const std::unique_ptr<region>& part) {
+                        return part->changed_queue.empty();
+                    }))
+    {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        running = unsigned(threads.size());
+        ++generation;
+    }
+    wake.notify_all();
+    const bool settled = simulate(0);
+    wait_for_threads();
+    return settled;
+}
+
+template<typename id_type>
+class basic_partitioned_nmos<id_type>::serial_nmos : public basic_nmos<id_type>
+{
+public:
+
+    explicit serial_nmos(const basic_chip_description<id_type>& desc):
+        basic_nmos<id_type>(desc)
+    {}
+
+    virtual const char *name() const noexcept final
+    {
+        return "serial";
+    }
+};
+
+template<typename id_type>
+basic_partitioned_nmos<id_type>::basic_partitioned_nmos(
+        const basic_chip_description<id_type>& desc,
+        unsigned region_count):
+    description(desc),
+    topology(netlist::get(desc)),
+    desc_transistor_count(desc.transistor_count),
+    power(topology->power),
+    ground(topology->ground)
+{
+    layout = make_partition(*topology, region_count);
+
+    const vector<transistor_legs> legs = collect_transistors(*topology);
+    const size_t count = layout.report.regions.size();
+    vector<uint32_t> next_node(count, 0);
+    vector<uint32_t> next_transistor(count, 0);
+    vector<uint32_t> local_transistor(legs.size());
+
+    local_id.assign(node_count() + 1, 0);
+    for (uint32_t id = 1; id <= node_count(); ++id) {
+        if (id != power and id != ground) {
+            local_id[id] = next_node[layout.node_region[id]]++;
+        }
+    }
+    for (uint32_t t = 0; t < legs.size(); ++t) {
+        local_transistor[t] = next_transistor[layout.transistor_region[t]]++;
+    }
+    regions.reset(new pool(*this, legs, local_transistor));
+}
+
+template<typename id_type>
+basic_partitioned_nmos<id_type>::~basic_partitioned_nmos()
+{}
+
+template<typename id_type>
+bool
+basic_partitioned_nmos<id_type>::get_node(unsigned id) const noexcept
+{
+    if (id == 0 or id > node_count()) {
+        return false;
+    }
+
+    const id_type internal = topology->internal_id(id);
+
+    if (internal == power) {
+        return true;
+    }
+    else if (internal != ground) {
+        const region& part = *regions->parts[layout.node_region[internal]];
+
+        return part.flags[local_id[internal]] & node_is_high;
+    }
+    else {
+        return false;
+    }
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::set_node(unsigned id, bool high) noexcept
+{
+    if (id == 0 or id > node_count()) return;
+
+    const id_type internal = topology->internal_id(id);
+
+    if (internal != power and internal != ground) {
+        region& part = *regions->parts[layout.node_region[internal]];
+        uint8_t& node = part.flags[local_id[internal]];
+
+        if ((node & node_is_pullup) and not high) {
+            node &= ~node_is_pullup;
+            node |= node_is_pulldown;
+        }
+        else if (high and not (node & node_is_pullup)) {
+            node |= node_is_pullup;
+            node &= ~node_is_pulldown;
+        }
+        else return;
+
+        queue_node(internal, false);
+    }
+}
+
+/* Queues a node between two recalcs, restoring queues a node
+ * regardless of its node_in_changelist flag.
+ */
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::queue_node(id_type id, bool restoring)
+{
+    region& part = *regions->parts[layout.node_region[id]];
+
+    if (restoring) {
+        part.enqueue(local_id[id]);
+        queued.push_back(id);
+    }
+    else if (part.push(local_id[id])) {
+        queued.push_back(id);
+    }
+}
+
+template<typename id_type>
+const partition_report&
+basic_partitioned_nmos<id_type>::report() const noexcept
+{
+    return layout.report;
+}
+
+template<typename id_type>
+unsigned
+basic_partitioned_nmos<id_type>::node_count() const noexcept
+{
+    return topology->node_count();
+}
+
+template<typename id_type>
+unsigned
+basic_partitioned_nmos<id_type>::transistor_count() const noexcept
+{
+    return desc_transistor_count;
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::stabilize_network() noexcept
+{
+    for (uint32_t id = 1; id <= node_count(); ++id) {
+        const id_type internal = topology->internal_id(id);
+
+        if (internal != power and internal != ground) {
+            queue_node(internal, false);
+        }
+    }
+    recalc();
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::recalc() noexcept
+{
+    if (not regions->recalc()) {
+        recalc_serial();
+    }
+    queued.clear();
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::recalc_serial()
+{
+    if (serial == nullptr) {
+        serial.reset(new serial_nmos(description));
+    }
+    serial->restore(snapshot());
+    serial->recalc();
+    restore(serial->snapshot());
+}
+
+template<typename id_type>
+unsigned long long
+basic_partitioned_nmos<id_type>::evaluated_node_count() const noexcept
+{
+    unsigned long long count = 0;
+
+    for (const std::unique_ptr<region>& part : regions->parts) {
+        count += part->evaluated_nodes;
+    }
+    if (serial != nullptr) {
+        count += serial->evaluated_node_count();
+    }
+    return count;
+}
+
+template<typename id_type>
+chip_stats
+basic_partitioned_nmos<id_type>::stats() const noexcept
+{
+    chip_stats total = empty_stats();
+
+    for (const std::unique_ptr<region>& part : regions->parts) {
+        add_stats(total, part->counters);
+    }
+    if (serial != nullptr) {
+        add_stats(total, serial->stats());
+    }
+    return total;
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::reset_stats() noexcept
+{
+    for (const std::unique_ptr<region>& part : regions->parts) {
+        part->counters = empty_stats();
+    }
+    if (serial != nullptr) {
+        serial->reset_stats();
+    }
+}
+
+template<typename id_type>
+vector<unsigned char>
+basic_partitioned_nmos<id_type>::snapshot() const
+{
+    vector<unsigned char> blob;
+    snapshot_writer writer(blob);
+    vector<uint8_t> flags(node_count() + 1, 0);
+    bit_vector transistor_on;
+
+    transistor_on.resize(layout.transistor_region.size());
+    flags[power] = node_is_high;
+    if (topology->is_pullup(power)) flags[power] |= node_is_pullup;
+    if (topology->is_pullup(ground)) flags[ground] |= node_is_pullup;
+    for (const std::unique_ptr<region>& part : regions->parts) {
+        for (size_t i = 0; i < part->node_ids.size(); ++i) {
+            flags[part->node_ids[i]] = part->flags[i];
+        }
+        for (size_t i = 0; i < part->transistor_ids.size(); ++i) {
+            transistor_on.set(part->transistor_ids[i], part->transistor_on[i]);
+        }
+    }
+
+    nmos_snapshot_header header = {
+        topology->checksum(),
+        uint32_t(node_count()),
+        uint32_t(transistor_on.size()),
+        uint32_t(queued.size())
+    };
+
+    writer.write(header);
+    writer.write(flags.data(), flags.size());
+    writer.write(transistor_on.data(), transistor_on.word_count());
+    writer.write(queued.data(), queued.size());
+    return blob;
+}
+
+template<typename id_type>
+void
+basic_partitioned_nmos<id_type>::restore(const vector<unsigned char>& blob)
+{
+    snapshot_reader reader(blob.data(), blob.size());
+    auto header = reader.read<nmos_snapshot_header>();
+    vector<uint8_t> flags(node_count() + 1);
+    bit_vector transistor_on;
+
+    transistor_on.resize(layout.transistor_region.size());
+    if (header.checksum != topology->checksum()
+            or header.node_count != node_count()
+            or header.transistor_count != transistor_on.size()
+            or blob.size() != sizeof(header)
+                              + flags.size() * sizeof(flags[0])
+                              + transistor_on.word_count() * sizeof(uint64_t)
+                              + header.queue_length * sizeof(id_type))
+    {
+        throw std::invalid_argument("snapshot");
+    }
+
+    vector<id_type> queue(header.queue_length);
+
+    reader.read(flags.data(), flags.size());
+    reader.read(transistor_on.data(), transistor_on.word_count());
+    reader.read(queue.data(), queue.size());
+    for (const std::unique_ptr<region>& part : regions->parts) {
+        for (size_t i = 0; i < part->node_ids.size(); ++i) {
+            part->flags[i] = flags[part->node_ids[i]];
+        }
+        for (size_t i = 0; i < part->transistor_ids.size(); ++i) {
+            part->transistor_on.set(i, transistor_on[part->transistor_ids[i]]);
+        }
+        part->changed_queue.clear();
+    }
+    queued.clear();
+    for (id_type id : queue) {
+        if (id != power and id != ground) {
+            queue_node(id, true);
+        }
+    }
+}
+
+template class basic_partitioned_nmos<uint16_t>;
+template class basic_partitioned_nmos<uint32_t>;
+
+}
+}
@@ -0,0 +1,115 @@
+
+#ifndef CHIPEMU_NMOS_PARTITIONED_H
+#define CHIPEMU_NMOS_PARTITIONED_H
+
+#include "chipemu.h"
+#include "netlist.h"
+#include "nmos.h"
+#include "partition.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace chipemu
+{
+namespace implementation
+{
+
+/* The nmos engine, with the netlist split into regions, see make_partition
+ *
+ * Every region owns the state of its own nodes, and transistors, in its own
+ * arrays, renumbered in ascending node id order - the arrays of a region
+ * are allocated by the thread simulating the region. Groups never span
+ * regions, thus a region only needs to tell the other regions about
+ * the nodes toggling the gates of their transistors.
+ *
+ * recalc() proceeds in rounds: each region evaluates the nodes in its own
+ * queue of changed nodes - one generation of the queue of basic_nmos -
+ * collecting the toggled boundary nodes in one outbox for every other
+ * region, then all regions wait for each other. If anything was
+ * sent, every region applies its inbound messages - in the order of the
+ * sending regions - and a new round starts. The result only depends on the
+ * partition, not on the scheduling of the threads.
+ *
+ * Feedback loops spanning regions can keep such rounds from ever settling,
+ * a recalc taking too many rounds is rolled back, and done by the serial
+ * engine instead - the snapshots of the two engines are interchangeable.
+ *
+ * The calling thread simulates region zero, every other region has its
+ * own thread.
+ */
+template<typename id_type>
+class basic_partitioned_nmos : public virtual chipemu::chip
+{
+private:
+
+    class region;
+    class pool;
+
+    class serial_nmos;
+
+    typedef basic_netlist<id_type> netlist;
+
+    const basic_chip_description<id_type> description;
+    std::shared_ptr<const netlist> topology;
+    partition layout;
+
+    /* indexed by the node ids of the netlist, the index of the node
+     * in its region
+     */
+    std::vector<uint32_t> local_id;
+
+    unsigned desc_transistor_count;
+    std::unique_ptr<pool> regions;
+
+    /* The nodes queued since the last recalc, in the order they were
+     * queued in, saved by snapshot in the same order as basic_nmos would.
+     */
+    std::vector<id_type> queued;
+
+    /* created at the first recalc the regions fail to settle */
+    std::unique_ptr<serial_nmos> serial;
+
+    void queue_node(id_type id, bool restoring);
+    void recalc_serial();
+
+protected:
+
+    const id_type power;
+    const id_type ground;
+
+    basic_partitioned_nmos(const basic_chip_description<id_type>& desc,
+                           unsigned region_count);
+
+    basic_partitioned_nmos(const basic_partitioned_nmos&) = delete;
+    basic_partitioned_nmos& operator=(const basic_partitioned_nmos&) = delete;
+
+    ~basic_partitioned_nmos();
+
+public:
+
+    bool get_node(unsigned) const noexcept;
+    void set_node(unsigned, bool) noexcept;
+    const partition_report& report() const noexcept;
+    virtual unsigned node_count() const noexcept final;
+    virtual unsigned transistor_count() const noexcept final;
+    virtual void stabilize_network() noexcept override;
+    virtual void recalc() noexcept override;
+    virtual unsigned long long evaluated_node_count() const noexcept final;
+    virtual chip_stats stats() const noexcept final;
+    virtual void reset_stats() noexcept final;
+
+    /* The same layout as the snapshots of basic_nmos, thus a snapshot can
+     * be restored into a chip built from the same chip_description,
+     * regardless of it being partitioned or not.
+     */
+    virtual std::vector<unsigned char> snapshot() const override;
+    virtual void restore(const std::vector<unsigned char>&) override;
+
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,120 @@
+
+#ifndef CHIPEMU_NMOS_PRIMITIVES_H
+#define CHIPEMU_NMOS_PRIMITIVES_H
+
+#include "nmos.h"
+
+#include <cassert>
+
+namespace chipemu
+{
+namespace implementation
+{
+
+/* The operations the nmos engine is built of, shared between nmos.cc
+ * and the evaluation code generated by nmos_compiler.
+ * See netlist.h about the layout of the topology.
+ */
+
+enum node_flags : uint8_t {
+    node_is_pullup       = 0b00001,
+    node_is_pulldown     = 0b00010,
+    node_is_high         = 0b00100,
+    node_in_changelist   = 0b01000,
+    node_in_group        = 0b10000,
+};
+
+template<typename id_type>
+inline void
+basic_nmos<id_type>::changed_push(id_type id)
+{
+    if (flags[id] & node_in_changelist) return;
+
+    changed_queue[changed_feeding] = id;
+    changed_feeding = (changed_feeding + 1) & (changed_queue.size() - 1);
+    if (changed_feeding == changed_eating) {
+        changed_queue_grow();
+    }
+    flags[id] |= node_in_changelist;
+}
+
+template<typename id_type>
+inline void
+basic_nmos<id_type>::update_group_value(group_contains& value, uint8_t flags)
+{
+    switch (value) {
+        case group_contains::nothing:
+            if (flags & node_is_high) {
+                value = group_contains::high;
+            }
+        case group_contains::pullup:
+            if (flags & node_is_pullup) {
+                value = group_contains::pullup;
+            }
+        case group_contains::pulldown:
+            if (flags & node_is_pulldown) {
+                value = group_contains::pulldown;
+            }
+        case group_contains::power:
+        case group_contains::ground:
+        case group_contains::high:
+            break;
+    }
+}
+
+template<typename id_type>
+inline void
+basic_nmos<id_type>::group_update_value(uint8_t flags)
+{
+    update_group_value(group_current_value, flags);
+}
+
+/* Primitives used by the generated code, where node ids, and transistor
+ * indices are already known at compile time. The generated code is only
+ * used with the compact layout.
+ */
+struct compiled_primitives
+{
+    static uint8_t *flags(nmos& chip)
+    {
+        return chip.flags.data();
+    }
+
+    /* the words of the transistor bitmap, see bit_vector */
+    static uint64_t *transistor_on(nmos& chip)
+    {
+        return chip.transistor_on.data();
+    }
+
+    static void group_add_power(nmos& chip)
+    {
+        if (chip.group_current_value != nmos::group_contains::ground) {
+            chip.group_current_value = nmos::group_contains::power;
+        }
+    }
+
+    static void group_add_ground(nmos& chip)
+    {
+        chip.group_current_value = nmos::group_contains::ground;
+    }
+
+    static void group_add(nmos& chip, uint16_t id)
+    {
+        uint8_t& flags = chip.flags[id];
+
+        flags |= node_in_group;
+        flags &= ~node_in_changelist;
+        chip.current_group[chip.group_tail++] = id;
+        chip.group_update_value(flags);
+    }
+
+    static void changed_push(nmos& chip, uint16_t id)
+    {
+        chip.changed_push(id);
+    }
+};
+
+}
+}
+
+#endif
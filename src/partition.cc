@@ -0,0 +1,349 @@
+
+#include "partition.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+using std::vector;
+
+namespace chipemu
+{
+namespace implementation
+{
+
+namespace
+{
+
+constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+
+/* regions may be this much heavier than the average, while refining */
+constexpr double imbalance = 0.05;
+
+constexpr unsigned refinement_passes = 8;
+
+class disjoint_sets
+{
+    vector<uint32_t> parent;
+
+public:
+
+    explicit disjoint_sets(size_t count):
+        parent(count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            parent[i] = uint32_t(i);
+        }
+    }
+
+    uint32_t find(uint32_t item)
+    {
+        while (parent[item] != item) {
+            parent[item] = parent[parent[item]];
+            item = parent[item];
+        }
+        return item;
+    }
+
+    void unite(uint32_t a, uint32_t b)
+    {
+        a = find(a);
+        b = find(b);
+        if (a < b) {
+            parent[b] = a;
+        }
+        else if (b < a) {
+            parent[a] = b;
+        }
+    }
+};
+
+/* The graph of components, an edge weighing as much as the number of
+ * transistors gated across the two components, in compressed rows.
+ */
+struct component_graph
+{
+    vector<uint32_t> offsets;
+    vector<std::pair<uint32_t, uint32_t>> edges;
+
+    component_graph(size_t count, vector<std::pair<uint32_t, uint32_t>> links):
+        offsets(count + 1, 0)
+    {
+        std::sort(links.begin(), links.end());
+        for (size_t i = 0; i < links.size(); ) {
+            size_t end = i;
+
+            while (end < links.size() and links[end] == links[i]) ++end;
+            edges.emplace_back(links[i].second, uint32_t(end - i));
+            ++offsets[links[i].first + 1];
+            i = end;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            offsets[i + 1] += offsets[i];
+        }
+    }
+
+    size_t size() const
+    {
+        return offsets.size() - 1;
+    }
+};
+
+/* Breadth first order of all components, starting at the component
+ * visited last by a traversal starting at component zero - a component
+ * at the periphery of the graph, which makes regions grow in layers.
+ */
+vector<uint32_t>
+traversal_order(const component_graph& graph, uint32_t start)
+{
+    vector<uint32_t> order;
+    vector<bool> visited(graph.size(), false);
+
+    order.reserve(graph.size());
+    for (size_t root = 0; root < graph.size(); ++root) {
+        uint32_t first = (root == 0) ? start : uint32_t(root);
+
+        if (visited[first]) continue;
+        visited[first] = true;
+        order.push_back(first);
+        for (size_t next = order.size() - 1; next < order.size(); ++next) {
+            const uint32_t c = order[next];
+
+            for (uint32_t e = graph.offsets[c]; e < graph.offsets[c + 1]; ++e) {
+                const uint32_t neighbour = graph.edges[e].first;
+
+                if (not visited[neighbour]) {
+                    visited[neighbour] = true;
+                    order.push_back(neighbour);
+                }
+            }
+        }
+    }
+    return order;
+}
+
+void
+refine(const component_graph& graph,
+       const vector<uint64_t>& weight,
+       vector<uint32_t>& region,
+       vector<uint64_t>& region_weight,
+       uint64_t limit)
+{
+    vector<uint64_t> links(region_weight.size(), 0);
+    vector<uint32_t> linked;
+
+    for (unsigned pass = 0; pass < refinement_passes; ++pass) {
+        unsigned moved = 0;
+
+        for (uint32_t c = 0; c < graph.size(); ++c) {
+            const uint32_t own = region[c];
+            uint32_t best = own;
+            uint64_t best_gain = 0;
+
+            for (uint32_t e = graph.offsets[c]; e < graph.offsets[c + 1]; ++e) {
+                const uint32_t r = region[graph.edges[e].first];
+
+                if (links[r] == 0) linked.push_back(r);
+                links[r] += graph.edges[e].second;
+            }
+            for (uint32_t r : linked) {
+                if (r != own
+                        and links[r] > links[own] + best_gain
+                        and region_weight[r] + weight[c] <= limit
+                        and region_weight[own] > weight[c])
+                {
+                    best = r;
+                    best_gain = links[r] - links[own];
+                }
+            }
+            for (uint32_t r : linked) {
+                links[r] = 0;
+            }
+            linked.clear();
+            if (best != own) {
+                region[c] = best;
+                region_weight[own] -= weight[c];
+                region_weight[best] += weight[c];
+                ++moved;
+            }
+        }
+        if (moved == 0) return;
+    }
+}
+
+}
+
+/* every transistor is listed exactly once, among the gates of the node
+ * controlling it
+ */
+template<typename id_type>
+vector<transistor_legs>
+collect_transistors(const basic_netlist<id_type>& netlist)
+{
+    typedef basic_netlist<id_type> netlist_type;
+    vector<transistor_legs> result(netlist.transistor_count());
+
+    for (uint32_t id = 1; id <= netlist.node_count(); ++id) {
+        const id_type *node = netlist.node(id_type(id));
+        const id_type *gate = netlist_type::gates(node);
+
+        for (id_type i = 0; i < netlist_type::gate_count(node); ++i) {
+            result[gate[0]] = {id, gate[1], gate[2]};
+            gate += netlist_type::gate_entry_size;
+        }
+    }
+    return result;
+}
+
+template<typename id_type>
+partition
+make_partition(const basic_netlist<id_type>& netlist, unsigned region_count)
+{
+    const uint32_t node_count = netlist.node_count();
+    const vector<transistor_legs> transistors = collect_transistors(netlist);
+    auto is_rail = [&](uint32_t id) {
+        return id == netlist.power or id == netlist.ground;
+    };
+
+    disjoint_sets sets(node_count + 1);
+
+    for (const transistor_legs& t : transistors) {
+        if (not is_rail(t.c1) and not is_rail(t.c2)) {
+            sets.unite(t.c1, t.c2);
+        }
+    }
+
+    /* number the components, and weigh them */
+    vector<uint32_t> component(node_count + 1, none);
+    vector<uint32_t> owner(transistors.size(), none);
+    vector<uint64_t> weight;
+
+    for (uint32_t id = 1; id <= node_count; ++id) {
+        if (is_rail(id)) continue;
+
+        const uint32_t root = sets.find(id);
+
+        if (component[root] == none) {
+            component[root] = uint32_t(weight.size());
+            weight.push_back(0);
+        }
+        component[id] = component[root];
+        ++weight[component[id]];
+    }
+    for (size_t i = 0; i < transistors.size(); ++i) {
+        const transistor_legs& t = transistors[i];
+
+        if (not is_rail(t.c1)) {
+            owner[i] = component[t.c1];
+        }
+        else if (not is_rail(t.c2)) {
+            owner[i] = component[t.c2];
+        }
+        if (owner[i] != none) {
+            ++weight[owner[i]];
+        }
+    }
+
+    const uint32_t components = uint32_t(weight.size());
+
+    region_count = std::max(1u, std::min<unsigned>(region_count, components));
+
+    vector<std::pair<uint32_t, uint32_t>> links;
+
+    for (size_t i = 0; i < transistors.size(); ++i) {
+        const uint32_t gate = transistors[i].gate;
+
+        if (owner[i] != none and not is_rail(gate)
+                and component[gate] != owner[i])
+        {
+            links.emplace_back(component[gate], owner[i]);
+            links.emplace_back(owner[i], component[gate]);
+        }
+    }
+
+    const component_graph graph(components, std::move(links));
+
+    /* grow the regions along the traversal, then refine them */
+    vector<uint32_t> region(components, 0);
+    vector<uint64_t> region_weight(region_count, 0);
+    uint64_t total = 0;
+
+    for (uint64_t w : weight) {
+        total += w;
+    }
+    if (components > 0) {
+        const vector<uint32_t> probe = traversal_order(graph, 0);
+        uint64_t prefix = 0;
+
+        for (uint32_t c : traversal_order(graph, probe.back())) {
+            region[c] = uint32_t(std::min<uint64_t>(
+                region_count - 1, (prefix + weight[c] / 2) * region_count / total));
+            prefix += weight[c];
+            region_weight[region[c]] += weight[c];
+        }
+        refine(graph, weight, region, region_weight,
+               uint64_t((1 + imbalance) * total / region_count) + 1);
+    }
+
+    /* the result, and the report */
+    partition result;
+    partition_report& report = result.report;
+
+    result.node_region.assign(node_count + 1, 0);
+    for (uint32_t id = 1; id <= node_count; ++id) {
+        if (component[id] != none) {
+            result.node_region[id] = region[component[id]];
+        }
+    }
+    result.transistor_region.assign(transistors.size(), 0);
+    for (size_t i = 0; i < transistors.size(); ++i) {
+        if (owner[i] != none) {
+            result.transistor_region[i] = region[owner[i]];
+        }
+    }
+
+    vector<bool> boundary(node_count + 1, false);
+
+    report.regions.assign(region_count, {0, 0, 0});
+    report.component_count = components;
+    report.cut_size = 0;
+    for (uint32_t id = 1; id <= node_count; ++id) {
+        ++report.regions[result.node_region[id]].node_count;
+    }
+    for (size_t i = 0; i < transistors.size(); ++i) {
+        const uint32_t gate = transistors[i].gate;
+        const uint32_t own = result.transistor_region[i];
+
+        ++report.regions[own].transistor_count;
+        if (not is_rail(gate) and result.node_region[gate] != own) {
+            ++report.cut_size;
+            if (not boundary[gate]) {
+                boundary[gate] = true;
+                ++report.regions[result.node_region[gate]].boundary_node_count;
+            }
+        }
+    }
+
+    double heaviest = 0;
+    double sum = 0;
+
+    for (const partition_report::region& r : report.regions) {
+        double w = double(r.node_count) + r.transistor_count;
+
+        heaviest = std::max(heaviest, w);
+        sum += w;
+    }
+    report.balance = (sum > 0) ? heaviest * region_count / sum : 1;
+    return result;
+}
+
+template vector<transistor_legs>
+collect_transistors(const basic_netlist<uint16_t>&);
+template vector<transistor_legs>
+collect_transistors(const basic_netlist<uint32_t>&);
+
+template partition make_partition(const basic_netlist<uint16_t>&, unsigned);
+template partition make_partition(const basic_netlist<uint32_t>&, unsigned);
+
+}
+}
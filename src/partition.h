@@ -0,0 +1,65 @@
+
+#ifndef CHIPEMU_PARTITION_H
+#define CHIPEMU_PARTITION_H
+
+#include "netlist.h"
+#include "nmos_chip.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace chipemu
+{
+namespace implementation
+{
+
+struct transistor_legs
+{
+    uint32_t gate;
+    uint32_t c1;
+    uint32_t c2;
+};
+
+/* The gate, and legs of each transistor of a netlist,
+ * indexed by transistor index
+ */
+template<typename id_type>
+std::vector<transistor_legs>
+collect_transistors(const basic_netlist<id_type>&);
+
+/* The assignment of the nodes, and transistors of a netlist to regions
+ *
+ * A node connected to other nodes through the legs of transistors always
+ * shares its region with those nodes, as groups can not span regions.
+ * Such channel connected components - power, and ground are not part of
+ * them - are assigned to regions as a whole, by growing the regions along
+ * a breadth first traversal of the components, followed by a few passes of
+ * greedy refinement, moving components to a neighbouring region whenever
+ * that reduces the number of transistors gated across regions, without
+ * unbalancing the regions.
+ *
+ * A transistor belongs to the region of its legs, a transistor with both
+ * legs connected to power, or ground belongs to region zero, as do power,
+ * and ground themselves.
+ */
+struct partition
+{
+    /* indexed by node id */
+    std::vector<uint32_t> node_region;
+
+    /* indexed by transistor index, see basic_netlist */
+    std::vector<uint32_t> transistor_region;
+
+    partition_report report;
+};
+
+/* region_count is reduced to the number of components, if there are
+ * fewer components than that
+ */
+template<typename id_type>
+partition make_partition(const basic_netlist<id_type>&, unsigned region_count);
+
+}
+}
+
+#endif
@@ -0,0 +1,105 @@
+
+#ifndef CHIPEMU_SNAPSHOT_H
+#define CHIPEMU_SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace chipemu
+{
+namespace implementation
+{
+
+/* Helpers for building, and parsing the blobs returned by
+ * chip::snapshot(). A blob is just the raw bytes of the state vectors
+ * of a chip, one after the other, in the native byte order - a blob is
+ * only meant to be restored in the same process, or at least on the
+ * same machine, into a chip built from the same chip_description.
+ */
+class snapshot_writer
+{
+    std::vector<unsigned char>& blob;
+
+public:
+
+    explicit snapshot_writer(std::vector<unsigned char>& output):
+        blob(output)
+    {}
+
+    template<typename T>
+    void write(const T *data, size_t count)
+    {
+        size_t size = blob.size();
+
+        blob.resize(size + sizeof(T) * count);
+        if (count > 0) {
+            std::memcpy(blob.data() + size, data, sizeof(T) * count);
+        }
+    }
+
+    template<typename T>
+    void write(const T& value)
+    {
+        write(&value, 1);
+    }
+};
+
+class snapshot_reader
+{
+    const unsigned char *data;
+    size_t remaining;
+
+public:
+
+    snapshot_reader(const unsigned char *blob, size_t size):
+        data(blob),
+        remaining(size)
+    {}
+
+    template<typename T>
+    void read(T *output, size_t count)
+    {
+        if (sizeof(T) * count > remaining) {
+            throw std::invalid_argument("snapshot size");
+        }
+        if (count > 0) {
+            std::memcpy(output, data, sizeof(T) * count);
+        }
+        data += sizeof(T) * count;
+        remaining -= sizeof(T) * count;
+    }
+
+    template<typename T>
+    T read()
+    {
+        T value;
+
+        read(&value, 1);
+        return value;
+    }
+
+    /* throws if any of the input is left unparsed */
+    void finish() const
+    {
+        if (remaining != 0) {
+            throw std::invalid_argument("snapshot size");
+        }
+    }
+};
+
+/* The start of the snapshots of the nmos engines, see basic_nmos::snapshot */
+struct nmos_snapshot_header
+{
+    uint32_t checksum;
+    uint32_t node_count;
+    uint32_t transistor_count;
+    uint32_t queue_length;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,62 @@
+
+#ifndef CHIPEMU_STATS_H
+#define CHIPEMU_STATS_H
+
+#include "chipemu.h"
+
+#include <cstddef>
+
+/* CHIPEMU_STATS(statement) executes statement only when the library is
+ * built with CHIPEMU_ENABLE_STATS, otherwise it compiles to nothing.
+ */
+#ifdef CHIPEMU_ENABLE_STATS
+#define CHIPEMU_STATS(statement) do { statement; } while (false)
+#else
+#define CHIPEMU_STATS(statement) do { } while (false)
+#endif
+
+namespace chipemu
+{
+namespace implementation
+{
+
+inline chip_stats
+empty_stats()
+{
+    chip_stats stats = chip_stats();
+
+#ifdef CHIPEMU_ENABLE_STATS
+    stats.enabled = true;
+#endif
+    return stats;
+}
+
+inline void
+count_group(chip_stats& stats, size_t size)
+{
+    unsigned bucket = 0;
+
+    while (bucket + 1 < chip_stats::group_size_buckets
+           and (size >> (bucket + 1)) != 0)
+    {
+        ++bucket;
+    }
+    ++stats.group_sizes[bucket];
+    ++stats.groups;
+    if (size > stats.group_high_water) {
+        stats.group_high_water = size;
+    }
+}
+
+inline void
+count_queue_length(chip_stats& stats, size_t length)
+{
+    if (length > stats.changed_queue_high_water) {
+        stats.changed_queue_high_water = length;
+    }
+}
+
+}
+}
+
+#endif
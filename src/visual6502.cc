@@ -0,0 +1,389 @@
+
+#include "visual6502.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+
+using std::string;
+
+namespace chipemu
+{
+namespace implementation
+{
+namespace
+{
+
+/* Splits a javascript source file into the few kinds of tokens
+ * found in the visual6502 data files. Comments, and everything up to
+ * the first bracket, e.g. "var transdefs =" are skipped.
+ */
+class scanner
+{
+public:
+
+    enum kind {
+        end,
+        open_bracket,
+        close_bracket,
+        open_brace,
+        close_brace,
+        comma,
+        colon,
+        number,
+        text,
+        word
+    };
+
+    struct token
+    {
+        kind type;
+        string value;
+    };
+
+private:
+
+    FILE *file;
+    const char *path;
+    int next;
+    unsigned line;
+
+    int advance()
+    {
+        int c = next;
+
+        if (c == '\n') ++line;
+        next = fgetc(file);
+        return c;
+    }
+
+    void skip_space_and_comments()
+    {
+        while (true) {
+            while (next != EOF and isspace(next)) advance();
+            if (next != '/') return;
+            advance();
+            if (next == '/') {
+                while (next != EOF and next != '\n') advance();
+            }
+            else if (next == '*') {
+                advance();
+                int previous = 0;
+                while (next != EOF and not (previous == '*' and next == '/')) {
+                    previous = advance();
+                }
+                advance();
+            }
+            else {
+                fail("unexpected '/'");
+            }
+        }
+    }
+
+public:
+
+    scanner(const char *file_path):
+        file(fopen(file_path, "r")),
+        path(file_path),
+        line(1)
+    {
+        if (file == nullptr) {
+            throw std::runtime_error(string("unable to open ") + path);
+        }
+        next = fgetc(file);
+    }
+
+    ~scanner()
+    {
+        fclose(file);
+    }
+
+    scanner(const scanner&) = delete;
+    scanner& operator=(const scanner&) = delete;
+
+    [[noreturn]] void fail(const string& message) const
+    {
+        throw std::runtime_error(string(path) + ":" + std::to_string(line)
+                                 + ": " + message);
+    }
+
+    token get()
+    {
+        skip_space_and_comments();
+
+        int c = next;
+
+        if (c == EOF) return {end, ""};
+        advance();
+        switch (c) {
+            case '[': return {open_bracket, "["};
+            case ']': return {close_bracket, "]"};
+            case '{': return {open_brace, "{"};
+            case '}': return {close_brace, "}"};
+            case ',': return {comma, ","};
+            case ':': return {colon, ":"};
+            case '=':
+            case ';':
+                return get();
+            case '\'':
+            case '"': {
+                string value;
+
+                while (next != c) {
+                    if (next == EOF or next == '\n') {
+                        fail("unterminated string");
+                    }
+                    value += char(advance());
+                }
+                advance();
+                return {text, value};
+            }
+        }
+        if (isdigit(c) or c == '-') {
+            string value(1, char(c));
+
+            while (next != EOF and (isalnum(next) or next == '.')) {
+                value += char(advance());
+            }
+            return {number, value};
+        }
+        if (isalpha(c) or c == '_' or c == '$') {
+            string value(1, char(c));
+
+            while (next != EOF and (isalnum(next) or next == '_')) {
+                value += char(advance());
+            }
+            return {word, value};
+        }
+        fail(string("unexpected character '") + char(c) + "'");
+    }
+
+    /* the first token after the declaration, e.g. "var segdefs =" */
+    token get_value()
+    {
+        token t = get();
+
+        while (t.type == word) {
+            t = get();
+        }
+        return t;
+    }
+
+    uint32_t node_id(const token& t) const
+    {
+        if (t.type != number) {
+            fail("node id expected");
+        }
+
+        unsigned long value = std::strtoul(t.value.c_str(), nullptr, 10);
+
+        if (t.value[0] == '-'
+                or value >= std::numeric_limits<uint32_t>::max() - 1)
+        {
+            fail("invalid node id");
+        }
+        return uint32_t(value + 1);
+    }
+
+    /* skips the rest of a list, or object, the opening token
+     * already consumed
+     */
+    void skip_nested()
+    {
+        unsigned depth = 1;
+
+        while (depth > 0) {
+            token t = get();
+
+            switch (t.type) {
+                case end:
+                    fail("unexpected end of file");
+                case open_bracket:
+                case open_brace:
+                    ++depth;
+                    break;
+                case close_bracket:
+                case close_brace:
+                    --depth;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+};
+
+/* Iterates over the entries of a list of lists: [ [...], [...], ... ]
+ * calling process with each element of an entry, until process returns
+ * false, skipping the rest of the entry.
+ */
+template<typename function>
+void
+parse_list_of_lists(scanner& input, function process)
+{
+    scanner::token t = input.get_value();
+
+    if (t.type != scanner::open_bracket) {
+        input.fail("'[' expected");
+    }
+    while (true) {
+        t = input.get();
+        if (t.type == scanner::comma) continue;
+        if (t.type == scanner::close_bracket) return;
+        if (t.type != scanner::open_bracket) {
+            input.fail("'[' expected");
+        }
+
+        unsigned index = 0;
+        bool wanted = true;
+
+        while (true) {
+            t = input.get();
+            if (t.type == scanner::close_bracket) break;
+            if (t.type == scanner::comma) {
+                ++index;
+                continue;
+            }
+            if (t.type == scanner::end) {
+                input.fail("unexpected end of file");
+            }
+            if (wanted) {
+                wanted = process(index, t);
+            }
+            if (t.type == scanner::open_bracket
+                    or t.type == scanner::open_brace)
+            {
+                input.skip_nested();
+            }
+        }
+        process(std::numeric_limits<unsigned>::max(), t);
+    }
+}
+
+void
+grow(visual6502_netlist& result, uint32_t id)
+{
+    if (id >= result.pullups.size()) {
+        result.pullups.resize(id + 1, false);
+    }
+}
+
+void
+parse_transdefs(visual6502_netlist& result, const char *path)
+{
+    scanner input(path);
+    uint32_t entry[3];
+    unsigned found = 0;
+
+    parse_list_of_lists(input,
+        [&](unsigned index, const scanner::token& t) {
+            if (index >= 1 and index <= 3) {
+                entry[index - 1] = input.node_id(t);
+                grow(result, entry[index - 1]);
+                ++found;
+                return true;
+            }
+            if (index == std::numeric_limits<unsigned>::max()) {
+                if (found != 3) {
+                    input.fail("gate, and two legs expected");
+                }
+                result.transistors.insert(result.transistors.end(),
+                                          entry, entry + 3);
+                found = 0;
+            }
+            return index < 3;
+        });
+}
+
+void
+parse_segdefs(visual6502_netlist& result, const char *path)
+{
+    scanner input(path);
+    uint32_t id = 0;
+
+    parse_list_of_lists(input,
+        [&](unsigned index, const scanner::token& t) {
+            if (index == 0) {
+                id = input.node_id(t);
+                grow(result, id);
+                return true;
+            }
+            if (index == 1 and t.value == "+") {
+                result.pullups[id] = true;
+            }
+            return false;
+        });
+}
+
+void
+parse_nodenames(visual6502_netlist& result, const char *path)
+{
+    scanner input(path);
+    scanner::token t = input.get_value();
+
+    if (t.type != scanner::open_brace) {
+        input.fail("'{' expected");
+    }
+    while (true) {
+        t = input.get();
+        if (t.type == scanner::comma) continue;
+        if (t.type == scanner::close_brace) return;
+        if (t.type != scanner::word and t.type != scanner::text) {
+            input.fail("node name expected");
+        }
+
+        string name = t.value;
+
+        if (input.get().type != scanner::colon) {
+            input.fail("':' expected");
+        }
+
+        uint32_t id = input.node_id(input.get());
+
+        grow(result, id);
+        result.node_names[name] = id;
+    }
+}
+
+uint32_t
+lookup_rail(const visual6502_netlist& result, const string& name)
+{
+    for (auto& entry : result.node_names) {
+        const string& candidate = entry.first;
+
+        if (candidate.size() == name.size()
+                and std::equal(candidate.begin(), candidate.end(),
+                               name.begin(),
+                               [](char a, char b) {
+                                   return tolower(a) == tolower(b);
+                               }))
+        {
+            return entry.second;
+        }
+    }
+    throw std::runtime_error("no node named " + name);
+}
+
+} // anonym namespace
+
+visual6502_netlist
+load_visual6502(const char *transdefs_path,
+                const char *segdefs_path,
+                const char *nodenames_path)
+{
+    visual6502_netlist result;
+
+    result.pullups.push_back(false);
+    parse_transdefs(result, transdefs_path);
+    parse_segdefs(result, segdefs_path);
+    parse_nodenames(result, nodenames_path);
+    result.power = lookup_rail(result, "vcc");
+    result.ground = lookup_rail(result, "vss");
+    return result;
+}
+
+}
+}
@@ -0,0 +1,61 @@
+
+#ifndef CHIPEMU_VISUAL6502_H
+#define CHIPEMU_VISUAL6502_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace chipemu
+{
+namespace implementation
+{
+
+/* The contents of a netlist in the layout used by the visual6502 project:
+ *
+ *  transdefs.js  -  var transdefs = [ ['t0', gate, c1, c2, ...], ... ]
+ *  segdefs.js    -  var segdefs = [ [ node, '+' or '-', ... ], ... ]
+ *                   a node is a pullup, if any of its segments is marked '+'
+ *  nodenames.js  -  var nodenames = { name: node, ... }
+ *
+ * Node ids in those files start at zero, while the nmos engine reserves
+ * zero, thus every id is incremented by one - the same way as in mos6502.inc
+ * The power, and ground nodes are the ones named vcc, and vss.
+ *
+ * The files are parsed as a stream of tokens, without reading them
+ * into memory first.
+ */
+struct visual6502_netlist
+{
+    /* gate, c1, c2 of each transistor, in the order of transdefs */
+    std::vector<uint32_t> transistors;
+
+    /* indexed by node id */
+    std::vector<bool> pullups;
+
+    std::map<std::string, uint32_t> node_names;
+
+    uint32_t power;
+    uint32_t ground;
+
+    unsigned node_count() const
+    {
+        return unsigned(pullups.size()) - 1;
+    }
+
+    unsigned transistor_count() const
+    {
+        return unsigned(transistors.size() / 3);
+    }
+};
+
+/* throws std::runtime_error if a file can not be read, or parsed */
+visual6502_netlist load_visual6502(const char *transdefs_path,
+                                   const char *segdefs_path,
+                                   const char *nodenames_path);
+
+}
+}
+
+#endif
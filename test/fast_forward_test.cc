@@ -0,0 +1,191 @@
+/* fast_forward must leave the 6502 in the same state as running the same
+ * number of cycles on the netlist - the registers, and the memory are
+ * compared after each handoff from the instruction level back to the
+ * netlist. The handoff is in the cycle fetching an opcode, the previous
+ * instruction writes its result to a register during the next cycle, thus
+ * the registers are compared one cycle later - see instruction_state.
+ *
+ * The memory is filled with random documented opcodes, so the programs
+ * jump around, and use the stack at random, but only run instructions
+ * the instruction level knows about. The programs start with SED, the
+ * decimal mode stays on until CLD, PLP, or RTI clears it. Every documented
+ * opcode must be run by fast_forward at least once. The fast_forward
+ * calls validate their own results on a clone of the chip as well.
+ */
+
+#include "mos65xx.h"
+#include "mos6500_core.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using chipemu::MOS6502;
+using chipemu::implementation::mos6500_core;
+
+namespace
+{
+
+constexpr unsigned ram_size = 0x800;
+constexpr unsigned start = 0x1000;
+constexpr unsigned interrupt = 0x2000;
+constexpr unsigned char SED = 0xf8;
+
+bool
+documented(unsigned char opcode)
+{
+    return mos6500_core::cycle_counts[opcode] != 0;
+}
+
+/* RAM below ram_size, random opcodes everywhere, written only to RAM.
+ * The opcodes fetched are recorded while recording is set.
+ */
+class memory : public chipemu::bus_handler
+{
+public:
+
+    std::vector<unsigned char> data;
+    std::vector<bool> fetched;
+    bool recording;
+
+    explicit memory(unsigned seed):
+        data(0x10000),
+        fetched(0x100, false),
+        recording(false)
+    {
+        std::mt19937 random(seed);
+
+        for (unsigned char& byte : data) {
+            do {
+                byte = (unsigned char)random();
+            } while (not documented(byte));
+        }
+        data[start] = SED;
+        data[0xfffc] = start & 0xff;
+        data[0xfffd] = start >> 8;
+        data[0xfffe] = interrupt & 0xff;
+        data[0xffff] = interrupt >> 8;
+    }
+
+    virtual unsigned char read(unsigned address) final
+    {
+        return data[address];
+    }
+
+    virtual void write(unsigned address, unsigned char value) final
+    {
+        if (address < ram_size) {
+            data[address] = value;
+        }
+    }
+
+    virtual unsigned char fetch(unsigned address) final
+    {
+        if (recording) {
+            fetched[data[address]] = true;
+        }
+        return data[address];
+    }
+};
+
+void
+reset(MOS6502& cpu, memory& bus)
+{
+    cpu.pin_write(MOS6502::RES, false);
+    cpu.pin_write(MOS6502::CLK0IN, true);
+    cpu.pin_write(MOS6502::RDY, true);
+    cpu.pin_write(MOS6502::SO, false);
+    cpu.pin_write(MOS6502::IRQ, true);
+    cpu.pin_write(MOS6502::NMI, true);
+    cpu.stabilize_network();
+    cpu.run_cycles(8, bus);
+    cpu.pin_write(MOS6502::RES, true);
+    cpu.recalc();
+}
+
+bool
+same_state(const MOS6502& expected, const memory& expected_memory,
+           const MOS6502& cpu, const memory& cpu_memory)
+{
+    const MOS6502::register_file x = expected.registers();
+    const MOS6502::register_file y = cpu.registers();
+
+    return x.A == y.A and x.X == y.X and x.Y == y.Y and x.S == y.S
+           and (x.P & 0xcf) == (y.P & 0xcf) and x.PC == y.PC
+           and x.IR == y.IR and x.address_bus == y.address_bus
+           and x.RW == y.RW and x.SYNC == y.SYNC
+           and expected_memory.data == cpu_memory.data;
+}
+
+/* Alternates fast_forward calls, and cycles run on the netlist, while
+ * the expected chip runs every cycle on the netlist.
+ */
+bool
+test_program(unsigned seed, std::vector<bool>& fetched)
+{
+    const unsigned handoffs = 4;
+    const unsigned long long count = 1000;
+    const unsigned long long netlist_cycles = 37;
+    std::unique_ptr<MOS6502> expected(MOS6502::create());
+    std::unique_ptr<MOS6502> cpu(MOS6502::create());
+    memory expected_memory(seed);
+    memory cpu_memory(seed);
+
+    reset(*expected, expected_memory);
+    reset(*cpu, cpu_memory);
+    for (unsigned i = 0; i < handoffs; ++i) {
+        unsigned long long cycles;
+
+        cpu_memory.recording = true;
+        try {
+            cycles = cpu->fast_forward(count, cpu_memory, true);
+        }
+        catch (const std::runtime_error& error) {
+            fprintf(stderr, "seed %u, handoff %u: %s\n", seed, i, error.what());
+            return false;
+        }
+        cpu_memory.recording = false;
+        expected->run_cycles(cycles + 1, expected_memory);
+        cpu->run_cycles(1, cpu_memory);
+        if (not same_state(*expected, expected_memory, *cpu, cpu_memory)) {
+            fprintf(stderr, "seed %u: differs after fast_forward %u\n",
+                    seed, i);
+            return false;
+        }
+        expected->run_cycles(netlist_cycles, expected_memory);
+        cpu->run_cycles(netlist_cycles, cpu_memory);
+        if (not same_state(*expected, expected_memory, *cpu, cpu_memory)) {
+            fprintf(stderr, "seed %u: differs after the netlist run %u\n",
+                    seed, i);
+            return false;
+        }
+    }
+    for (unsigned opcode = 0; opcode < 0x100; ++opcode) {
+        if (cpu_memory.fetched[opcode]) {
+            fetched[opcode] = true;
+        }
+    }
+    return true;
+}
+
+}
+
+int main()
+{
+    std::vector<bool> fetched(0x100, false);
+    bool ok = true;
+
+    for (unsigned seed = 1; seed <= 8; ++seed) {
+        ok = test_program(seed, fetched) and ok;
+    }
+    for (unsigned opcode = 0; opcode < 0x100; ++opcode) {
+        if (documented((unsigned char)opcode) and not fetched[opcode]) {
+            fprintf(stderr, "opcode %02x never run\n", opcode);
+            ok = false;
+        }
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,170 @@
+/* The rails of a wide netlist keep their ids above the range of the
+ * compact layout - when built, renumbered, saved and loaded again.
+ * A damaged image is refused by load.
+ *
+ * The netlist holds an inverter: the input gates a transistor between
+ * the output, and ground, the output has a pullup.
+ */
+
+#include "nmos.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using chipemu::implementation::node_order;
+using chipemu::implementation::wide_chip_description;
+using chipemu::implementation::wide_netlist;
+using chipemu::implementation::wide_nmos;
+using chipemu::implementation::wide_transdef;
+
+namespace
+{
+
+constexpr unsigned node_count = 70000;
+constexpr uint32_t input = 3;
+constexpr uint32_t output = 4;
+const char *image_path = "netlist_test.image";
+
+struct inverter
+{
+    std::vector<wide_transdef> transistors;
+    std::unique_ptr<bool[]> pullups;
+    wide_chip_description description;
+
+    inverter(uint32_t power, uint32_t ground):
+        transistors{{input, output, ground}},
+        pullups(new bool[node_count]()),
+        description{node_count,
+                    pullups.get(),
+                    unsigned(transistors.size()),
+                    transistors.data(),
+                    power,
+                    ground}
+    {
+        pullups[output - 1] = true;
+    }
+};
+
+class inverter_chip : public wide_nmos
+{
+public:
+
+    inverter_chip(const wide_chip_description& desc,
+                  std::shared_ptr<const wide_netlist> topology):
+        wide_nmos(desc, std::move(topology))
+    {}
+
+    virtual const char *name() const noexcept final
+    {
+        return "inverter";
+    }
+};
+
+bool
+check_rails(const char *test_name,
+            const wide_chip_description& desc,
+            std::shared_ptr<const wide_netlist> topology)
+{
+    if (not topology) {
+        fprintf(stderr, "%s: not loaded\n", test_name);
+        return false;
+    }
+    if (topology->external_id(topology->power) != desc.node_power
+            or topology->external_id(topology->ground) != desc.node_ground)
+    {
+        fprintf(stderr, "%s: rails %u %u, expected %u %u\n", test_name,
+                unsigned(topology->external_id(topology->power)),
+                unsigned(topology->external_id(topology->ground)),
+                unsigned(desc.node_power),
+                unsigned(desc.node_ground));
+        return false;
+    }
+
+    inverter_chip chip(desc, topology);
+
+    chip.stabilize_network();
+    for (bool value : {true, false, true}) {
+        chip.set_node(input, value);
+        chip.recalc();
+        if (chip.get_node(output) == value) {
+            fprintf(stderr, "%s: input %d, output %d\n", test_name,
+                    int(value), int(chip.get_node(output)));
+            return false;
+        }
+    }
+    return true;
+}
+
+/* The last words of the packed nodes, just before the pullups, are
+ * overwritten - the image keeps its size, and must be refused by load.
+ */
+bool
+test_corrupted_image(const inverter& source)
+{
+    const wide_chip_description& desc = source.description;
+    const wide_netlist built(desc);
+    std::vector<unsigned char> image;
+
+    built.save(image_path);
+    if (FILE *file = fopen(image_path, "rb")) {
+        int c;
+
+        while ((c = fgetc(file)) != EOF) {
+            image.push_back((unsigned char)c);
+        }
+        fclose(file);
+    }
+
+    const size_t pullups_size = node_count + 1;
+
+    for (size_t i = 1; i <= 64; ++i) {
+        image[image.size() - pullups_size - i] = 0xff;
+    }
+    if (FILE *file = fopen(image_path, "wb")) {
+        fwrite(image.data(), 1, image.size(), file);
+        fclose(file);
+    }
+
+    const bool refused = not wide_netlist::load(image_path, desc);
+
+    remove(image_path);
+    if (not refused) {
+        fprintf(stderr, "corrupted image: loaded\n");
+    }
+    return refused;
+}
+
+bool
+test_rails(const char *test_name, const inverter& source, node_order order)
+{
+    const wide_chip_description& desc = source.description;
+    auto built = std::make_shared<const wide_netlist>(desc, order);
+    bool ok = check_rails(test_name, desc, built);
+
+    built->save(image_path);
+    ok = check_rails(test_name, desc, wide_netlist::load(image_path, desc))
+         and ok;
+    remove(image_path);
+    return ok;
+}
+
+}
+
+int main()
+{
+    const inverter high_rails(node_count - 1, node_count);
+    const inverter low_rails(1, 2);
+    bool ok = true;
+
+    ok = test_rails("rails above 65535", high_rails, node_order::description)
+         and ok;
+    ok = test_rails("rails renumbered", high_rails, node_order::connectivity)
+         and ok;
+    ok = test_rails("rails renumbered last", low_rails,
+                    node_order::connectivity)
+         and ok;
+    ok = test_corrupted_image(low_rails) and ok;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,299 @@
+/* Every lane of the bit-sliced engine must follow the same trajectory as
+ * a chip simulated by the nmos engine, driven with the same inputs.
+ *
+ * The netlists are generated in levels: the legs of a transistor are
+ * in the same level, or are the rails, and its gate is in a lower level,
+ * or is a rail - thus the networks never oscillate. Each lane is driven
+ * by its own sequence of input toggles, so the groups visited in the
+ * lanes of one recalc() differ.
+ */
+
+#include "nmos.h"
+#include "nmos_bitsliced.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using chipemu::implementation::chip_description;
+using chipemu::implementation::nmos;
+using chipemu::implementation::nmos_bitsliced;
+using chipemu::implementation::transdef;
+
+namespace
+{
+
+constexpr uint16_t power = 1;
+constexpr uint16_t ground = 2;
+
+struct netlist
+{
+    std::vector<transdef> transistors;
+    std::unique_ptr<bool[]> pullups;
+    std::vector<uint16_t> inputs;
+    chip_description description;
+
+    netlist(unsigned node_count,
+            std::vector<transdef> transistor_list,
+            const std::vector<uint16_t>& pullup_nodes,
+            std::vector<uint16_t> input_nodes):
+        transistors(std::move(transistor_list)),
+        pullups(new bool[node_count]()),
+        inputs(std::move(input_nodes)),
+        description{node_count,
+                    pullups.get(),
+                    unsigned(transistors.size()),
+                    transistors.data(),
+                    power,
+                    ground}
+    {
+        for (uint16_t id : pullup_nodes) {
+            pullups[id - 1] = true;
+        }
+    }
+};
+
+class scalar_chip : public nmos
+{
+public:
+
+    explicit scalar_chip(const chip_description& desc):
+        nmos(desc)
+    {}
+
+    virtual const char *name() const noexcept final
+    {
+        return "scalar";
+    }
+};
+
+class lanes_chip : public nmos_bitsliced
+{
+public:
+
+    explicit lanes_chip(const chip_description& desc):
+        nmos_bitsliced(desc)
+    {}
+
+    virtual const char *name() const noexcept final
+    {
+        return "lanes";
+    }
+};
+
+/* Applies the same steps to a scalar chip in each lane, and to the
+ * lanes, comparing every node after each recalc().
+ */
+class comparison
+{
+    const netlist& source;
+    const char *test_name;
+    std::vector<std::unique_ptr<scalar_chip>> scalars;
+    lanes_chip lanes;
+
+public:
+
+    comparison(const netlist& net, const char *name):
+        source(net),
+        test_name(name),
+        lanes(net.description)
+    {
+        for (unsigned lane = 0; lane < nmos_bitsliced::lane_count; ++lane) {
+            scalars.emplace_back(new scalar_chip(net.description));
+            scalars.back()->stabilize_network();
+        }
+        lanes.stabilize_network();
+    }
+
+    void set_node(unsigned lane, uint16_t id, bool value)
+    {
+        scalars[lane]->set_node(id, value);
+        lanes.set_node(lane, id, value);
+    }
+
+    bool recalc()
+    {
+        for (auto& scalar : scalars) {
+            scalar->recalc();
+        }
+        lanes.recalc();
+        return check();
+    }
+
+    bool check() const
+    {
+        for (unsigned lane = 0; lane < nmos_bitsliced::lane_count; ++lane) {
+            for (unsigned id = 1; id <= source.description.node_count; ++id) {
+                if (scalars[lane]->get_node(id) != lanes.get_node(lane, id)) {
+                    fprintf(stderr, "%s: lane %u node %u is %d, expected %d\n",
+                            test_name, lane, id,
+                            int(lanes.get_node(lane, id)),
+                            int(scalars[lane]->get_node(id)));
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool expect(uint16_t id, bool value) const
+    {
+        if (scalars[0]->get_node(id) != value) {
+            fprintf(stderr, "%s: node %u is %d, expected %d\n",
+                    test_name, unsigned(id),
+                    int(scalars[0]->get_node(id)), int(value));
+            return false;
+        }
+        return true;
+    }
+};
+
+/* A node left floating high decides the value of its group, even when
+ * a pulled down node is found after it - charge sharing between X, Y and
+ * the input Z.
+ */
+bool
+test_floating_high()
+{
+    const uint16_t enable_xy = 3;
+    const uint16_t enable_xz = 4;
+    const uint16_t charge = 5;
+    const uint16_t x = 6;
+    const uint16_t y = 7;
+    const uint16_t z = 8;
+    const netlist net(8,
+                      {{charge, y, power},
+                       {enable_xy, x, y},
+                       {enable_xz, x, z}},
+                      {},
+                      {});
+    comparison chips(net, "floating high");
+    const unsigned lanes = nmos_bitsliced::lane_count;
+    bool ok = chips.check();
+
+    for (unsigned lane = 0; lane < lanes; ++lane) {
+        chips.set_node(lane, charge, true);
+        chips.set_node(lane, z, true);
+    }
+    ok = ok and chips.recalc();
+    for (unsigned lane = 0; lane < lanes; ++lane) {
+        chips.set_node(lane, charge, false);
+        chips.set_node(lane, z, false);
+    }
+    ok = ok and chips.recalc();
+    for (unsigned lane = 0; lane < lanes; ++lane) {
+        chips.set_node(lane, enable_xy, true);
+        chips.set_node(lane, enable_xz, true);
+    }
+    ok = ok and chips.recalc();
+    return ok and chips.expect(x, true) and chips.expect(y, true)
+           and chips.expect(z, true);
+}
+
+/* A transistor gated by power starts in the off state, and never
+ * toggles.
+ */
+bool
+test_gated_by_power()
+{
+    const uint16_t node = 3;
+    const netlist net(3, {{power, node, ground}}, {node}, {});
+    comparison chips(net, "gated by power");
+
+    return chips.check() and chips.expect(node, true);
+}
+
+netlist
+random_netlist(std::mt19937& random)
+{
+    const unsigned level_count = 4;
+    const unsigned level_size = 4;
+    const unsigned input_count = 4;
+    std::vector<transdef> transistors;
+    std::vector<uint16_t> pullups;
+    std::vector<uint16_t> inputs;
+    std::vector<uint16_t> gates;
+    uint16_t next_id = 3;
+
+    for (unsigned i = 0; i < input_count; ++i) {
+        inputs.push_back(next_id);
+        gates.push_back(next_id++);
+    }
+    gates.push_back(power);
+    gates.push_back(ground);
+    for (unsigned level = 0; level < level_count; ++level) {
+        std::vector<uint16_t> legs = {power, ground, power, ground};
+        const uint16_t first = next_id;
+
+        for (unsigned i = 0; i < level_size; ++i) {
+            if (random() % 2 == 0) {
+                pullups.push_back(next_id);
+            }
+            legs.push_back(next_id++);
+        }
+
+        const unsigned count = level_size + random() % (2 * level_size);
+
+        for (unsigned i = 0; i < count; ++i) {
+            const uint16_t gate = gates[random() % gates.size()];
+            const uint16_t c1 = legs[random() % legs.size()];
+            uint16_t c2 = legs[random() % legs.size()];
+
+            if (c1 < first and c2 < first) {
+                c2 = uint16_t(first + random() % level_size);
+            }
+            transistors.push_back({gate, c1, c2});
+        }
+        for (uint16_t id = first; id < next_id; ++id) {
+            gates.push_back(id);
+        }
+    }
+    return netlist(next_id - 1u, std::move(transistors), pullups, inputs);
+}
+
+bool
+test_random_netlists()
+{
+    std::mt19937 random(6502);
+    const unsigned lanes = nmos_bitsliced::lane_count;
+
+    for (unsigned n = 0; n < 200; ++n) {
+        const netlist net = random_netlist(random);
+        comparison chips(net, "random netlist");
+
+        if (not chips.check()) {
+            fprintf(stderr, "netlist #%u\n", n);
+            return false;
+        }
+        for (unsigned step = 0; step < 64; ++step) {
+            for (unsigned lane = 0; lane < lanes; ++lane) {
+                const unsigned toggles = random() % 3;
+
+                for (unsigned i = 0; i < toggles; ++i) {
+                    const uint16_t id = net.inputs[random() % net.inputs.size()];
+
+                    chips.set_node(lane, id, random() % 2 == 0);
+                }
+            }
+            if (not chips.recalc()) {
+                fprintf(stderr, "netlist #%u, step %u\n", n, step);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}
+
+int main()
+{
+    bool ok = true;
+
+    ok = test_floating_high() and ok;
+    ok = test_gated_by_power() and ok;
+    ok = test_random_netlists() and ok;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,114 @@
+/* recalc with worker threads must leave the chip in the same state as
+ * recalc with a single thread, after every recalc.
+ *
+ * The netlists change hundreds of nodes at once, so the queue of changed
+ * nodes is processed in batches, and the speculative groups built by the
+ * workers are often touched by the groups committed before them - see
+ * parallel_recalc. The random netlists are generated in levels, like the
+ * ones in nmos_bitsliced_test.cc, wide enough to fill several batches.
+ */
+
+#include "synthetic.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using chipemu::bench::synthetic_chip;
+using chipemu::bench::synthetic_netlist;
+
+namespace
+{
+
+synthetic_netlist
+random_netlist(std::mt19937& random, unsigned index)
+{
+    const unsigned level_count = 4;
+    const unsigned level_size = 256;
+    const unsigned input_count = 4;
+    const uint32_t power = synthetic_netlist::power;
+    const uint32_t ground = synthetic_netlist::ground;
+    synthetic_netlist result;
+    std::vector<uint32_t> gates;
+
+    result.name = "random/" + std::to_string(index);
+    result.pullups.assign(3, false);
+    for (unsigned i = 0; i < input_count; ++i) {
+        result.pullups.push_back(false);
+        result.inputs.push_back(uint32_t(result.pullups.size() - 1));
+        gates.push_back(result.inputs.back());
+    }
+    for (unsigned level = 0; level < level_count; ++level) {
+        const uint32_t first = uint32_t(result.pullups.size());
+
+        for (unsigned i = 0; i < level_size; ++i) {
+            result.pullups.push_back(random() % 4 != 0);
+        }
+
+        auto leg = [&]() {
+            const unsigned pick = random() % 8;
+
+            return pick == 0 ? power
+                 : pick == 1 ? ground
+                 : uint32_t(first + random() % level_size);
+        };
+
+        for (unsigned i = 0; i < 3 * level_size; ++i) {
+            result.transistors.push_back(gates[random() % gates.size()]);
+            result.transistors.push_back(uint32_t(first + random() % level_size));
+            result.transistors.push_back(leg());
+        }
+        for (uint32_t id = first; id < first + level_size; ++id) {
+            gates.push_back(id);
+        }
+    }
+    for (unsigned i = 0; i < 32; ++i) {
+        result.outputs.push_back(gates[gates.size() - 1 - i]);
+    }
+    return result;
+}
+
+bool
+compare(const synthetic_netlist& source, unsigned thread_count)
+{
+    const unsigned half_cycles = 64;
+    std::unique_ptr<synthetic_chip> serial(synthetic_chip::create(source));
+    std::unique_ptr<synthetic_chip> parallel(synthetic_chip::create(source));
+
+    serial->set_thread_count(1);
+    parallel->set_thread_count(thread_count);
+    for (unsigned i = 0; i < half_cycles; ++i) {
+        serial->half_cycle();
+        parallel->half_cycle();
+        if (serial->snapshot() != parallel->snapshot()) {
+            fprintf(stderr, "%s, %u threads: differs after half-cycle %u\n",
+                    source.name.c_str(), thread_count, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main()
+{
+    std::mt19937 random(6510);
+    std::vector<synthetic_netlist> netlists = {
+        chipemu::bench::pass_transistor_bus(512),
+        chipemu::bench::inverter_ring(512)
+    };
+    bool ok = true;
+
+    for (unsigned i = 0; i < 8; ++i) {
+        netlists.push_back(random_netlist(random, i));
+    }
+    for (const synthetic_netlist& source : netlists) {
+        for (unsigned threads : {2, 4}) {
+            ok = compare(source, threads) and ok;
+        }
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,113 @@
+/* A chip partitioned into regions must follow the same trajectory as the
+ * serial engine, driven with the same inputs, comparing snapshots after
+ * every recalc.
+ *
+ * The order the nodes are evaluated in differs between the engines, thus
+ * the netlists here have no races: every node of the random netlists has
+ * a pullup, and they are generated in levels, like the ones in
+ * nmos_bitsliced_test.cc - the state after a recalc only depends on the
+ * inputs.
+ */
+
+#include "synthetic.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using chipemu::bench::synthetic_chip;
+using chipemu::bench::synthetic_netlist;
+
+namespace
+{
+
+synthetic_netlist
+random_netlist(std::mt19937& random, unsigned index)
+{
+    const unsigned level_count = 4;
+    const unsigned level_size = 64;
+    const unsigned input_count = 4;
+    const uint32_t ground = synthetic_netlist::ground;
+    synthetic_netlist result;
+    std::vector<uint32_t> gates;
+
+    result.name = "random/" + std::to_string(index);
+    result.pullups.assign(3, false);
+    for (unsigned i = 0; i < input_count; ++i) {
+        result.pullups.push_back(false);
+        result.inputs.push_back(uint32_t(result.pullups.size() - 1));
+        gates.push_back(result.inputs.back());
+    }
+    for (unsigned level = 0; level < level_count; ++level) {
+        const uint32_t first = uint32_t(result.pullups.size());
+
+        result.pullups.resize(first + level_size, true);
+        for (unsigned i = 0; i < 2 * level_size; ++i) {
+            const uint32_t c1 = uint32_t(first + random() % level_size);
+            const uint32_t c2 = random() % 4 == 0
+                                ? ground
+                                : uint32_t(first + random() % level_size);
+
+            result.transistors.push_back(gates[random() % gates.size()]);
+            result.transistors.push_back(c1);
+            result.transistors.push_back(c2);
+        }
+        for (uint32_t id = first; id < first + level_size; ++id) {
+            gates.push_back(id);
+        }
+    }
+    for (unsigned i = 0; i < 32; ++i) {
+        result.outputs.push_back(gates[gates.size() - 1 - i]);
+    }
+    return result;
+}
+
+bool
+compare(const synthetic_netlist& source, unsigned region_count)
+{
+    const unsigned half_cycles = 64;
+    std::unique_ptr<synthetic_chip> serial(synthetic_chip::create(source));
+    std::unique_ptr<synthetic_chip> partitioned(
+        synthetic_chip::create_partitioned(source, region_count));
+
+    if (serial->snapshot() != partitioned->snapshot()) {
+        fprintf(stderr, "%s, %u regions: differs after stabilize_network\n",
+                source.name.c_str(), region_count);
+        return false;
+    }
+    for (unsigned i = 0; i < half_cycles; ++i) {
+        serial->half_cycle();
+        partitioned->half_cycle();
+        if (serial->snapshot() != partitioned->snapshot()) {
+            fprintf(stderr, "%s, %u regions: differs after half-cycle %u\n",
+                    source.name.c_str(), region_count, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main()
+{
+    std::mt19937 random(6510);
+    std::vector<synthetic_netlist> netlists = {
+        chipemu::bench::inverter_chain(256),
+        chipemu::bench::inverter_ring(256),
+        chipemu::bench::pass_transistor_bus(256)
+    };
+    bool ok = true;
+
+    for (unsigned i = 0; i < 8; ++i) {
+        netlists.push_back(random_netlist(random, i));
+    }
+    for (const synthetic_netlist& source : netlists) {
+        for (unsigned regions : {1, 2, 4}) {
+            ok = compare(source, regions) and ok;
+        }
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
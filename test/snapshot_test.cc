@@ -0,0 +1,265 @@
+/* A chip restored from a snapshot must continue exactly the way it did
+ * after the snapshot was taken, and so must a clone.
+ *
+ * The 6502 runs a short loop storing to memory, the state after running
+ * some more cycles is compared as a snapshot, along with the memory.
+ * The lanes of the bit-sliced 6502 each run the loop with a different
+ * value. The snapshots of the serial, and the partitioned engines share
+ * their layout, a snapshot of one is restored into the other, using the
+ * generated netlists of chipemu_bench.
+ */
+
+#include "mos65xx.h"
+#include "synthetic.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using chipemu::MOS6500;
+using chipemu::MOS6502;
+using chipemu::MOS6502_lanes;
+using chipemu::bench::synthetic_chip;
+using chipemu::bench::synthetic_netlist;
+
+namespace
+{
+
+typedef std::vector<unsigned char> blob;
+
+/* LDX #value; loop: TXA; STA $0300,X; INX; JMP loop */
+class ram : public chipemu::bus_handler
+{
+public:
+
+    std::vector<unsigned char> data;
+
+    explicit ram(unsigned char value):
+        data(0x10000, 0)
+    {
+        const unsigned char program[] = {
+            0xa2, value,
+            0x8a,
+            0x9d, 0x00, 0x03,
+            0xe8,
+            0x4c, 0x02, 0x02
+        };
+
+        std::copy(program, program + sizeof(program), data.begin() + 0x200);
+        data[0xfffc] = 0x00;
+        data[0xfffd] = 0x02;
+    }
+
+    virtual unsigned char read(unsigned address) final
+    {
+        return data[address];
+    }
+
+    virtual void write(unsigned address, unsigned char value) final
+    {
+        data[address] = value;
+    }
+};
+
+void
+reset(MOS6502& cpu, ram& memory)
+{
+    cpu.pin_write(MOS6502::RES, false);
+    cpu.pin_write(MOS6502::CLK0IN, true);
+    cpu.pin_write(MOS6502::RDY, true);
+    cpu.pin_write(MOS6502::SO, false);
+    cpu.pin_write(MOS6502::IRQ, true);
+    cpu.pin_write(MOS6502::NMI, true);
+    cpu.stabilize_network();
+    cpu.run_cycles(8, memory);
+    cpu.pin_write(MOS6502::RES, true);
+    cpu.recalc();
+}
+
+bool
+report(const char *test_name, bool ok)
+{
+    if (not ok) {
+        fprintf(stderr, "%s: state differs\n", test_name);
+    }
+    return ok;
+}
+
+bool
+test_6502()
+{
+    const unsigned before = 100;
+    const unsigned after = 200;
+    std::unique_ptr<MOS6502> cpu(MOS6502::create());
+    ram memory(0);
+
+    reset(*cpu, memory);
+    cpu->run_cycles(before, memory);
+
+    const blob saved = cpu->snapshot();
+    const ram saved_memory = memory;
+    std::unique_ptr<MOS6500> copy(cpu->clone());
+
+    cpu->run_cycles(after, memory);
+
+    const blob expected = cpu->snapshot();
+    const ram expected_memory = memory;
+    bool ok = true;
+
+    memory = saved_memory;
+    cpu->restore(saved);
+    cpu->run_cycles(after, memory);
+    ok = report("6502 restore", cpu->snapshot() == expected
+                                and memory.data == expected_memory.data)
+         and ok;
+
+    memory = saved_memory;
+    copy->run_cycles(after, memory);
+    ok = report("6502 clone", copy->snapshot() == expected
+                              and memory.data == expected_memory.data)
+         and ok;
+    return ok;
+}
+
+void
+run_lanes(MOS6502_lanes& cpu, std::vector<ram>& memory, unsigned count)
+{
+    while (count-- > 0) {
+        cpu.pin_write_all(MOS6502::CLK0IN, false);
+        cpu.recalc();
+        cpu.pin_write_all(MOS6502::CLK0IN, true);
+        cpu.recalc();
+        for (unsigned lane = 0; lane < cpu.lane_count(); ++lane) {
+            const unsigned address = cpu.read_address_bus(lane);
+
+            if (cpu.pin_read(lane, MOS6502::RW)) {
+                cpu.write_data_bus(lane, memory[lane].data[address]);
+            }
+            else {
+                memory[lane].data[address] = cpu.read_data_bus(lane);
+            }
+        }
+    }
+}
+
+bool
+test_6502_lanes()
+{
+    const unsigned before = 100;
+    const unsigned after = 200;
+    std::unique_ptr<MOS6502_lanes> cpu(MOS6502_lanes::create());
+    std::vector<ram> memory;
+
+    for (unsigned lane = 0; lane < cpu->lane_count(); ++lane) {
+        memory.emplace_back((unsigned char)(lane * 3));
+    }
+    cpu->pin_write_all(MOS6502::RES, false);
+    cpu->pin_write_all(MOS6502::CLK0IN, true);
+    cpu->pin_write_all(MOS6502::RDY, true);
+    cpu->pin_write_all(MOS6502::SO, false);
+    cpu->pin_write_all(MOS6502::IRQ, true);
+    cpu->pin_write_all(MOS6502::NMI, true);
+    cpu->stabilize_network();
+    run_lanes(*cpu, memory, 8);
+    cpu->pin_write_all(MOS6502::RES, true);
+    cpu->recalc();
+    run_lanes(*cpu, memory, before);
+
+    const blob saved = cpu->snapshot();
+    const std::vector<ram> saved_memory = memory;
+
+    run_lanes(*cpu, memory, after);
+
+    const blob expected = cpu->snapshot();
+    const std::vector<ram> expected_memory = memory;
+
+    memory = saved_memory;
+    cpu->restore(saved);
+    run_lanes(*cpu, memory, after);
+
+    bool same_memory = true;
+
+    for (unsigned lane = 0; lane < cpu->lane_count(); ++lane) {
+        same_memory = same_memory
+                      and memory[lane].data == expected_memory[lane].data;
+    }
+    return report("6502 lanes restore",
+                  cpu->snapshot() == expected and same_memory);
+}
+
+void
+half_cycles(synthetic_chip& chip, unsigned count)
+{
+    while (count-- > 0) {
+        chip.half_cycle();
+    }
+}
+
+/* The counts of half-cycles are multiples of the number of inputs of
+ * the netlists, so every chip toggles the same input next.
+ */
+bool
+test_partitioned(const synthetic_netlist& source, unsigned region_count)
+{
+    const unsigned before = 40;
+    const unsigned after = 80;
+    std::unique_ptr<synthetic_chip> serial(synthetic_chip::create(source));
+    std::unique_ptr<synthetic_chip> partitioned(
+        synthetic_chip::create_partitioned(source, region_count));
+    bool ok = true;
+
+    half_cycles(*serial, before);
+
+    const blob saved = serial->snapshot();
+
+    partitioned->restore(saved);
+    ok = report("serial to partitioned", partitioned->snapshot() == saved)
+         and ok;
+
+    half_cycles(*serial, after);
+    half_cycles(*partitioned, after);
+
+    const blob expected = partitioned->snapshot();
+
+    ok = report("partitioned after restore", serial->snapshot() == expected)
+         and ok;
+
+    serial->restore(saved);
+    half_cycles(*serial, after);
+    ok = report("serial restore", serial->snapshot() == expected) and ok;
+
+    partitioned->restore(saved);
+    half_cycles(*partitioned, after);
+    ok = report("partitioned restore", partitioned->snapshot() == expected)
+         and ok;
+
+    serial->restore(expected);
+    ok = report("partitioned to serial", serial->snapshot() == expected)
+         and ok;
+    return ok;
+}
+
+}
+
+int main()
+{
+    bool ok = true;
+
+    ok = test_6502() and ok;
+    ok = test_6502_lanes() and ok;
+    for (const synthetic_netlist& source :
+         {chipemu::bench::inverter_chain(64),
+          chipemu::bench::inverter_ring(64),
+          chipemu::bench::pass_transistor_bus(64)})
+    {
+        for (unsigned regions : {2, 4}) {
+            if (not test_partitioned(source, regions)) {
+                fprintf(stderr, "%s, %u regions\n",
+                        source.name.c_str(), regions);
+                ok = false;
+            }
+        }
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
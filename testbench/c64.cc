@@ -8,6 +8,15 @@ namespace
 
 #include "c64_basic_hex.inc"
 
+/* The bank configurations of the PLA, keyed by the LORAM, HIRAM, and
+ * CHAREN bits of the 6510 port: BASIC is mapped when both LORAM, and
+ * HIRAM are high, the kernel when HIRAM is high.
+ */
+constexpr unsigned bank_port_mask = 7;
+constexpr memory::bank_set basic_banks = (1 << 3) | (1 << 7);
+constexpr memory::bank_set kernel_banks =
+    (1 << 2) | (1 << 3) | (1 << 6) | (1 << 7);
+
 }
 
 class C64 : public commodore
@@ -15,10 +24,13 @@ class C64 : public commodore
 
 public:
 
-    C64()
+    C64():
+        commodore(kernel_banks)
     {
-        memory.add_ROM(0xa000, c64_basic, 0x2000);
-        memory.add_ROM(0xe000, c64_basic + 0x2000, c64_basic_len - 0x2000);
+        memory.enable_bank_port(bank_port_mask);
+        memory.add_ROM(0xa000, c64_basic, 0x2000, basic_banks);
+        memory.add_ROM(0xe000, c64_basic + 0x2000, c64_basic_len - 0x2000,
+                       kernel_banks);
         memory.add_RAM(0, 0x10000);
 
         *mem_top_high = 0xa0;
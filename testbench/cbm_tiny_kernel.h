@@ -17,4 +17,8 @@
 #define OFF_RAM_TOP 7
 #define OFF_RAM_BOTTOM 9
 
+/* variables of the kernel, see cbm_tiny_kernel.s */
+#define OFF_VAR0 (REGISTERS_SIZE - 5)
+#define OFF_LAST_CHAR (REGISTERS_SIZE - 6)
+
 #endif
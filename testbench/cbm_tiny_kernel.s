@@ -17,8 +17,8 @@
 /* Variables used by kernel */
 #define RAM_TOP_CURRENT REGISTERS_START+REGISTERS_SIZE-2
 #define RAM_BOT_CURRENT REGISTERS_START+REGISTERS_SIZE-4
-#define VAR0 REGISTERS_START + REGISTERS_SIZE - 5
-#define LAST_CHAR REGISTERS_START + REGISTERS_SIZE - 6
+#define VAR0 REGISTERS_START + OFF_VAR0
+#define LAST_CHAR REGISTERS_START + OFF_LAST_CHAR
 
 #define CBM_CR $0d
 #define CBM_CLR $93
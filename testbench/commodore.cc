@@ -14,6 +14,16 @@ namespace
 #include "cbm_tiny_kernel.h"
 #include "cbm_tiny_kernel_hex.inc"
 
+/* see cbm_tiny_kernel.s */
+constexpr unsigned char CBM_CR = 0x0d;
+constexpr unsigned char CBM_CLR = 0x93;
+constexpr unsigned char ASCII_NL = 0x0a;
+constexpr unsigned char ASCII_FF = 0x0c;
+
+constexpr unsigned char flag_C = 0x01;
+constexpr unsigned char flag_Z = 0x02;
+constexpr unsigned char flag_N = 0x80;
+
 class kernel_registers_class : public address_range
 {
 public:
@@ -60,7 +70,7 @@ unsigned char* register_addr(const std::shared_ptr<address_range>& registers,
 
 }
 
-commodore::commodore():
+commodore::commodore(memory::bank_set kernel_banks):
     kernel_registers(new kernel_registers_class),
     mem_top_high(register_addr(kernel_registers, OFF_RAM_TOP + 1)),
     mem_top_low(register_addr(kernel_registers, OFF_RAM_TOP + 0)),
@@ -69,12 +79,30 @@ commodore::commodore():
     basic_entry_high(register_addr(kernel_registers, OFF_BASIC_ENTRY + 1)),
     basic_entry_low(register_addr(kernel_registers, OFF_BASIC_ENTRY + 0)),
     screen_width(register_addr(kernel_registers, OFF_SCREEN_WIDTH)),
-    screen_height(register_addr(kernel_registers, OFF_SCREEN_HEIGHT))
+    screen_height(register_addr(kernel_registers, OFF_SCREEN_HEIGHT)),
+    select(register_addr(kernel_registers, OFF_SELECT)),
+    io(register_addr(kernel_registers, OFF_IO)),
+    ack(register_addr(kernel_registers, OFF_ACK)),
+    var0(register_addr(kernel_registers, OFF_VAR0)),
+    last_char(register_addr(kernel_registers, OFF_LAST_CHAR)),
+    input(nullptr),
+    output(nullptr)
 {
     memory.add_ROM(0x10000 - cbm_tiny_kernel_len,
 				   cbm_tiny_kernel,
-				   cbm_tiny_kernel_len);
-    memory.add_range(kernel_registers);
+				   cbm_tiny_kernel_len,
+                   kernel_banks);
+    memory.add_range(kernel_registers, kernel_banks);
+
+    /* the kernel writes SEL, then IO, or ACK to talk to the host */
+    memory.add_write_hook(REGISTERS_START + OFF_SELECT, 3,
+                          [this](unsigned, unsigned char) {
+                              on_kernel_write();
+                          });
+    memory.add_fetch_hook(syscall_first, syscall_last + 1 - syscall_first,
+                          [this](unsigned address, unsigned char) {
+                              on_syscall(address);
+                          });
 }
 
 static bool handle_chrin(unsigned char *io,
@@ -111,24 +139,94 @@ static bool handle_chrout(unsigned char *io, FILE *output)
     }
 }
 
-static bool is_syscall_address(unsigned address)
+void commodore::on_start(FILE *input_file, FILE *output_file)
 {
-    return (address >= 0xff81)
-           and (address <= 0xfff3)
-           and (address - 0xff81) % 3 == 0;
+    input = input_file;
+    output = output_file;
 }
 
-void commodore::on_CPU_cycle(FILE *input, FILE *output,
-                             unsigned long long cycle) 
+void commodore::enable_high_level_emulation()
 {
-    unsigned char * const select = register_addr(kernel_registers, OFF_SELECT);
-    unsigned char * const io = register_addr(kernel_registers, OFF_IO);
-    unsigned char * const ack = register_addr(kernel_registers, OFF_ACK);
-    bool clear_all;
+    add_subroutine(syscall_chrin,
+                   [this](chipemu::MOS6500::instruction_state& state) {
+                       chrin(state);
+                   });
+    add_subroutine(syscall_chrout,
+                   [this](chipemu::MOS6500::instruction_state& state) {
+                       chrout(state);
+                   });
+}
 
-    if (is_trace_enabled() and is_syscall_address(CPU()->PC())) {
-        print_trace("syscall: $%04X\n", CPU()->PC());
+/* the flags set by loading value, followed by clc */
+static void set_flags(chipemu::MOS6500::instruction_state& state,
+                      unsigned char value)
+{
+    state.P &= ~(flag_N | flag_Z | flag_C);
+    if (value == 0) {
+        state.P |= flag_Z;
+    }
+    if (value & 0x80) {
+        state.P |= flag_N;
     }
+}
+
+/* Does what chrin in cbm_tiny_kernel.s does, except waiting for input
+ * forever at the end of the input.
+ */
+void commodore::chrin(chipemu::MOS6500::instruction_state& state)
+{
+    int c = fgetc(input);
+
+    if (c == EOF) {
+        return;
+    }
+    if (c == ASCII_NL) {
+        c = CBM_CR;
+    }
+    else if (c == ASCII_FF) {
+        c = CBM_CLR;
+    }
+    *var0 = state.X;
+    *last_char = (unsigned char)c;
+    state.A = (unsigned char)c;
+    set_flags(state, state.X);    // ldx VAR0; clc
+    return_from_subroutine(state);
+}
+
+void commodore::chrout(chipemu::MOS6500::instruction_state& state)
+{
+    if (state.A == CBM_CR and *last_char == CBM_CR) {
+        *last_char = 0;
+    }
+    else {
+        unsigned char c = state.A;
+
+        if (c == CBM_CR) {
+            c = ASCII_NL;
+        }
+        else if (c == CBM_CLR) {
+            c = ASCII_FF;
+        }
+        *var0 = state.X;
+        if (c != 0) {
+            write_char(c, output);
+        }
+    }
+    set_flags(state, state.A);    // pla; clc
+    return_from_subroutine(state);
+}
+
+void commodore::on_syscall(unsigned address)
+{
+    if (is_trace_enabled() and (address - syscall_first) % 3 == 0) {
+        print_trace("syscall: $%04X\n", address);
+    }
+}
+
+void commodore::on_kernel_write()
+{
+    bool clear_all;
+
     switch (*select) {
         case SELECT_CHRIN:
             clear_all = handle_chrin(io, ack, input);
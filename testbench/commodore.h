@@ -16,11 +16,18 @@ namespace testbench
 class commodore : public machine_6502
 {
 protected:
-    commodore();
+    /* kernel_banks - the bank configurations mapping the kernel ROM, and
+     * the kernel registers, see memory::bank_set
+     */
+    explicit commodore(memory::bank_set kernel_banks = memory::all_banks);
     virtual ~commodore();
 
-    virtual void on_CPU_cycle(FILE *input, FILE *output,
-                              unsigned long long cycle) override final;
+    virtual void on_start(FILE *input, FILE *output) override final;
+
+public:
+    virtual void enable_high_level_emulation() override final;
+
+protected:
 
     const std::shared_ptr<address_range> kernel_registers;
 
@@ -32,6 +39,28 @@ protected:
     unsigned char * const basic_entry_low;
     unsigned char * const screen_width;
     unsigned char * const screen_height;
+
+private:
+
+    /* the jump table of the kernel calls */
+    static constexpr unsigned syscall_first = 0xff81;
+    static constexpr unsigned syscall_last = 0xfff3;
+    static constexpr unsigned syscall_chrin = 0xffcf;
+    static constexpr unsigned syscall_chrout = 0xffd2;
+
+    unsigned char * const select;
+    unsigned char * const io;
+    unsigned char * const ack;
+    unsigned char * const var0;
+    unsigned char * const last_char;
+
+    FILE *input;
+    FILE *output;
+
+    void on_syscall(unsigned address);
+    void on_kernel_write();
+    void chrin(chipemu::MOS6500::instruction_state&);
+    void chrout(chipemu::MOS6500::instruction_state&);
 };
 
 }
@@ -22,6 +22,14 @@ public:
     virtual void disable_trace() = 0;
     virtual bool is_trace_enabled() = 0;
 
+    /* run the first `cycles` cycles at the instruction level */
+    virtual void enable_fast_forward(unsigned long long cycles) = 0;
+
+    /* do the I/O routines of the ROM on the host, instead of running
+     * them on the CPU
+     */
+    virtual void enable_high_level_emulation() = 0;
+
     static machine* create(const char*);
 
     virtual ~machine();
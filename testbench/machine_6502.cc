@@ -9,36 +9,116 @@ namespace testbench
 {
 
 machine_6502::machine_6502():
-    CPU_6502(MOS6502::create())
+    CPU_6502(MOS6502::create()),
+    fast_forward_cycles(0),
+    pending_subroutine(nullptr)
 {}
 
 static void cycle(MOS6502*);
-static void handle_memory(MOS6502*, memory*);
+
+namespace
+{
+
+class memory_bus : public chipemu::bus_handler
+{
+    class memory& memory;
+
+public:
+
+    memory_bus(class memory& target):
+        memory(target)
+    {}
+
+    virtual unsigned char read(unsigned address) override
+    {
+        return memory.read(address);
+    }
+
+    virtual void write(unsigned address, unsigned char value) override
+    {
+        memory.write(address, value);
+    }
+
+    virtual unsigned char fetch(unsigned address) override
+    {
+        return memory.fetch(address);
+    }
+};
+
+}
 
 inline void machine_6502::trace_CPU()
 {
     if (not is_trace_enabled()) return;
 
+    const MOS6502::register_file CPU_state = CPU()->registers();
+
     print_trace("A:%02X X:%02X Y:%02X P:%02X PC:%04X S:%02X"
                 " IR:%02X RW:%d AB:%04X DB:%02X\n",
-                CPU()->A(), CPU()->X(), CPU()->Y(), CPU()->P(),
-                CPU()->PC(), CPU()->S(),
-                (~(CPU()->IR())) & 0xff,
-                CPU()->pin_read(MOS6502::RW),
-                CPU()->read_address_bus(),
-                CPU()->read_data_bus());
-    if (CPU()->pin_read(MOS6502::RW)) {
+                CPU_state.A, CPU_state.X, CPU_state.Y, CPU_state.P,
+                CPU_state.PC, CPU_state.S,
+                (~CPU_state.IR) & 0xff,
+                CPU_state.RW,
+                CPU_state.address_bus,
+                CPU_state.data_bus);
+    if (CPU_state.RW) {
         print_trace(" read $%04X - $%02X\n",
-                    CPU()->read_address_bus(),
-                    memory.read(CPU()->read_address_bus()));
+                    CPU_state.address_bus,
+                    memory.read(CPU_state.address_bus));
     }
     else {
         print_trace(" write $%04X - $%02X\n",
-                    CPU()->read_address_bus(),
-                    CPU()->read_data_bus());
+                    CPU_state.address_bus,
+                    CPU_state.data_bus);
     }
 }
 
+inline void machine_6502::trace_instruction()
+{
+    if (not is_trace_enabled()) return;
+
+    print_trace("A:%02X X:%02X Y:%02X P:%02X PC:%04X S:%02X IR:%02X\n",
+                instruction_state.A, instruction_state.X,
+                instruction_state.Y, instruction_state.P,
+                instruction_state.PC, instruction_state.S,
+                instruction_state.opcode);
+}
+
+void machine_6502::enable_fast_forward(unsigned long long cycles)
+{
+    fast_forward_cycles = cycles;
+}
+
+/* Runs the CPU at the instruction level, one instruction at a time, until
+ * the cycles requested are over, then hands the state back to the
+ * transistor level emulation.
+ */
+void machine_6502::fast_forward(FILE *input, run_result& result)
+{
+    memory_bus bus(memory);
+
+    print_trace("Fast forward\n");
+    instruction_state = CPU_6502->save_instruction_state(bus,
+                                                         result.cycle_count);
+    while (result.cycle_count < fast_forward_cycles and not feof(input)) {
+        unsigned long long cycles =
+            MOS6502::run_instructions(instruction_state, 1, bus);
+
+        if (cycles == 0) {
+            break;  // not a documented opcode
+        }
+        result.cycle_count += cycles;
+        print_trace("Cycle %llu\n", result.cycle_count);
+        trace_instruction();
+        if (pending_subroutine != nullptr) {
+            (*pending_subroutine)(instruction_state);
+            pending_subroutine = nullptr;
+        }
+    }
+    CPU_6502->load_instruction_state(instruction_state);
+    print_trace("Fast forward - done\n");
+}
+
 inline void machine_6502::initialize_CPU()
 {
     print_trace("Initializing MOS6502\n");
@@ -60,7 +140,6 @@ inline void machine_6502::initialize_CPU()
     print_trace("Initializing MOS6502 - holding RES\n");
     for (int clk = 1; clk <= 8; ++clk) {
         cycle(CPU_6502.get());                        // hold reset for 8 cycles
-        //handle_memory(CPU_6502.get(), &memory);
         trace_CPU();
     }
 
@@ -74,33 +153,65 @@ run_result machine_6502::run(FILE *input, FILE *output)
 {
     std::lock_guard<std::mutex> lock(mutex);
     run_result result = {0};
+    memory_bus bus(memory);
 
+    on_start(input, output);
     initialize_CPU();
+    if (fast_forward_cycles > 0) {
+        fast_forward(input, result);
+    }
     while (not feof(input)) {
-        cycle(CPU_6502.get());
+        CPU_6502->run_cycles(1, bus);
         ++result.cycle_count;
-        handle_memory(CPU_6502.get(), &memory);
         print_trace("Cycle %llu\n", result.cycle_count);
         trace_CPU();
-        on_CPU_cycle(input, output, result.cycle_count);
+        if (pending_subroutine != nullptr) {
+            call_subroutine(bus, result);
+        }
     }
     return result;
 }
 
-machine_6502::~machine_6502()
+void machine_6502::add_subroutine(unsigned address, subroutine routine)
+{
+    const subroutine *target = &(subroutines[address] = routine);
+
+    memory.add_fetch_hook(address, 1,
+                          [this, target](unsigned, unsigned char) {
+                              pending_subroutine = target;
+                          });
+}
+
+void machine_6502::return_from_subroutine(
+                        chipemu::MOS6500::instruction_state& state)
 {
+    unsigned low = memory.read(0x100 | ((state.S + 1) & 0xff));
+    unsigned high = memory.read(0x100 | ((state.S + 2) & 0xff));
+
+    state.S += 2;
+    state.PC = (((high << 8) | low) + 1) & 0xffff;
+    state.opcode = memory.read(state.PC);
+    state.cycle = 1;
 }
 
-static void handle_memory(MOS6502 *CPU, class memory *memory)
+/* The opcode at the address of the subroutine was just fetched, the
+ * state of the CPU is only known at the next instruction boundary.
+ */
+void machine_6502::call_subroutine(chipemu::bus_handler& bus,
+                                   run_result& result)
 {
-    unsigned address = CPU->read_address_bus();
+    const subroutine& routine = *pending_subroutine;
+
+    pending_subroutine = nullptr;
+    instruction_state = CPU_6502->save_instruction_state(bus,
+                                                         result.cycle_count);
+    routine(instruction_state);
+    CPU_6502->load_instruction_state(instruction_state);
+    print_trace("Subroutine - continue at $%04X\n", instruction_state.PC);
+}
 
-    if (CPU->pin_read(MOS6502::RW)) {
-        CPU->write_data_bus(memory->read(address));
-    }
-    else {
-        memory->write(address, CPU->read_data_bus());
-    }
+machine_6502::~machine_6502()
+{
 }
 
 static void cycle(MOS6502 *CPU)
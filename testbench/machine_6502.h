@@ -4,9 +4,10 @@
 
 #include "machine_implementation.h"
 #include "memory.h"
+#include "mos65xx.h"
 
-namespace chipemu { class MOS6502; }
-
+#include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 
@@ -19,8 +20,27 @@ protected:
 
     class memory memory;
 
-    virtual void on_CPU_cycle(FILE *input, FILE *output,
-                              unsigned long long cycle) = 0;
+    /* called by run, before starting the CPU - the machine only
+     * reacts to the CPU via the hooks of memory afterwards
+     */
+    virtual void on_start(FILE *input, FILE *output) = 0;
+
+    /* A high level emulation of a subroutine, called with the state of
+     * the CPU at an instruction boundary, after the subroutine was
+     * entered - it can do what the subroutine would, and return to the
+     * caller using return_from_subroutine, or leave the state unchanged
+     * to let the CPU run the subroutine itself
+     */
+    typedef std::function<void(chipemu::MOS6500::instruction_state&)>
+        subroutine;
+
+    /* calls the subroutine instead of the code at address, when the CPU
+     * fetches an opcode from there, using the state injection of the CPU
+     */
+    void add_subroutine(unsigned address, subroutine);
+
+    /* does what RTS would, pulling the return address from the stack */
+    void return_from_subroutine(chipemu::MOS6500::instruction_state&);
 
     machine_6502();
 
@@ -31,6 +51,9 @@ public:
         return CPU_6502.get();
     }
 
+    virtual void enable_fast_forward(unsigned long long cycles)
+        override final;
+
     virtual ~machine_6502();
 
     virtual run_result run(FILE *input, FILE *output) override final;
@@ -39,8 +62,17 @@ private:
 
     void initialize_CPU();
     void trace_CPU();
+    void trace_instruction();
+    void fast_forward(FILE *input, run_result&);
+    void call_subroutine(chipemu::bus_handler&, run_result&);
     std::mutex mutex;
     const std::unique_ptr<chipemu::MOS6502> CPU_6502;
+    unsigned long long fast_forward_cycles;
+    chipemu::MOS6500::instruction_state instruction_state;
+    std::map<unsigned, subroutine> subroutines;
+
+    /* set by the fetch hook of a subroutine, called after the cycle */
+    const subroutine *pending_subroutine;
 
 };
 
@@ -1,5 +1,6 @@
 
 #include "machine.h"
+#include "mos65xx.h"
  
 #include <exception>
 #include <memory>
@@ -18,6 +19,8 @@ static void usage_exit(int exit_code);
 static void print_run_result(testbench::run_result);
 FILE *trace_file = nullptr;
 bool print_stats_on_exit = false;
+unsigned long long fast_forward_cycles = 0;
+bool high_level_emulation = false;
 
 /* Code for registering machine constructors in other translation units,
  * without recompiling this one.
@@ -37,6 +40,12 @@ int main(int argc, char **argv)
     if (trace_file != nullptr) {
         machine->enable_trace(trace_file);
     }
+    if (fast_forward_cycles > 0) {
+        machine->enable_fast_forward(fast_forward_cycles);
+    }
+    if (high_level_emulation) {
+        machine->enable_high_level_emulation();
+    }
     result = machine->run(stdin, stdout);
     if (print_stats_on_exit) {
         print_run_result(result);
@@ -56,12 +65,22 @@ static void usage_exit(int exit_code)
      "%s\n"
      "Built: " __DATE__ " " __TIME__ "\n"
      "Usage:\n"
-     "%s [-h] [-t path] <machine type>\n"
+     "%s [-h] [-t path] [-n path] [-f cycles] [-e] <machine type>\n"
      "  -h\n"
      "  --help          print this very helpful text, and exit\n"
      "  -s              print some statistics on exit\n"
      "  -t path\n"
      "  --trace path    print trace to file at `path`\n"
+     "  -n path\n"
+     "  --netlist path  load the preprocessed netlist from `path`, or\n"
+     "                  create the file, if it can not be loaded\n"
+     "  -f cycles\n"
+     "  --fast-forward cycles\n"
+     "                  run the first `cycles` cycles at the instruction\n"
+     "                  level, instead of the transistor level\n"
+     "  -e\n"
+     "  --emulate-io    do the character I/O of the kernel on the host,\n"
+     "                  instead of running it on the CPU\n"
      "  <machine type>  basic interpreter to emulate, available choices are:\n",
      project_url,
      program_name ? program_name : "./basic");
@@ -103,6 +122,35 @@ static void setup_trace_path(const char *path)
     }
 }
 
+static void setup_netlist_path(const char *path)
+{
+    if (path == nullptr or path[0] == 0) {
+        usage_exit(2);
+    }
+    if (chipemu::MOS6500::load_netlist(path)) return;
+    try {
+        chipemu::MOS6500::save_netlist(path);
+    }
+    catch (const std::exception& exception) {
+        fprintf(stderr, "Error: %s\n", exception.what());
+        exit(1);
+    }
+}
+
+static void setup_fast_forward(const char *cycles)
+{
+    char *end;
+
+    if (cycles == nullptr or cycles[0] == 0) {
+        usage_exit(2);
+    }
+    errno = 0;
+    fast_forward_cycles = strtoull(cycles, &end, 10);
+    if (*end != 0 or errno != 0) {
+        usage_exit(2);
+    }
+}
+
 static void process_arguments(char **arg)
 {
     if (*arg == nullptr) return;
@@ -116,6 +164,15 @@ static void process_arguments(char **arg)
         else if (argument == "-t" or argument == "--trace") {
             setup_trace_path(*arg++);
         }
+        else if (argument == "-n" or argument == "--netlist") {
+            setup_netlist_path(*arg++);
+        }
+        else if (argument == "-f" or argument == "--fast-forward") {
+            setup_fast_forward(*arg++);
+        }
+        else if (argument == "-e" or argument == "--emulate-io") {
+            high_level_emulation = true;
+        }
         else if (argument == "-s") {
             print_stats_on_exit = true;
         }
@@ -48,6 +48,11 @@ public:
         data[address - start] = value;
     }
 
+    unsigned char *bytes()
+    {
+        return data.data();
+    }
+
 };
 
 class general_ROM : address_range
@@ -95,49 +100,203 @@ public:
 
 }
 
-void memory::add_range(std::shared_ptr<address_range> range)
+constexpr memory::bank_set memory::all_banks;
+
+memory::memory():
+    banks(1),
+    current_bank(0),
+    pages(banks[0].data()),
+    bank_mask(0),
+    port_directions(0),
+    port_data(0)
 {
-    ranges.push_back(range);
+    write_hooked_pages.fill(false);
+    fetch_hooked_pages.fill(false);
+    map_pages();
 }
 
-void memory::add_RAM(unsigned start_address, unsigned size)
+void memory::add_range(std::shared_ptr<address_range> range,
+                       bank_set visible_banks)
 {
-    std::shared_ptr<address_range> RAM;
-    
-    RAM.reset((address_range*)(new general_RAM(start_address, size)));
-    add_range(std::move(RAM));
+    ranges.push_back({range, visible_banks});
+    map_pages();
+}
+
+void memory::add_RAM(unsigned start_address,
+                     unsigned size,
+                     bank_set visible_banks)
+{
+    general_RAM *RAM = new general_RAM(start_address, size);
+
+    plain_ranges.push_back({(address_range*)RAM, start_address,
+                            RAM->bytes(), RAM->bytes()});
+    add_range(std::shared_ptr<address_range>((address_range*)RAM),
+              visible_banks);
 }
 
 void memory::add_ROM(unsigned start_address,
                      const unsigned char *data,
-                     unsigned size)
+                     unsigned size,
+                     bank_set visible_banks)
 {
     std::shared_ptr<address_range> ROM;
     
     ROM.reset((address_range*)(new general_ROM(start_address, data, size)));
-    add_range(std::move(ROM));
+    plain_ranges.push_back({ROM.get(), start_address, data, nullptr});
+    add_range(std::move(ROM), visible_banks);
+}
+
+void memory::enable_bank_port(unsigned mask)
+{
+    bank_mask = mask;
+    banks.resize(mask + 1);
+    add_write_hook(0, 2, [this](unsigned address, unsigned char value) {
+        if (address == 0) {
+            port_directions = value;
+        }
+        else {
+            port_data = value;
+        }
+        select_bank();
+    });
 }
 
-unsigned char memory::read(unsigned address) const noexcept
+void memory::add_hook(std::vector<hooked_range>& hooks,
+                      std::array<bool, 256>& hooked_pages,
+                      unsigned start_address,
+                      unsigned size,
+                      hook function)
 {
-    for (auto range : ranges) {
-        if (range->is_visible() and range->contains(address)) {
-            return range->read(address);
+    hooks.push_back({start_address, size, std::move(function)});
+    for (unsigned address = start_address;
+         address < start_address + size;
+         address += 0x100)
+    {
+        hooked_pages[address >> 8] = true;
+    }
+    hooked_pages[(start_address + size - 1) >> 8] = true;
+}
+
+void memory::call_hooks(const std::vector<hooked_range>& hooks,
+                        unsigned address,
+                        unsigned char value)
+{
+    for (const hooked_range& hooked : hooks) {
+        if (address - hooked.start < hooked.size) {
+            hooked.function(address, value);
         }
     }
-    return 0;
 }
 
-void memory::write(unsigned address, unsigned char value) noexcept
+void memory::add_write_hook(unsigned start_address,
+                            unsigned size,
+                            hook function)
+{
+    add_hook(write_hooks, write_hooked_pages, start_address, size,
+             std::move(function));
+    map_pages();
+}
+
+void memory::add_fetch_hook(unsigned start_address,
+                            unsigned size,
+                            hook function)
 {
-    for (auto range : ranges) {
-        if (range->is_visible() and range->contains(address)) {
-            if (range->is_writable()) {
-                range->write(address, value);
+    add_hook(fetch_hooks, fetch_hooked_pages, start_address, size,
+             std::move(function));
+}
+
+address_range *memory::find_range(unsigned address,
+                                  unsigned bank,
+                                  bool writing) const noexcept
+{
+    for (const auto& mapped : ranges) {
+        if (((mapped.banks >> bank) & 1)
+                and mapped.range->is_visible()
+                and mapped.range->contains(address)
+                and (mapped.range->is_writable() or not writing))
+        {
+            return mapped.range.get();
+        }
+    }
+    return nullptr;
+}
+
+/* the range all of a page is in, or nullptr */
+address_range *memory::find_page_range(unsigned index,
+                                       unsigned bank,
+                                       bool writing) const noexcept
+{
+    const unsigned start = index * 0x100;
+    address_range *range = find_range(start, bank, writing);
+
+    for (unsigned address = start + 1; address < start + 0x100; ++address) {
+        if (find_range(address, bank, writing) != range) {
+            return nullptr;
+        }
+    }
+    return range;
+}
+
+void memory::map_pages()
+{
+    for (unsigned bank = 0; bank < banks.size(); ++bank) {
+        for (unsigned index = 0; index < 256; ++index) {
+            const unsigned offset = index * 0x100;
+            page& target = banks[bank][index];
+
+            target.reader = find_page_range(index, bank, false);
+            target.writer = find_page_range(index, bank, true);
+            target.read_data = nullptr;
+            target.write_data = nullptr;
+            for (const plain_range& plain : plain_ranges) {
+                if (plain.range == target.reader) {
+                    target.read_data =
+                        plain.read_data + (offset - plain.start);
+                }
+                if (plain.range == target.writer
+                        and not write_hooked_pages[index])
+                {
+                    target.write_data =
+                        plain.write_data + (offset - plain.start);
+                }
             }
-            return;
         }
     }
+    select_bank();
+}
+
+void memory::select_bank() noexcept
+{
+    current_bank = (port_data | ~port_directions) & bank_mask;
+    pages = banks[current_bank].data();
+}
+
+unsigned char memory::read_range(unsigned address) const noexcept
+{
+    const address_range *range = pages[address >> 8].reader;
+
+    if (range == nullptr) {
+        range = find_range(address, bank(), false);
+    }
+    if (range != nullptr) {
+        return range->read(address);
+    }
+    return 0;
+}
+
+void memory::write_range(unsigned address, unsigned char value) noexcept
+{
+    address_range *range = pages[address >> 8].writer;
+
+    if (range == nullptr) {
+        range = find_range(address, bank(), true);
+    }
+    if (range != nullptr) {
+        range->write(address, value);
+    }
+    if (write_hooked_pages[address >> 8]) {
+        call_hooks(write_hooks, address, value);
+    }
 }
 
 }
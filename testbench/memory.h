@@ -2,6 +2,9 @@
 #ifndef TESTBENCH_MEMORY_H
 #define TESTBENCH_MEMORY_H
 
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -21,18 +24,181 @@ public:
 
 class memory 
 {
-    std::vector<std::shared_ptr<address_range> > ranges;
+public:
+
+    /* Bank switching, the way the PLA of the C64 does it
+     *
+     * A bank configuration is selected by the bits of the I/O port of
+     * a 6510, see enable_bank_port. Every range is added with the set of
+     * configurations it is visible in - bit N standing for configuration
+     * N - and a page table is kept for each configuration, so switching
+     * between them is just selecting another table.
+     */
+    typedef uint32_t bank_set;
+
+    static constexpr bank_set all_banks = ~bank_set(0);
+
+    /* Called with the address, and the value after a write to, or an
+     * opcode fetch from the addresses it is added for, in every bank
+     * configuration. Only the accesses of the pages holding such
+     * addresses are slowed down by the hooks.
+     */
+    typedef std::function<void(unsigned address, unsigned char value)> hook;
+
+private:
+
+    struct mapped_range
+    {
+        std::shared_ptr<address_range> range;
+        bank_set banks;
+    };
+
+    std::vector<mapped_range> ranges;
+
+    /* The ranges added by add_RAM, and add_ROM, whose bytes can be
+     * accessed directly
+     */
+    struct plain_range
+    {
+        const address_range *range;
+        unsigned start;
+        const unsigned char *read_data;
+        unsigned char *write_data;
+    };
+
+    std::vector<plain_range> plain_ranges;
+
+    /* The page tables, rebuilt whenever a range is added
+     *
+     * Reads go to the first visible range containing the address, in the
+     * order the ranges were added, writes to the first one that is also
+     * writable - as on the C64, where writing to a ROM writes the RAM
+     * under it. If all of a page is read from the same plain range, the
+     * page points to its bytes, the same for writes, unless the page
+     * has write hooks. Otherwise, if all of the page is in the same
+     * range, that range handles it, or the ranges are scanned for each
+     * access, when it is in several.
+     */
+    struct page
+    {
+        const unsigned char *read_data;
+        unsigned char *write_data;
+        address_range *reader;
+        address_range *writer;
+    };
+
+    typedef std::array<page, 256> page_table;
+
+    std::vector<page_table> banks;
+    unsigned current_bank;
+    const page *pages;
+
+    /* The I/O port of the 6510, the data direction register at address
+     * 0, and the data register at address 1 - the bits of the inputs are
+     * high, as the C64 pulls them up. The bank configuration is the value
+     * of the port, masked by bank_mask.
+     */
+    unsigned bank_mask;
+    unsigned char port_directions;
+    unsigned char port_data;
+
+    struct hooked_range
+    {
+        unsigned start;
+        unsigned size;
+        hook function;
+    };
+
+    std::vector<hooked_range> write_hooks;
+    std::vector<hooked_range> fetch_hooks;
+    std::array<bool, 256> write_hooked_pages;
+    std::array<bool, 256> fetch_hooked_pages;
+
+    static void add_hook(std::vector<hooked_range>&,
+                         std::array<bool, 256>& hooked_pages,
+                         unsigned start_address,
+                         unsigned size,
+                         hook);
+    static void call_hooks(const std::vector<hooked_range>&,
+                           unsigned address,
+                           unsigned char value);
+
+    void map_pages();
+    void select_bank() noexcept;
+    address_range *find_range(unsigned address,
+                              unsigned bank,
+                              bool writing) const noexcept;
+    address_range *find_page_range(unsigned index,
+                                   unsigned bank,
+                                   bool writing) const noexcept;
+    unsigned char read_range(unsigned address) const noexcept;
+    void write_range(unsigned address, unsigned char value) noexcept;
 
 public:
 
-    void add_range(std::shared_ptr<address_range>);
-    void add_RAM(unsigned start_address, unsigned size);
+    memory();
+
+    memory(const memory&) = delete;
+    memory& operator=(const memory&) = delete;
+
+    void add_range(std::shared_ptr<address_range>,
+                   bank_set visible_banks = all_banks);
+    void add_RAM(unsigned start_address,
+                 unsigned size,
+                 bank_set visible_banks = all_banks);
     void add_ROM(unsigned start_address,
                  const unsigned char *data,
-                 unsigned size);
+                 unsigned size,
+                 bank_set visible_banks = all_banks);
+
+    /* Selects the bank configurations by the bits in mask of the 6510
+     * port, writes to the addresses 0, and 1 switch between them
+     * afterwards. The mask must be one less than a power of two, at most
+     * 31. Without a bank port, configuration 0 is used.
+     */
+    void enable_bank_port(unsigned mask);
+
+    void add_write_hook(unsigned start_address, unsigned size, hook);
+    void add_fetch_hook(unsigned start_address, unsigned size, hook);
+
+    unsigned bank() const noexcept
+    {
+        return current_bank;
+    }
+
+    /* the address is expected to be below 0x10000 */
+    unsigned char read(unsigned address) const noexcept
+    {
+        const page& target = pages[address >> 8];
+
+        if (target.read_data != nullptr) {
+            return target.read_data[address & 0xff];
+        }
+        return read_range(address);
+    }
+
+    void write(unsigned address, unsigned char value) noexcept
+    {
+        const page& target = pages[address >> 8];
+
+        if (target.write_data != nullptr) {
+            target.write_data[address & 0xff] = value;
+        }
+        else {
+            write_range(address, value);
+        }
+    }
+
+    /* a read of an opcode */
+    unsigned char fetch(unsigned address)
+    {
+        const unsigned char value = read(address);
 
-    unsigned char read(unsigned address) const noexcept;
-    void write(unsigned address, unsigned char value) noexcept;
+        if (fetch_hooked_pages[address >> 8]) {
+            call_hooks(fetch_hooks, address, value);
+        }
+        return value;
+    }
 
 };
 